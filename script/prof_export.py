@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+"""Print a flat profile from the samples written by the prof app.
+
+Kernel samples are symbolized with kernel.elf. As every application is
+linked at the same address, user samples are symbolized with the ELF file
+given for their pid (e.g. 3:images/shell.elf), and are left as addresses
+for the other pids.
+
+Usage: prof_export.py PROF_FILE KERNEL_ELF [PID:APP_ELF]...
+"""
+
+import bisect
+import collections
+import struct
+import subprocess
+import sys
+
+PROF_MAGIC = 0x464F5250
+HEADER = struct.Struct("<4I")  # prof_header_t
+SAMPLE = struct.Struct("<IHH")  # prof_sample_t
+
+
+def load_symbols(elf):
+    """Return the sorted addresses, ends and names of the functions in elf.
+
+    The end is None for a symbol without a size, such as an assembly label.
+    """
+    out = subprocess.run(["nm", "-n", "-S", "--defined-only", elf],
+                         capture_output=True, text=True, check=True).stdout
+    addrs, ends, names = [], [], []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "tT":
+            addr = int(fields[0], 16)
+            end = addr + int(fields[1], 16)
+        elif len(fields) == 3 and fields[1] in "tT":
+            addr, end = int(fields[0], 16), None
+        else:
+            continue
+
+        addrs.append(addr)
+        ends.append(end)
+        names.append(fields[-1])
+
+    return addrs, ends, names
+
+
+def symbolize(table, eip):
+    addrs, ends, names = table
+    i = bisect.bisect_right(addrs, eip) - 1
+    if i < 0 or (ends[i] is not None and eip >= ends[i]):
+        return None
+
+    return names[i]
+
+
+def parse_apps(args):
+    """Map each pid to the name and the symbols of its ELF file."""
+    apps = {}
+    for arg in args:
+        pid, sep, elf = arg.partition(":")
+        if not sep or not pid.isdigit():
+            sys.exit("Expected PID:APP_ELF, got " + arg)
+
+        apps[int(pid)] = (elf.rsplit("/", 1)[-1], load_symbols(elf))
+
+    return apps
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    magic, hz, cnt, lost = HEADER.unpack_from(data)
+    if magic != PROF_MAGIC:
+        sys.exit("Not a profile written by prof: " + sys.argv[1])
+
+    kernel = load_symbols(sys.argv[2])
+    apps = parse_apps(sys.argv[3:])
+
+    counts = collections.Counter()
+    for i in range(cnt):
+        eip, cs, pid = SAMPLE.unpack_from(data, HEADER.size + i * SAMPLE.size)
+        if not cs & 3:
+            name = "[idle]" if pid == 0 else symbolize(kernel, eip)
+            counts[(name or "0x%x" % eip, "kernel")] += 1
+            continue
+
+        name = None
+        if pid in apps:
+            elf, table = apps[pid]
+            name = symbolize(table, eip)
+            if name:
+                name = "%s (%s)" % (name, elf)
+
+        counts[(name or "0x%x (pid %d)" % (eip, pid), "user")] += 1
+
+    print("%d samples at %d Hz, %d lost" % (cnt, hz, lost))
+    print("%8s %7s  %-6s  %s" % ("samples", "%", "mode", "symbol"))
+    for (name, mode), n in counts.most_common():
+        print("%8d %6.2f%%  %-6s  %s" % (n, n * 100.0 / max(cnt, 1), mode, name))
+
+
+if __name__ == "__main__":
+    main()
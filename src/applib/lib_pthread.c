@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "lib_pthread.h"
+#include "comm/cpu_instr.h"
+#include "ipc/futex.h"
+#include "lib_syscall.h"
+#include <errno.h>
+#include <limits.h>
+
+// Not MUTEX_*, which fs/file.h brings in from the kernel's ipc/mutex.h
+#define MTX_UNLOCKED 0
+#define MTX_LOCKED 1
+#define MTX_CONTENDED 2
+
+int pthread_mutex_init(pthread_mutex_t *mutex,
+                       const pthread_mutexattr_t *attr) {
+  *mutex = MTX_UNLOCKED;
+  return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+  return *mutex == MTX_UNLOCKED ? 0 : EBUSY;
+}
+
+// Only enter the kernel when the mutex is owned by others
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  uint32_t state = cmpxchg(mutex, MTX_UNLOCKED, MTX_LOCKED);
+  if (state == MTX_UNLOCKED)
+    return 0;
+
+  // Mark the mutex contended, so that the owner wakes us up when unlocking
+  if (state != MTX_CONTENDED)
+    state = xchg(mutex, MTX_CONTENDED);
+
+  while (state != MTX_UNLOCKED) {
+    futex(mutex, FUTEX_WAIT, MTX_CONTENDED);
+    state = xchg(mutex, MTX_CONTENDED);
+  }
+
+  return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+  return cmpxchg(mutex, MTX_UNLOCKED, MTX_LOCKED) == MTX_UNLOCKED
+             ? 0
+             : EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+  if (xadd(mutex, -1) != MTX_LOCKED) { // contended
+    *mutex = MTX_UNLOCKED;
+    futex(mutex, FUTEX_WAKE, 1);
+  }
+
+  return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
+  *cond = 0;
+  return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond) { return 0; }
+
+/*
+ * If the sequence number changes between unlocking the mutex and sleeping,
+ * FUTEX_WAIT returns at once, so no signal is lost.
+ * The mutex is relocked as contended since other waiters may be woken too.
+ */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  const uint32_t seq = *cond;
+  pthread_mutex_unlock(mutex);
+  futex(cond, FUTEX_WAIT, seq);
+
+  while (xchg(mutex, MTX_CONTENDED) != MTX_UNLOCKED)
+    futex(mutex, FUTEX_WAIT, MTX_CONTENDED);
+
+  return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+  xadd(cond, 1);
+  futex(cond, FUTEX_WAKE, 1);
+  return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+  xadd(cond, 1);
+  futex(cond, FUTEX_WAKE, INT_MAX);
+  return 0;
+}
@@ -4,11 +4,17 @@
 
 #include "lib_syscall.h"
 #include "comm/cpu_instr.h"
+#include "comm/vdso.h"
 #include "core/syscall.h"
 #include "os_cfg.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <sys/fcntl.h>
+#include <sys/time.h>
 
-int sys_call(const syscall_args_t *args) {
+int sys_call_gate(const syscall_args_t *args) {
   const uint32_t addr[] = {0, SYSCALL_SELECTOR | SELECTOR_RPL0};
   int ret;
   __asm__ __volatile__(
@@ -24,6 +30,36 @@ int sys_call(const syscall_args_t *args) {
   return ret;
 }
 
+/*
+ * The arguments are passed in eax, ebx, esi, edi and ebp,
+ * and the kernel returns to the esp in ecx and the eip in edx.
+ */
+int sys_call_sysenter(const syscall_args_t *args) {
+  const syscall_args_t *ptr = args; // ecx is overwritten
+  int ret;
+  __asm__ __volatile__("push %%ebp\n\t"
+                       "mov %c[arg3](%%ecx), %%ebp\n\t"
+                       "mov %%esp, %%ecx\n\t"
+                       "lea 1f, %%edx\n\t"
+                       "sysenter\n\t"
+                       "1:\n\t"
+                       "pop %%ebp"
+                       : "=a"(ret), "+c"(ptr)
+                       : "a"(args->id), "b"(args->arg0), "S"(args->arg1),
+                         "D"(args->arg2),
+                         [arg3] "i"(offsetof(syscall_args_t, arg3))
+                       : "edx", "memory");
+  return ret;
+}
+
+int sys_call(const syscall_args_t *args) {
+  static int has_sep = -1; // not probed yet
+  if (has_sep < 0)
+    has_sep = cpu_has_sep();
+
+  return has_sep ? sys_call_sysenter(args) : sys_call_gate(args);
+}
+
 void msleep(uint32_t time) {
   if (time <= 0)
     return;
@@ -32,10 +68,8 @@ void msleep(uint32_t time) {
   sys_call(&args);
 }
 
-int getpid() {
-  syscall_args_t args = {.id = SYS_GETPID};
-  return sys_call(&args);
-}
+// Read from the page shared with the kernel instead of making a syscall
+int getpid() { return vdso_data()->pid; }
 
 void print_msg(const char *fmt, int arg) {
   syscall_args_t args = {
@@ -67,10 +101,19 @@ int open(const char *path, int oflag, ...) {
   return sys_call(&args);
 }
 
+// The kernel returns -EAGAIN instead of blocking on a O_NONBLOCK file
+static int io_result(int ret) {
+  if (ret != -EAGAIN)
+    return ret;
+
+  errno = EAGAIN;
+  return -1;
+}
+
 ssize_t read(int fd, void *buf, size_t nbytes) {
   syscall_args_t args = {
       .id = SYS_READ, .arg0 = (void *)fd, .arg1 = buf, .arg2 = (void *)nbytes};
-  return sys_call(&args);
+  return io_result(sys_call(&args));
 }
 
 ssize_t write(int fd, const void *buf, size_t nbytes) {
@@ -78,7 +121,7 @@ ssize_t write(int fd, const void *buf, size_t nbytes) {
                          .arg0 = (void *)fd,
                          .arg1 = (void *)buf,
                          .arg2 = (void *)nbytes};
-  return sys_call(&args);
+  return io_result(sys_call(&args));
 }
 
 int close(int fd) {
@@ -103,6 +146,20 @@ int ioctl(int fd, int cmd, void *arg0, void *arg1) {
   return sys_call(&args);
 }
 
+// Only F_GETFL and F_SETFL (O_NONBLOCK) are supported
+int fcntl(int fd, int cmd, ...) {
+  va_list arg_list;
+  va_start(arg_list, cmd);
+  const int arg = cmd == F_SETFL ? va_arg(arg_list, int) : 0;
+  va_end(arg_list);
+
+  syscall_args_t args = {.id = SYS_FCNTL,
+                         .arg0 = (void *)fd,
+                         .arg1 = (void *)cmd,
+                         .arg2 = (void *)arg};
+  return sys_call(&args);
+}
+
 int isatty(int fd) {
   syscall_args_t args = {.id = SYS_ISATTY, .arg0 = (void *)fd};
   return sys_call(&args);
@@ -123,6 +180,91 @@ int dup(int fd) {
   return sys_call(&args);
 }
 
+int dup2(int old_fd, int new_fd) {
+  syscall_args_t args = {
+      .id = SYS_DUP2, .arg0 = (void *)old_fd, .arg1 = (void *)new_fd};
+  return sys_call(&args);
+}
+
+int pipe(int fds[2]) {
+  syscall_args_t args = {.id = SYS_PIPE, .arg0 = fds};
+  return sys_call(&args);
+}
+
+int splice(int fd_in, int fd_out, size_t len) {
+  syscall_args_t args = {.id = SYS_SPLICE,
+                         .arg0 = (void *)fd_in,
+                         .arg1 = (void *)fd_out,
+                         .arg2 = (void *)len};
+  return io_result(sys_call(&args));
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout_ms) {
+  syscall_args_t args = {.id = SYS_POLL,
+                         .arg0 = fds,
+                         .arg1 = (void *)nfds,
+                         .arg2 = (void *)timeout_ms};
+  return sys_call(&args);
+}
+
+/*
+ * Implemented by poll, exceptfds is cleared as there is no out-of-band data.
+ * A closed peer of a pipe is reported as ready, like poll does.
+ */
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout) {
+  if (nfds < 0 || nfds > FD_SETSIZE)
+    return -1;
+
+  struct pollfd fds[FD_SETSIZE];
+  nfds_t cnt = 0;
+  for (int fd = 0; fd < nfds; fd++) {
+    short events = 0;
+    if (readfds && FD_ISSET(fd, readfds))
+      events |= POLLIN;
+
+    if (writefds && FD_ISSET(fd, writefds))
+      events |= POLLOUT;
+
+    if (events)
+      fds[cnt++] = (struct pollfd){.fd = fd, .events = events};
+  }
+
+  const int timeout_ms =
+      timeout ? timeout->tv_sec * 1000 + timeout->tv_usec / 1000
+              : POLL_INFINITE;
+  if (poll(fds, cnt, timeout_ms) < 0)
+    return -1;
+
+  if (readfds)
+    FD_ZERO(readfds);
+
+  if (writefds)
+    FD_ZERO(writefds);
+
+  if (exceptfds)
+    FD_ZERO(exceptfds);
+
+  int ready = 0;
+  for (nfds_t i = 0; i < cnt; i++) {
+    const struct pollfd *pfd = fds + i;
+    if (pfd->revents & POLLNVAL)
+      return -1;
+
+    if ((pfd->revents & (POLLIN | POLLHUP)) && (pfd->events & POLLIN)) {
+      FD_SET(pfd->fd, readfds);
+      ready++;
+    }
+
+    if ((pfd->revents & (POLLOUT | POLLERR)) && (pfd->events & POLLOUT)) {
+      FD_SET(pfd->fd, writefds);
+      ready++;
+    }
+  }
+
+  return ready;
+}
+
 int unlink(const char *pathname) {
   syscall_args_t args = {.id = SYS_UNLINK, .arg0 = (void *)pathname};
   return sys_call(&args);
@@ -185,3 +327,64 @@ int reboot() {
   syscall_args_t args = {.id = SYS_REBOOT};
   return sys_call(&args);
 }
+
+int futex(uint32_t *uaddr, int op, uint32_t val) {
+  syscall_args_t args = {
+      .id = SYS_FUTEX, .arg0 = uaddr, .arg1 = (void *)op, .arg2 = (void *)val};
+  return sys_call(&args);
+}
+
+int io_ring_setup(io_ring_t *ring, uint32_t entries) {
+  syscall_args_t args = {
+      .id = SYS_IO_RING_SETUP, .arg0 = ring, .arg1 = (void *)entries};
+  return sys_call(&args);
+}
+
+int io_ring_enter(uint32_t to_submit, uint32_t min_complete) {
+  syscall_args_t args = {.id = SYS_IO_RING_ENTER,
+                         .arg0 = (void *)to_submit,
+                         .arg1 = (void *)min_complete};
+  return sys_call(&args);
+}
+
+/*
+ * Read the ticks counted by the kernel, and the microseconds elapsed since
+ * the latest tick measured by the TSC (0 if the TSC isn't calibrated yet).
+ */
+static uint32_t vdso_ticks(uint32_t *offset_us) {
+  const vdso_data_t *vdso = vdso_data();
+  uint32_t seq, ticks;
+  uint64_t tick_tsc;
+  do {
+    seq = vdso->seq;
+    ticks = vdso->ticks;
+    tick_tsc = vdso->tick_tsc;
+  } while ((seq & 1) || seq != vdso->seq);
+
+  const uint32_t tick_us = vdso->tick_ms * 1000;
+  *offset_us = 0;
+  if (vdso->tsc_khz >= 1000) {
+    *offset_us = (uint32_t)(read_tsc() - tick_tsc) / (vdso->tsc_khz / 1000);
+    if (*offset_us >= tick_us)
+      *offset_us = tick_us - 1;
+  }
+
+  return ticks;
+}
+
+uint64_t uptime_us() {
+  uint32_t offset_us;
+  const uint32_t ticks = vdso_ticks(&offset_us);
+  return (uint64_t)ticks * vdso_data()->tick_ms * 1000 + offset_us;
+}
+
+int gettimeofday(struct timeval *tv, void *tz) {
+  const vdso_data_t *vdso = vdso_data();
+  const uint32_t ticks_per_sec = 1000 / vdso->tick_ms;
+
+  uint32_t offset_us;
+  const uint32_t ticks = vdso_ticks(&offset_us);
+  tv->tv_sec = vdso->boot_time + ticks / ticks_per_sec;
+  tv->tv_usec = ticks % ticks_per_sec * vdso->tick_ms * 1000 + offset_us;
+  return 0;
+}
@@ -5,8 +5,11 @@
 #ifndef LIB_SYSCALL_H
 #define LIB_SYSCALL_H
 
+#include "comm/io_ring.h"
+#include "comm/poll.h"
 #include "fs/file.h"
 #include <sys/stat.h>
+#include <sys/time.h>
 
 typedef struct _syscall_args_t {
   int id;
@@ -17,6 +20,8 @@ typedef struct _syscall_args_t {
 } syscall_args_t;
 
 int sys_call(const syscall_args_t *args);
+int sys_call_gate(const syscall_args_t *args);
+int sys_call_sysenter(const syscall_args_t *args);
 void msleep(uint32_t time);
 int getpid();
 void print_msg(const char *fmt, int arg);
@@ -29,11 +34,18 @@ ssize_t write(int fd, const void *buf, size_t nbytes);
 int close(int fd);
 int lseek(int fd, int offset, int whence);
 int ioctl(int fd, int cmd, void *arg0, void *arg1);
+int fcntl(int fd, int cmd, ...);
 
 int isatty(int fd);
 int fstat(int fd, struct stat *buf);
 void *sbrk(ptrdiff_t incr);
 int dup(int fd);
+int dup2(int old_fd, int new_fd);
+int pipe(int fds[2]);
+int splice(int fd_in, int fd_out, size_t len);
+int poll(struct pollfd *fds, nfds_t nfds, int timeout_ms);
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout);
 int unlink(const char *pathname);
 
 void _exit(int status);
@@ -42,6 +54,13 @@ int wait(int *status);
 int poweroff();
 int reboot();
 
+int futex(uint32_t *uaddr, int op, uint32_t val);
+int io_ring_setup(io_ring_t *ring, uint32_t entries);
+int io_ring_enter(uint32_t to_submit, uint32_t min_complete);
+
+uint64_t uptime_us();
+int gettimeofday(struct timeval *tv, void *tz);
+
 #define DIRENT_NAME_LEN 255
 
 struct dirent {
@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "main.h"
+#include "comm/disk_stat.h"
+#include "lib_syscall.h"
+#include <stdio.h>
+#include <string.h>
+
+static char read_buf[DISKBENCH_BUF_SIZE];
+
+static const char *const mode_name[] = {[DISK_PIO] = "PIO",
+                                        [DISK_DMA] = "DMA"};
+
+// KiB per second without 64-bit division
+static uint32_t rate_kib(uint32_t bytes, uint32_t us) {
+  const uint32_t kib = bytes >> 10, ms = us / 1000 ? us / 1000 : 1;
+  return kib / ms * 1000 + kib % ms * 1000 / ms;
+}
+
+static int bench(int stat_fd, const char *path, int mode) {
+  ioctl(stat_fd, DISK_CMD_DMA, (void *)(mode == DISK_DMA), NULL);
+  if (ioctl(stat_fd, DISK_CMD_DROP_CACHE, NULL, NULL) < 0) {
+    puts("diskbench: Drop the block cache failed!");
+    return -1;
+  }
+  ioctl(stat_fd, DISK_CMD_RESET, NULL, NULL);
+
+  const int fd = open(path, 0);
+  if (fd < 0) {
+    printf("diskbench: %s: No such file or directory\n", path);
+    return -1;
+  }
+
+  uint32_t bytes = 0;
+  int size;
+  const uint64_t start = uptime_us();
+  while ((size = read(fd, read_buf, sizeof(read_buf))) > 0)
+    bytes += size;
+
+  const uint32_t elapsed_us = uptime_us() - start;
+  close(fd);
+
+  disk_stat_t stat;
+  lseek(stat_fd, 0, SEEK_SET);
+  if (read(stat_fd, &stat, sizeof(stat)) < (int)sizeof(stat)) {
+    puts("diskbench: Read /dev/diskstat0 failed!");
+    return -1;
+  }
+
+  const disk_mode_stat_t *mode_stat = stat.mode + mode;
+  const uint32_t percent = elapsed_us / 100 ? elapsed_us / 100 : 1;
+  const uint32_t requests = mode_stat->requests ? mode_stat->requests : 1;
+  printf("%s: %lu KiB in %lu ms, %lu KiB/s, %lu requests, CPU %lu%%, "
+         "%lu irqs per request\n",
+         mode_name[mode], bytes >> 10, elapsed_us / 1000,
+         rate_kib(bytes, elapsed_us), mode_stat->requests,
+         mode_stat->cpu_us / percent, mode_stat->irqs / requests);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    puts("Invalid options!");
+    print_diskbench_help();
+    return -1;
+  }
+
+  if (!strcmp(argv[1], "--help")) {
+    print_diskbench_help();
+    return 0;
+  }
+
+  const int stat_fd = open("/dev/diskstat0", 0);
+  disk_stat_t stat;
+  if (stat_fd < 0 || read(stat_fd, &stat, sizeof(stat)) < (int)sizeof(stat)) {
+    puts("diskbench: Open /dev/diskstat0 failed!");
+    return -1;
+  }
+
+  int err = bench(stat_fd, argv[1], DISK_PIO);
+  if (!stat.dma_avail)
+    puts("diskbench: No IDE bus master, DMA is unavailable");
+  else if (!err)
+    err = bench(stat_fd, argv[1], DISK_DMA);
+
+  ioctl(stat_fd, DISK_CMD_DMA, (void *)stat.dma_on, NULL); // restore the mode
+  close(stat_fd);
+  return err;
+}
+
+void print_diskbench_help() {
+  printf("diskbench %s\n", DISKBENCH_USAGE);
+  puts("--help  display this help and exit");
+  puts("CPU is the share of the elapsed time spent by the disk driver");
+  puts("outside of interrupt waits, from /dev/diskstat0.");
+  puts("The block cache is dropped before each pass.");
+}
@@ -0,0 +1,14 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef MAIN_H
+#define MAIN_H
+
+#define DISKBENCH_USAGE                                                        \
+  "FILE - compare sequential reads of FILE with PIO and DMA"
+#define DISKBENCH_BUF_SIZE 65536
+
+void print_diskbench_help();
+
+#endif
@@ -0,0 +1,139 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "main.h"
+#include "comm/prof.h"
+#include "lib_syscall.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char copy_buf[PROF_COPY_SIZE];
+
+static int run_cmd(char **argv) {
+  const int pid = fork();
+  if (pid < 0) {
+    puts("prof: Fork failed!");
+    return -1;
+  } else if (pid == 0) { // child process
+    const int err = execve(argv[0], argv, NULL);
+    printf("prof: Failed to execute file %s\n", argv[0]);
+    exit(err);
+  }
+
+  printf("prof: %s runs as pid %d\n", argv[0], pid); // for prof_export.py
+  int status;
+  wait(&status);
+  return status;
+}
+
+// Print the share of kernel, user and idle samples
+static void print_summary(const prof_header_t *header, int fd) {
+  uint32_t kernel = 0, user = 0, idle = 0;
+  prof_sample_t sample;
+  for (uint32_t i = 0; i < header->cnt; i++) {
+    if (read(fd, &sample, sizeof(sample)) < (int)sizeof(sample))
+      break;
+
+    if (sample.cs & 3)
+      user++;
+    else if (sample.pid == 0) // the idle task is the first task created
+      idle++;
+    else
+      kernel++;
+  }
+
+  const uint32_t total = header->cnt ? header->cnt : 1;
+  printf("%lu samples at %lu Hz (%lu lost)\n", header->cnt, header->hz,
+         header->lost);
+  printf("kernel %lu%%, user %lu%%, idle %lu%%\n", kernel * 100 / total,
+         user * 100 / total, idle * 100 / total);
+}
+
+// Copy /dev/prof0 to the output file, which is symbolized on the host
+static int save_samples(const char *path) {
+  const int src = open("/dev/prof0", 0);
+  const int dest = open(path, O_RDWR | O_CREAT | O_TRUNC);
+  if (src < 0 || dest < 0) {
+    printf("prof: Open /dev/prof0 or %s failed!\n", path);
+    return -1;
+  }
+
+  prof_header_t header;
+  if (read(src, &header, sizeof(header)) < (int)sizeof(header) ||
+      header.magic != PROF_MAGIC) {
+    puts("prof: No samples!");
+    return -1;
+  }
+
+  write(dest, &header, sizeof(header));
+
+  int size;
+  while ((size = read(src, copy_buf, sizeof(copy_buf))) > 0) {
+    if (write(dest, copy_buf, size) < size) {
+      printf("prof: Write %s failed!\n", path);
+      return -1;
+    }
+  }
+
+  lseek(src, sizeof(header), SEEK_SET);
+  print_summary(&header, src);
+
+  close(src);
+  close(dest);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  uint32_t hz = PROF_HZ_DEFAULT;
+  const char *output = PROF_OUTPUT_DEFAULT;
+
+  int cmd_index = 1;
+  while (cmd_index < argc && argv[cmd_index][0] == '-') {
+    const char *opt = argv[cmd_index];
+    if (!strcmp(opt, "--help")) {
+      print_prof_help();
+      return 0;
+    } else if (!strcmp(opt, "-f") && cmd_index + 1 < argc)
+      hz = atoi(argv[++cmd_index]);
+    else if (!strcmp(opt, "-o") && cmd_index + 1 < argc)
+      output = argv[++cmd_index];
+    else {
+      printf("prof: Unknown option '%s'\n", opt);
+      print_prof_help();
+      return -1;
+    }
+
+    cmd_index++;
+  }
+
+  if (cmd_index >= argc) {
+    printf("Invalid options!\n");
+    print_prof_help();
+    return -1;
+  }
+
+  const int fd = open("/dev/prof0", 0);
+  if (fd < 0 || ioctl(fd, PROF_CMD_START, (void *)hz, NULL) < 0) {
+    printf("prof: Start profiling at %lu Hz failed!\n", hz);
+    return -1;
+  }
+
+  const int status = run_cmd(argv + cmd_index);
+  ioctl(fd, PROF_CMD_STOP, NULL, NULL);
+  close(fd);
+
+  printf("+++ exited with %d +++\n", status);
+  return save_samples(output);
+}
+
+void print_prof_help() {
+  printf("prof %s\n", PROF_USAGE);
+  puts("-f HZ    sampling rate, a multiple of 100 (default: 1000)");
+  puts("-o FILE  write the samples to FILE (default: prof.out)");
+  puts("--help   display this help and exit");
+  puts("Run script/prof_export.py on the host to symbolize the samples,");
+  puts("with the ELF file of the command for the pid printed.");
+}
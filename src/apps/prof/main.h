@@ -0,0 +1,16 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef MAIN_H
+#define MAIN_H
+
+#define PROF_USAGE                                                             \
+  "[-f HZ] [-o FILE] COMMAND [ARG]... - sample the system while running a "   \
+  "command"
+#define PROF_OUTPUT_DEFAULT "prof.out"
+#define PROF_COPY_SIZE 4096
+
+void print_prof_help();
+
+#endif
@@ -0,0 +1,188 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "main.h"
+#include "comm/trace.h"
+#include "comm/vdso.h"
+#include "core/syscall.h"
+#include "lib_syscall.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *syscall_name[TRACE_SYSCALL_NUM] = {
+    [SYS_SLEEP] = "sleep",
+    [SYS_GETPID] = "getpid",
+    [SYS_PRINTMSG] = "print_msg",
+    [SYS_FORK] = "fork",
+    [SYS_EXECVE] = "execve",
+    [SYS_YIELD] = "yield",
+    [SYS_OPEN] = "open",
+    [SYS_CLOSE] = "close",
+    [SYS_LSEEK] = "lseek",
+    [SYS_IOCTL] = "ioctl",
+    [SYS_READ] = "read",
+    [SYS_WRITE] = "write",
+    [SYS_ISATTY] = "isatty",
+    [SYS_FSTAT] = "fstat",
+    [SYS_SBRK] = "sbrk",
+    [SYS_DUP] = "dup",
+    [SYS_UNLINK] = "unlink",
+    [SYS_EXIT] = "exit",
+    [SYS_WAIT] = "wait",
+    [SYS_OPENDIR] = "opendir",
+    [SYS_READDIR] = "readdir",
+    [SYS_CLOSEDIR] = "closedir",
+    [SYS_POWEROFF] = "poweroff",
+    [SYS_REBOOT] = "reboot",
+    [SYS_FUTEX] = "futex",
+    [SYS_IO_RING_SETUP] = "io_ring_setup",
+    [SYS_IO_RING_ENTER] = "io_ring_enter",
+    [SYS_PIPE] = "pipe",
+    [SYS_DUP2] = "dup2",
+    [SYS_SPLICE] = "splice",
+    [SYS_POLL] = "poll",
+    [SYS_FCNTL] = "fcntl"};
+
+static const char *get_syscall_name(int num) {
+  if (num < 0 || num >= TRACE_SYSCALL_NUM || !syscall_name[num])
+    return "unknown";
+
+  return syscall_name[num];
+}
+
+// Convert TSC cycles to microseconds, or keep cycles if the TSC is unknown
+static uint32_t cycles_to_us(uint32_t cycles, const char **unit) {
+  const uint32_t mhz = vdso_data()->tsc_khz / 1000;
+  *unit = mhz ? "us" : "cycles";
+  return mhz ? cycles / mhz : cycles;
+}
+
+static int trace_ioctl(const char *path, int cmd) {
+  const int fd = open(path, 0);
+  if (fd < 0)
+    return -1;
+
+  const int err = ioctl(fd, cmd, NULL, NULL);
+  close(fd);
+  return err;
+}
+
+static void print_events(int pid) {
+  char path[32];
+  sprintf(path, "/dev/trace%d", pid);
+  const int fd = open(path, 0);
+  if (fd < 0) {
+    printf("strace: Open %s failed!\n", path);
+    return;
+  }
+
+  trace_event_t events[STRACE_EVENT_BATCH];
+  int size;
+  while ((size = read(fd, events, sizeof(events))) > 0) {
+    for (size_t i = 0; i < size / sizeof(trace_event_t); i++) {
+      const trace_event_t *event = events + i;
+      const char *unit;
+      const uint32_t time = cycles_to_us(event->cycles, &unit);
+      printf("[%d] %s(0x%lx, 0x%lx, 0x%lx, 0x%lx) = %d <%lu %s>\n", event->pid,
+             get_syscall_name(event->num), event->args[0], event->args[1],
+             event->args[2], event->args[3], event->ret, time, unit);
+    }
+  }
+
+  close(fd);
+}
+
+// Upper bound of the bucket where the given percentage of calls falls in
+static uint32_t hist_percentile(const trace_hist_t *hist, uint32_t percent) {
+  uint32_t sum = 0;
+  for (int i = 0; i < TRACE_HIST_BUCKETS; i++) {
+    sum += hist->buckets[i];
+    if (sum * 100 >= hist->cnt * percent)
+      return i == TRACE_HIST_BUCKETS - 1 ? 0xFFFFFFFF : 2U << i;
+  }
+
+  return hist->max_cycles;
+}
+
+static void print_summary() {
+  static trace_hist_t hist_table[TRACE_SYSCALL_NUM];
+  const int fd = open("/dev/syslat0", 0);
+  if (fd < 0 || read(fd, hist_table, sizeof(hist_table)) <= 0) {
+    puts("strace: Read /dev/syslat0 failed!");
+    return;
+  }
+
+  close(fd);
+
+  const char *unit;
+  cycles_to_us(0, &unit);
+  printf("%-16s %8s %10s %10s %10s (%s)\n", "syscall", "calls", "p50 <=",
+         "p99 <=", "max", unit);
+  for (int i = 0; i < TRACE_SYSCALL_NUM; i++) {
+    const trace_hist_t *hist = hist_table + i;
+    if (!hist->cnt)
+      continue;
+
+    printf("%-16s %8lu %10lu %10lu %10lu\n", get_syscall_name(i), hist->cnt,
+           cycles_to_us(hist_percentile(hist, 50), &unit),
+           cycles_to_us(hist_percentile(hist, 99), &unit),
+           cycles_to_us(hist->max_cycles, &unit));
+  }
+}
+
+int main(int argc, char **argv) {
+  _Bool summary = FALSE;
+  int cmd_index = 1;
+  if (argc > 1 && !strcmp(argv[1], "-c")) {
+    summary = TRUE;
+    cmd_index++;
+  } else if (argc > 1 && !strcmp(argv[1], "--help")) {
+    print_strace_help();
+    return 0;
+  }
+
+  if (cmd_index >= argc) {
+    printf("Invalid options!\n");
+    print_strace_help();
+    return -1;
+  }
+
+  if (summary)
+    trace_ioctl("/dev/syslat0", TRACE_CMD_RESET);
+
+  const int pid = fork();
+  if (pid < 0) {
+    puts("strace: Fork failed!");
+    return -1;
+  } else if (pid == 0) { // child process
+    char path[32];
+    sprintf(path, "/dev/trace%d", getpid());
+    if (trace_ioctl(path, TRACE_CMD_ENABLE) < 0)
+      puts("strace: Enable tracing failed!");
+
+    const int err = execve(argv[cmd_index], argv + cmd_index, NULL);
+    printf("strace: Failed to execute file %s\n", argv[cmd_index]);
+    exit(err);
+  }
+
+  int status;
+  wait(&status);
+
+  if (summary)
+    print_summary();
+  else
+    print_events(pid);
+
+  printf("+++ exited with %d +++\n", status);
+  return 0;
+}
+
+void print_strace_help() {
+  printf("strace %s\n", STRACE_USAGE);
+  puts("-c      print the latency histogram summary of all syscalls");
+  puts("        instead of the syscalls of the command");
+  puts("--help  display this help and exit");
+  puts("Needs a kernel built with SYSCALL_TRACE in os_cfg.h.");
+}
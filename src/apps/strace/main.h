@@ -0,0 +1,13 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef MAIN_H
+#define MAIN_H
+
+#define STRACE_USAGE "[-c] COMMAND [ARG]... - trace the syscalls of a command"
+#define STRACE_EVENT_BATCH 32
+
+void print_strace_help();
+
+#endif
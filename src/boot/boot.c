@@ -4,9 +4,11 @@
 
 __asm__(".code16gcc");
 
+#include "comm/cpu_instr.h"
+
 #define LOADER_START_ADDR 0x8000
 
 void boot_entry(void) {
-  ((void (*)(void))LOADER_START_ADDR)();
+  ((void (*)(uint64_t))LOADER_START_ADDR)(read_tsc());
   // Force to convert address to function pointer
 }
@@ -9,12 +9,23 @@
 #define SYS_KERNEL_START_ADDR 1048576
 #include "types.h"
 
+// TSC values taken before entering the kernel, in the order of booting
+enum boot_stamp_id_t {
+  BOOT_STAMP_BOOT_ENTRY,    // the loader has been read by the boot sector
+  BOOT_STAMP_MEMORY_PROBE,  // E820 memory detection finished
+  BOOT_STAMP_LOAD_KERNEL,   // protected mode entered
+  BOOT_STAMP_KERNEL_READ,   // the kernel ELF file has been read from disk
+  BOOT_STAMP_KERNEL_RELOAD, // the segments have been copied
+  BOOT_STAMP_NUM
+};
+
 typedef struct _boot_info_t {
   struct {
     uint32_t start, size;
   } ram_region_cfg[BOOT_RAM_REGION_MAX];
 
   int ram_regions;
+  uint64_t boot_stamp[BOOT_STAMP_NUM];
 } boot_info_t;
 
 #endif
@@ -35,6 +35,19 @@ static inline void outw(uint16_t port, uint16_t data) {
       "out %[v],%[p]" ::[p] "d"(port), [v] "a"(data)); // out ax,dx
 }
 
+static inline uint32_t inl(uint16_t port) {
+  uint32_t rv; // returned value
+  __asm__ __volatile__("inl %[p],%[v]"
+                       : [v] "=a"(rv)
+                       : [p] "d"(port)); // in eax,dx
+  return rv;
+}
+
+static inline void outl(uint16_t port, uint32_t data) {
+  __asm__ __volatile__(
+      "outl %[v],%[p]" ::[p] "d"(port), [v] "a"(data)); // out eax,dx
+}
+
 static inline void lgdt(uint32_t start, uint32_t size) {
   struct {
     uint16_t limit;
@@ -113,6 +126,77 @@ static inline uint32_t read_eflags() {
 #define write_eflags(eflags)                                                   \
   __asm__ __volatile__("push %%eax\n\tpopf" ::"a"(eflags));
 
+static inline uint64_t read_tsc() {
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+} // Time Stamp Counter
+
+/*
+ * Compare *ptr with old, and store new to *ptr if they are equal.
+ * Return the original value of *ptr, so the exchange succeeded iff it's old.
+ */
+static inline uint32_t cmpxchg(volatile uint32_t *ptr, uint32_t old,
+                               uint32_t new) {
+  uint32_t prev;
+  __asm__ __volatile__("lock cmpxchgl %[n],%[p]"
+                       : "=a"(prev), [p] "+m"(*ptr)
+                       : [n] "r"(new), "0"(old)
+                       : "memory");
+  return prev;
+}
+
+// Store val to *ptr, and return the original value of *ptr
+static inline uint32_t xchg(volatile uint32_t *ptr, uint32_t val) {
+  __asm__ __volatile__("xchgl %[v],%[p]"
+                       : [v] "+r"(val), [p] "+m"(*ptr)
+                       :
+                       : "memory");
+  return val;
+}
+
+// Add val to *ptr, and return the original value of *ptr
+static inline uint32_t xadd(volatile uint32_t *ptr, uint32_t val) {
+  __asm__ __volatile__("lock xaddl %[v],%[p]"
+                       : [v] "+r"(val), [p] "+m"(*ptr)
+                       :
+                       : "memory");
+  return val;
+}
+
+// Order the stores before the loads, which x86 may reorder otherwise
+static inline void memory_barrier() {
+  __asm__ __volatile__("lock addl $0,(%%esp)" : : : "memory");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+                         uint32_t *ecx, uint32_t *edx) {
+  __asm__ __volatile__("cpuid"
+                       : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                       : "a"(leaf));
+}
+
+/*
+ * Whether sysenter/sysexit is supported (SEP bit of CPUID.01H:EDX),
+ * early Pentium Pro processors report SEP without supporting it.
+ */
+static inline _Bool cpu_has_sep() {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, &eax, &ebx, &ecx, &edx);
+
+  const uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF;
+  const uint32_t stepping = eax & 0xF;
+  if (family == 6 && model < 3 && stepping < 3)
+    return FALSE;
+
+  return (edx >> 11) & 1;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+  __asm__ __volatile__("wrmsr" ::"c"(msr), "a"((uint32_t)val),
+                       "d"((uint32_t)(val >> 32)));
+}
+
 static inline void switch_to_cpl3(const tss_t *tss) {
   __asm__ __volatile__("push %[ss]\n\t"
                        "push %[esp]\n\t"
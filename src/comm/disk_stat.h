@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DISK_STAT_H
+#define DISK_STAT_H
+
+#include "types.h"
+
+// ioctl commands of /dev/diskstat0
+#define DISK_CMD_DMA 1        // use DMA if arg0 isn't 0, otherwise PIO
+#define DISK_CMD_RESET 2      // clear the statistics
+#define DISK_CMD_DROP_CACHE 3 // write back and drop the cached blocks
+
+enum { DISK_PIO, DISK_DMA, DISK_MODE_NUM };
+
+typedef struct _disk_mode_stat_t {
+  uint32_t requests, sectors;
+  // Total interrupts waited for; divide by requests for the per-request figure
+  uint32_t irqs;
+  uint32_t busy_us; // from issuing the request to its completion
+  uint32_t cpu_us;  // busy_us except the time waiting for interrupts
+} disk_mode_stat_t;
+
+typedef struct _disk_stat_t {
+  uint32_t dma_avail, dma_on; // whether a bus master exists, and is used
+  disk_mode_stat_t mode[DISK_MODE_NUM];
+} disk_stat_t;
+
+#endif
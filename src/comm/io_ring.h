@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include "types.h"
+
+#define IO_RING_MAX_ENTRIES 256 // entries should be a power of 2
+
+enum { IO_RING_NOP, IO_RING_READ, IO_RING_WRITE };
+
+typedef struct _io_sqe_t {
+  int opcode, fd;
+  void *buf;
+  uint32_t len;
+  int offset; // -1 to use the position of the file, which is kept otherwise
+  uint32_t user_data; // copied to the completion untouched
+} io_sqe_t;
+
+typedef struct _io_cqe_t {
+  uint32_t user_data;
+  int res; // the result of read/write
+} io_cqe_t;
+
+/*
+ * A ring shared between an application and the kernel, followed by entries
+ * submission entries and entries completion entries.
+ * The application produces sq_tail and consumes cq_head,
+ * while the kernel consumes sq_head and produces cq_tail.
+ * Indexes run freely, and are masked by entries - 1 when accessing entries.
+ */
+typedef struct _io_ring_t {
+  uint32_t entries;
+  volatile uint32_t sq_head, sq_tail;
+  volatile uint32_t cq_head, cq_tail;
+} io_ring_t;
+
+#define io_ring_size(entries)                                                  \
+  (sizeof(io_ring_t) + (entries) * (sizeof(io_sqe_t) + sizeof(io_cqe_t)))
+#define io_ring_sqes(ring) ((io_sqe_t *)((io_ring_t *)(ring) + 1))
+#define io_ring_cqes(ring)                                                     \
+  ((io_cqe_t *)(io_ring_sqes(ring) + (ring)->entries))
+
+#endif
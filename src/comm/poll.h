@@ -0,0 +1,23 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef POLL_H
+#define POLL_H
+
+#define POLLIN 0x1   // data can be read without blocking
+#define POLLOUT 0x4  // data can be written without blocking
+#define POLLERR 0x8  // the read end of a pipe is closed (revents only)
+#define POLLHUP 0x10 // the write end of a pipe is closed (revents only)
+#define POLLNVAL 0x20 // fd isn't opened (revents only)
+
+#define POLL_INFINITE (-1)
+
+typedef unsigned int nfds_t;
+
+struct pollfd {
+  int fd; // ignored if negative
+  short events, revents;
+};
+
+#endif
@@ -0,0 +1,33 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef PROF_H
+#define PROF_H
+
+#include "types.h"
+
+#define PROF_MAGIC 0x464F5250 // "PROF"
+#define PROF_HZ_DEFAULT 1000
+
+// ioctl commands of /dev/prof0
+#define PROF_CMD_START 1 // arg0: sampling rate in Hz, a multiple of the tick
+#define PROF_CMD_STOP 2
+
+/*
+ * /dev/prof0 reads as a prof_header_t followed by cnt samples,
+ * which is also the format of the file written by the prof app.
+ */
+typedef struct _prof_header_t {
+  uint32_t magic;
+  uint32_t hz;
+  uint32_t cnt, lost; // samples recorded, and dropped as the buffer was full
+} prof_header_t;
+
+typedef struct _prof_sample_t {
+  uint32_t eip;
+  uint16_t cs; // privilege level in the lowest 2 bits
+  uint16_t pid;
+} prof_sample_t;
+
+#endif
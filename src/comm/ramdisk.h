@@ -0,0 +1,15 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+/*
+ * ioctl commands of /dev/ram0. The file is read and written at byte
+ * positions in whole sectors, e.g. to copy a FAT image onto it.
+ */
+#define RAMDISK_CMD_RESIZE 1  // arg0: bytes, rounded up to pages
+#define RAMDISK_CMD_SECTORS 2 // return the size in sectors
+
+#endif
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+#define TRACE_ARGC 4
+#define TRACE_SYSCALL_NUM 64
+#define TRACE_HIST_BUCKETS 32 // bucket i counts durations in [2^i, 2^(i+1))
+
+// ioctl commands of /dev/traceN, which affect the calling task
+#define TRACE_CMD_ENABLE 1
+#define TRACE_CMD_DISABLE 2
+#define TRACE_CMD_RESET 3 // clear the latency histograms
+
+typedef struct _trace_event_t {
+  int pid, num;
+  uint32_t args[TRACE_ARGC];
+  int ret;
+  uint32_t cycles; // TSC cycles spent in the syscall, saturated at 2^32 - 1
+} trace_event_t;
+
+typedef struct _trace_hist_t {
+  uint32_t cnt, max_cycles;
+  uint32_t buckets[TRACE_HIST_BUCKETS];
+} trace_hist_t;
+
+#endif
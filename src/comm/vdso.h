@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef VDSO_H
+#define VDSO_H
+
+#include "types.h"
+
+#define VDSO_ADDR 0xF0000000 // mapped read-only into every user address space
+
+/*
+ * Kernel data which can be read by applications without a syscall.
+ * seq is odd while the kernel updates ticks and tick_tsc,
+ * so that a reader retries if seq changed during its reading.
+ */
+typedef struct _vdso_data_t {
+  volatile uint32_t seq;
+  volatile int pid; // the running task
+  volatile uint32_t ticks;
+  volatile uint64_t tick_tsc; // TSC value at the latest tick
+  uint32_t tick_ms;
+
+  uint32_t boot_time; // seconds since the Epoch when booting, 0 if unknown
+  uint64_t boot_tsc;
+  volatile uint32_t tsc_khz; // 0 until the TSC is calibrated
+} vdso_data_t;
+
+#define vdso_data() ((const vdso_data_t *)VDSO_ADDR)
+
+#endif
@@ -4,9 +4,12 @@
 
 #include "acpi/poweroff.h"
 #include "comm/cpu_instr.h"
+#include "fs/fs.h"
 #include "os_cfg.h"
 
 int sys_poweroff() {
+  fs_shutdown();
+
 #ifdef HOST_QEMU
   outw(0x604, 0x2000);
 #endif
@@ -4,8 +4,11 @@
 
 #include "acpi/reboot.h"
 #include "comm/cpu_instr.h"
+#include "fs/fs.h"
 
 int sys_reboot() {
+  fs_shutdown();
+
   uint8_t good = 0x02;
   while (good & 0x02)
     good = inb(0x64);
@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "core/boot_stamp.h"
+#include "comm/cpu_instr.h"
+#include "core/vdso.h"
+#include "cpu/irq.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+const dev_desc_t boot_stamp_desc = {.name = "boot",
+                                    .major_no = DEV_BOOT,
+                                    .open = boot_stamp_open,
+                                    .close = boot_stamp_close,
+                                    .read = boot_stamp_read,
+                                    .write = boot_stamp_write,
+                                    .control = boot_stamp_control};
+
+static const char *loader_stamp_name[BOOT_STAMP_NUM] = {
+    [BOOT_STAMP_BOOT_ENTRY] = "BIOS & boot sector",
+    [BOOT_STAMP_MEMORY_PROBE] = "loader_16: memory probe",
+    [BOOT_STAMP_LOAD_KERNEL] = "loader_16: protected mode",
+    [BOOT_STAMP_KERNEL_READ] = "load_kernel: read",
+    [BOOT_STAMP_KERNEL_RELOAD] = "load_kernel: reload ELF"};
+
+/*
+ * The TSC starts from 0 at reset, so the first stamp is the time spent in
+ * the BIOS, and each phase lasts from the previous stamp to its own one.
+ */
+static boot_stamp_t stamp_table[BOOT_STAMP_MAX];
+static int stamp_cnt = 0;
+static _Bool boot_finished = FALSE;
+
+// Copy the stamps of the loader, whose memory may be reused later
+void boot_stamp_init(const boot_info_t *boot_info) {
+  for (int i = 0; i < BOOT_STAMP_NUM; i++) {
+    stamp_table[i].name = loader_stamp_name[i];
+    stamp_table[i].tsc = boot_info->boot_stamp[i];
+  }
+
+  stamp_cnt = BOOT_STAMP_NUM;
+}
+
+void boot_stamp(const char *name) {
+  const irq_state_t state = irq_protect();
+
+  if (!boot_finished && stamp_cnt < BOOT_STAMP_MAX) {
+    stamp_table[stamp_cnt].name = name;
+    stamp_table[stamp_cnt].tsc = read_tsc();
+    stamp_cnt++;
+  }
+
+  irq_unprotect(state);
+}
+
+// Microseconds if the TSC has been calibrated, otherwise kilo cycles
+static uint32_t cycles_to_time(uint64_t cycles) {
+  const uint32_t khz = vdso_tsc_khz();
+  return khz ? kernel_div_u64(cycles * 1000, khz) : cycles >> 10;
+}
+
+static const char *time_unit() { return vdso_tsc_khz() ? "us" : "Kcycles"; }
+
+static int format_stamp(char *buf, int index) {
+  const boot_stamp_t *stamp = stamp_table + index;
+  const uint64_t prev = index ? stamp_table[index - 1].tsc : 0;
+  return kernel_sprintf(buf, "%s: +%d (at %d)\n", stamp->name,
+                        cycles_to_time(stamp->tsc - prev),
+                        cycles_to_time(stamp->tsc));
+}
+
+// Stamp the first exec of the shell, and print the summary once
+void boot_stamp_finish() {
+  if (boot_finished)
+    return;
+
+  boot_stamp("first shell exec");
+  boot_finished = TRUE;
+
+  log_printf("Boot phases (%s):", time_unit());
+  for (int i = 0; i < stamp_cnt; i++) {
+    char line[BUF_SIZE];
+    const int len = format_stamp(line, i);
+    line[len] = '\0'; // drop the newline
+    log_printf("%s", line);
+  }
+}
+
+int boot_stamp_open(device_t *dev) { return 0; }
+
+int boot_stamp_close(const device_t *dev) { return 0; }
+
+// /dev/boot0 reads as the text of the summary
+int boot_stamp_read(const device_t *dev, uint32_t addr, void *buf,
+                    size_t size) {
+  static char report[BOOT_REPORT_SIZE];
+  const irq_state_t state = irq_protect();
+
+  int len = kernel_sprintf(report, "Boot phases (%s):\n", time_unit()) + 1;
+  for (int i = 0; i < stamp_cnt; i++)
+    len += format_stamp(report + len, i) + 1;
+
+  if (addr >= (uint32_t)len)
+    size = 0;
+  else {
+    size = min(size, (size_t)(len - addr));
+    kernel_memcpy(buf, report + addr, size);
+  }
+
+  irq_unprotect(state);
+  return size;
+}
+
+int boot_stamp_write(const device_t *dev, uint32_t addr, const void *buf,
+                     size_t size) {
+  return -1;
+}
+
+int boot_stamp_control(const device_t *dev, int cmd, va_list arg_list) {
+  return -1;
+}
@@ -3,8 +3,11 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "core/memory.h"
+#include "core/vdso.h"
+#include "cpu/irq.h"
 #include "cpu/mmu.h"
 #include "dev/console.h"
+#include "ipc/mutex_stat.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 
@@ -142,6 +145,9 @@ static void create_kernel_table() {
 
     memory_create_map(kernel_page_dir, vStart, paddr, pages, map->privilege);
   }
+
+  // Every task copies the PDE of the window, see memory_map_mmio
+  find_pte(kernel_page_dir, MEM_MMIO_BASE, 1);
 }
 
 uint32_t memory_create_uvm() {
@@ -156,6 +162,13 @@ uint32_t memory_create_uvm() {
   for (size_t i = 0; i < user_pde_start; i++)
     pde[i].value = kernel_page_dir[i].value;
 
+  // The read-only page shared with the kernel, see comm/vdso.h
+  if (vdso_paddr() && memory_create_map(pde, VDSO_ADDR, vdso_paddr(), 1,
+                                        PTE_U | PTE_SHARED) < 0) {
+    memory_destroy_uvm((uint32_t)pde);
+    return 0;
+  }
+
   return (uint32_t)pde;
 }
 
@@ -171,6 +184,7 @@ void memory_init(const boot_info_t *boot_info) {
 
   addr_alloc_init(&paddr_alloc, mem_free, MEM_EXT_START, mem_up1MB_free,
                   MEM_PAGE_SIZE);
+  mutex_stat_add(&paddr_alloc.mutex, "paddr_alloc");
 
   mem_free += bmp_bytes_cnt(paddr_alloc.size / MEM_PAGE_SIZE);
 
@@ -211,6 +225,15 @@ int memory_alloc_page_for(uint32_t addr, uint32_t size, int privilege) {
 
 uint32_t memory_alloc_page() { return addr_alloc_page(&paddr_alloc, 1); }
 
+// Physically contiguous pages, which are also accessible by the kernel
+uint32_t memory_alloc_pages(int pages) {
+  return addr_alloc_page(&paddr_alloc, pages);
+}
+
+void memory_free_pages(uint32_t addr, int pages) {
+  addr_free_page(&paddr_alloc, addr, pages);
+}
+
 void memory_free_page(uint32_t addr) {
   if (addr < MEM_TASK_BASE) // physical address (free page only)
     addr_free_page(&paddr_alloc, addr, 1);
@@ -236,8 +259,8 @@ uint32_t memory_copy_uvm(uint32_t page_dir) {
 
     const pte_t *pte = (pte_t *)pde_paddr(pde);
     for (size_t j = 0; j < PAGE_TABLE_NUM; j++, pte++) {
-      if (!pte->present)
-        continue;
+      if (!pte->present || (pte->value & PTE_SHARED))
+        continue; // shared pages are mapped by memory_create_uvm
 
       const uint32_t paddr = addr_alloc_page(&paddr_alloc, 1);
       if (!paddr)
@@ -272,7 +295,7 @@ void memory_destroy_uvm(uint32_t page_dir) {
 
     const pte_t *pte = (pte_t *)pde_paddr(pde);
     for (int j = 0; j < PAGE_TABLE_NUM; j++, pte++) {
-      if (!pte->present)
+      if (!pte->present || (pte->value & PTE_SHARED))
         continue;
 
       addr_free_page(&paddr_alloc, pte_paddr(pte), 1);
@@ -282,15 +305,57 @@ void memory_destroy_uvm(uint32_t page_dir) {
   addr_free_page(&paddr_alloc, page_dir, 1);
 }
 
+// Return 0 if the page isn't mapped
 uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr) {
   const pte_t *pte = find_pte((pde_t *)page_dir, vaddr, 0);
 
-  if (!pte)
+  if (!pte || !pte->present)
     return 0;
 
   return pte_paddr(pte) + (vaddr & (MEM_PAGE_SIZE - 1));
 }
 
+// The kernel is identity mapped, a user buffer is translated by the page table
+uint32_t memory_dma_paddr(uint32_t vaddr) {
+  if (vaddr < MEM_TASK_BASE)
+    return vaddr;
+
+  const pte_t *pte = find_pte(curr_page_dir(), vaddr, 0);
+  if (!pte || !pte->present)
+    return 0;
+
+  return pte_paddr(pte) + (vaddr & (MEM_PAGE_SIZE - 1));
+}
+
+/*
+ * Map the registers of a device, usually above the physical memory, to the
+ * MMIO window uncached. The page table of the window exists since boot,
+ * so that the mapping is visible to every task created before or after.
+ * Return NULL if the window is exhausted.
+ */
+void *memory_map_mmio(uint32_t paddr, uint32_t size) {
+  static uint32_t mmio_next = MEM_MMIO_BASE;
+
+  const uint32_t offset = paddr & (MEM_PAGE_SIZE - 1);
+  const uint32_t pages = up2(offset + size, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+
+  const irq_state_t state = irq_protect();
+  const uint32_t vaddr = mmio_next;
+  const _Bool full =
+      pages * MEM_PAGE_SIZE > MEM_MMIO_SIZE - (vaddr - MEM_MMIO_BASE);
+  if (!full)
+    mmio_next += pages * MEM_PAGE_SIZE;
+  irq_unprotect(state);
+
+  if (full || memory_create_map(kernel_page_dir, vaddr, paddr - offset, pages,
+                                PTE_W | PTE_PCD | PTE_PWT) < 0) {
+    log_printf("Failed to map MMIO at 0x%x!", paddr);
+    return NULL;
+  }
+
+  return (void *)(vaddr + offset);
+}
+
 int memory_copy_uvm_data(uint32_t dest, uint32_t page_dir, uint32_t src,
                          uint32_t size) {
   while (size > 0) {
@@ -5,8 +5,15 @@
 #include "core/syscall.h"
 #include "acpi/poweroff.h"
 #include "acpi/reboot.h"
+#include "comm/cpu_instr.h"
 #include "core/memory.h"
+#include "dev/trace.h"
 #include "fs/fs.h"
+#include "fs/io_ring.h"
+#include "fs/pipe.h"
+#include "fs/poll.h"
+#include "ipc/futex.h"
+#include "os_cfg.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 
@@ -34,15 +41,29 @@ static const syscall_handler_t sys_table[] = {
     [SYS_CLOSEDIR] = (syscall_handler_t)sys_closedir,
     [SYS_POWEROFF] = (syscall_handler_t)sys_poweroff,
     [SYS_REBOOT] = (syscall_handler_t)sys_reboot,
+    [SYS_FUTEX] = (syscall_handler_t)sys_futex,
+    [SYS_IO_RING_SETUP] = (syscall_handler_t)sys_io_ring_setup,
+    [SYS_IO_RING_ENTER] = (syscall_handler_t)sys_io_ring_enter,
+    [SYS_PIPE] = (syscall_handler_t)sys_pipe,
+    [SYS_DUP2] = (syscall_handler_t)sys_dup2,
+    [SYS_SPLICE] = (syscall_handler_t)sys_splice,
+    [SYS_POLL] = (syscall_handler_t)sys_poll,
+    [SYS_FCNTL] = (syscall_handler_t)sys_fcntl,
     [SYS_UNLINK] = (syscall_handler_t)sys_unlink};
 
 void do_handle_syscall(syscall_frame_t *frame) {
   if (frame->auto_push.func_id < ARRAY_SIZE(sys_table)) {
     const syscall_handler_t handler = sys_table[frame->auto_push.func_id];
     if (handler) {
+#if SYSCALL_TRACE
+      const uint64_t start = read_tsc();
+#endif
       const int ret = handler(frame->auto_push.arg0, frame->auto_push.arg1,
                               frame->auto_push.arg2, frame->auto_push.arg3);
       frame->manual_push.eax = ret;
+#if SYSCALL_TRACE
+      trace_syscall(frame, ret, read_tsc() - start);
+#endif
       return;
     }
   }
@@ -3,12 +3,18 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "core/task.h"
+#include "comm/cpu_instr.h"
 #include "comm/elf.h"
+#include "core/boot_stamp.h"
 #include "core/memory.h"
 #include "core/syscall.h"
+#include "core/vdso.h"
 #include "cpu/irq.h"
 #include "cpu/mmu.h"
 #include "fs/fs.h"
+#include "fs/io_ring.h"
+#include "ipc/mutex_stat.h"
+#include "ipc/wait.h"
 #include "os_cfg.h"
 #include "tools/klib.h"
 #include "tools/log.h"
@@ -39,8 +45,8 @@ static int tss_init(task_t *task, flag_t flag, uint32_t entry, uint32_t esp) {
     code_selector = KERNEL_SELECTOR_CS;
     data_selector = KERNEL_SELECTOR_DS;
   } else {
-    code_selector = task_manager.app_code_selector | SEG_CPL3;
-    data_selector = task_manager.app_data_selector | SEG_CPL3;
+    code_selector = APP_SELECTOR_CS | SEG_CPL3;
+    data_selector = APP_SELECTOR_DS | SEG_CPL3;
   }
 
   task->tss.eip = entry;
@@ -81,12 +87,21 @@ int task_init(task_t *task, const char *name, flag_t flag, uint32_t entry,
   task->sleep_ticks = 0;
   task->parent = NULL;
   task->heap_start = task->heap_end = 0;
+  task->priority = task->base_priority = TASK_PRIORITY_DEFAULT;
+  task->wait_mutex = NULL;
+  task->read_locks = 0;
+  task->wait_list = NULL;
+  task->wait_status = WAIT_OK;
+  task->futex_key = 0;
+  list_init(&task->pi_list);
 
   list_node_init(&task->all_node);
   list_node_init(&task->run_node);
   list_node_init(&task->wait_node);
 
   kernel_memset(&task->file_table, 0, sizeof(task->file_table));
+  task->io_ring = NULL;
+  task->trace = FALSE;
 
   const irq_state_t state = irq_protect();
 
@@ -124,24 +139,15 @@ static void idle_task_entry() {
 }
 
 void task_switch_to(const task_t *target_task) {
+  cpu_set_sysenter_esp(target_task->tss.esp0);
+  vdso_set_pid(target_task->pid);
   switch_to_tss(target_task->tss_selector);
 }
 
 void task_manager_init() {
   kernel_memset(task_table, 0, sizeof(task_table));
   mutex_init(&task_table_mutex);
-
-  int selector = gdt_alloc_desc();
-  segment_desc_set(selector, 0, 0xFFFFFFFF,
-                   SEG_P | SEG_DPL3 | SEG_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW |
-                       SEG_D);
-  task_manager.app_data_selector = selector;
-
-  selector = gdt_alloc_desc();
-  segment_desc_set(selector, 0, 0xFFFFFFFF,
-                   SEG_P | SEG_DPL3 | SEG_NORMAL | SEG_TYPE_CODE | SEG_TYPE_RW |
-                       SEG_D);
-  task_manager.app_code_selector = selector;
+  mutex_stat_add(&task_table_mutex, "task table");
 
   list_init(&task_manager.ready_list);
   list_init(&task_manager.task_list);
@@ -170,6 +176,8 @@ void task_first_init() {
   task_manager.first_task.heap_end = (uint32_t)e_first_task;
 
   write_tr(task_manager.first_task.tss_selector);
+  cpu_set_sysenter_esp(task_manager.first_task.tss.esp0);
+  vdso_set_pid(task_manager.first_task.pid);
   task_manager.curr_task = &task_manager.first_task;
 
   mmu_set_page_dir(task_manager.first_task.tss.cr3);
@@ -183,9 +191,18 @@ void task_first_init() {
 
 task_t *get_first_task() { return &task_manager.first_task; }
 
+/*
+ * Insert the task behind the last task whose priority is not lower than its
+ * own, so that tasks with the same priority are still scheduled in FIFO order.
+ */
 void task_set_ready(task_t *task) {
   if (task != &task_manager.idle_task) {
-    list_insert_last(&task_manager.ready_list, &task->run_node);
+    list_node_t *pos = list_last(&task_manager.ready_list);
+    while (pos && list_node_parent(pos, task_t, run_node)->priority <
+                      task->priority)
+      pos = list_node_prev(pos);
+
+    list_insert_after(&task_manager.ready_list, pos, &task->run_node);
     task->state = TASK_READY;
   }
 }
@@ -195,6 +212,44 @@ void task_set_block(task_t *task) {
     list_remove(&task_manager.ready_list, &task->run_node);
 }
 
+static _Bool task_is_ready(const task_t *task) {
+  list_for_each_node(&task_manager.ready_list, node) {
+    if (node == &task->run_node)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Change the effective priority of a task.
+ * A task in ready_list is moved to the position matching its new priority,
+ * and the caller should dispatch afterwards to let the change take effect.
+ */
+void task_set_priority(task_t *task, int priority) {
+  if (task->priority == priority)
+    return;
+
+  if (task_is_ready(task)) {
+    const int state = task->state;
+    task_set_block(task);
+    task->priority = priority;
+    task_set_ready(task);
+    task->state = state; // keep TASK_RUNNING for the current task
+  } else
+    task->priority = priority;
+}
+
+// Insert the task to wait_list in the order of priority (FIFO for equal ones)
+void task_insert_waiter(list_t *wait_list, task_t *task) {
+  list_node_t *pos = list_last(wait_list);
+  while (pos && list_node_parent(pos, task_t, wait_node)->priority <
+                    task->priority)
+    pos = list_node_prev(pos);
+
+  list_insert_after(wait_list, pos, &task->wait_node);
+}
+
 task_t *get_curr_task() { return task_manager.curr_task; }
 
 task_t *task_next_run() { // next task to run
@@ -245,7 +300,8 @@ void task_time_tick() {
   /*
    * scan the sleep_list at intervals (OS_TICKS_MS)
    * to check whether sleeping is due;
-   * if sleeping is due, move the task to ready queue
+   * if sleeping is due, move the task to ready queue;
+   * a task in a timed wait is also removed from its wait_list
    */
   const list_node_t *curr = list_first(&task_manager.sleep_list);
   while (curr) {
@@ -253,6 +309,12 @@ void task_time_tick() {
     task_t *task = list_node_parent(curr, task_t, run_node);
     if (--task->sleep_ticks == 0) {
       task_set_wakeup(task);
+      if (task->wait_list) {
+        list_remove(task->wait_list, &task->wait_node);
+        task->wait_list = NULL;
+        task->wait_status = WAIT_TIMEOUT;
+      }
+
       task_set_ready(task);
     }
 
@@ -324,6 +386,45 @@ static void free_task(task_t *task) {
   mutex_unlock(&task_table_mutex);
 }
 
+/*
+ * Create a kernel thread running entry(arg) on its kernel stack,
+ * which shares the page table page_dir with the task it serves.
+ */
+task_t *task_create_kthread(const char *name, uint32_t page_dir,
+                            void (*entry)(void *), void *arg) {
+  task_t *task = alloc_task();
+  if (!task)
+    return NULL;
+
+  task_init(task, name, SYSTEM, (uint32_t)entry, 0);
+  if (!task->tss_selector) {
+    free_task(task);
+    return NULL;
+  }
+
+  memory_destroy_uvm(task->tss.cr3);
+  task->tss.cr3 = page_dir;
+
+  uint32_t *stack = (uint32_t *)(task->tss.esp0 - 2 * sizeof(uint32_t));
+  stack[0] = 0; // entry never returns
+  stack[1] = (uint32_t)arg;
+  task->tss.esp = (uint32_t)stack;
+
+  task_start(task);
+  return task;
+}
+
+// The thread should have blocked itself, and its page table is left alone
+void task_destroy_kthread(task_t *task) {
+  const irq_state_t state = irq_protect();
+  list_remove(&task_manager.task_list, &task->all_node);
+  irq_unprotect(state);
+
+  gdt_free_selector(task->tss_selector);
+  memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
+  kernel_memset(task, 0, sizeof(task_t));
+}
+
 int sys_fork() {
   task_t *parent_task = get_curr_task();
   task_t *child_task = alloc_task();
@@ -355,6 +456,7 @@ int sys_fork() {
   tss->eflags = frame->manual_push.eflags;
 
   child_task->parent = parent_task;
+  child_task->trace = parent_task->trace; // trace the children as well
   if (!(child_task->tss.cr3 = memory_copy_uvm(parent_task->tss.cr3)))
     goto fork_failed;
 
@@ -378,7 +480,11 @@ fork_failed:
   return -1;
 }
 
-static int load_phdr(int file, const Elf32_Phdr *phdr, uint32_t page_dir) {
+/*
+ * Read the file part of a segment straight into its physical pages,
+ * and merge the pages which happen to be physically contiguous into one read.
+ */
+static int load_phdr(file_t *file, const Elf32_Phdr *phdr, uint32_t page_dir) {
   const int err = memory_alloc_for_page_dir(
       page_dir, phdr->p_vaddr, phdr->p_memsz, PTE_P | PTE_U | PTE_W);
   if (err < 0) {
@@ -386,7 +492,7 @@ static int load_phdr(int file, const Elf32_Phdr *phdr, uint32_t page_dir) {
     return -1;
   }
 
-  if (sys_lseek(file, phdr->p_offset, 0) < 0) {
+  if (fs_seek(file, phdr->p_offset, 0) < 0) {
     log_printf("Read file failed!");
     return -1;
   }
@@ -395,10 +501,14 @@ static int load_phdr(int file, const Elf32_Phdr *phdr, uint32_t page_dir) {
   uint32_t size = phdr->p_filesz;
 
   while (size > 0) {
-    const int curr_size = size > MEM_PAGE_SIZE ? MEM_PAGE_SIZE : size;
     const uint32_t paddr = memory_get_paddr(page_dir, vaddr);
+    uint32_t curr_size =
+        min(size, MEM_PAGE_SIZE - (vaddr & (MEM_PAGE_SIZE - 1)));
+    while (curr_size < size &&
+           memory_get_paddr(page_dir, vaddr + curr_size) == paddr + curr_size)
+      curr_size += min(size - curr_size, (uint32_t)MEM_PAGE_SIZE);
 
-    if (sys_read(file, (char *)paddr, curr_size) < curr_size) {
+    if (fs_read(file, (char *)paddr, curr_size) < (int)curr_size) {
       log_printf("Read file failed.");
       return -1;
     }
@@ -410,65 +520,65 @@ static int load_phdr(int file, const Elf32_Phdr *phdr, uint32_t page_dir) {
   return 0;
 }
 
+/*
+ * The ELF header and the program header table are read by a single request,
+ * as the linker puts the table right behind the header.
+ */
 static uint32_t load_elf_file(task_t *task, const char *name,
                               uint32_t page_dir) {
-  const Elf32_Ehdr elf_hdr;
-  const Elf32_Phdr elf_phdr;
+  uint8_t elf_buf[ELF_HDR_BUF_SIZE];
+  const Elf32_Ehdr *elf_hdr = (Elf32_Ehdr *)elf_buf;
+  uint32_t entry = 0;
 
-  const int file = sys_open(name, USER);
-  if (file < 0) {
+  const int fd = sys_open(name, USER);
+  if (fd < 0) {
     log_printf("Open file %s failed.", name);
-    goto load_failed;
+    return 0;
   }
 
-  size_t size = sys_read(file, (char *)&elf_hdr, sizeof(Elf32_Ehdr));
-  if (size < sizeof(Elf32_Ehdr)) {
+  file_t *file = task_file(fd);
+  const int size = fs_read(file, elf_buf, sizeof(elf_buf));
+  if (size < (int)sizeof(Elf32_Ehdr)) {
     log_printf("ELF header is too small! (Size = %d)", size);
-    goto load_failed;
+    goto load_done;
   }
 
-  if (elf_hdr.e_ident[0] != ELF_MAGIC || elf_hdr.e_ident[1] != 'E' ||
-      elf_hdr.e_ident[2] != 'L' || elf_hdr.e_ident[3] != 'F') {
+  if (elf_hdr->e_ident[0] != ELF_MAGIC || elf_hdr->e_ident[1] != 'E' ||
+      elf_hdr->e_ident[2] != 'L' || elf_hdr->e_ident[3] != 'F') {
     log_printf("ELF File is invalid!");
-    goto load_failed;
+    goto load_done;
   }
 
-  uint32_t e_phoff = elf_hdr.e_phoff;
-  for (int i = 0; i < elf_hdr.e_phnum; i++, e_phoff += elf_hdr.e_phentsize) {
-    if (sys_lseek(file, e_phoff, 0) < 0) {
-      log_printf("Read file failed!");
-      goto load_failed;
-    }
-
-    size = sys_read(file, (char *)&elf_phdr, sizeof(Elf32_Phdr));
-    if (size < sizeof(Elf32_Phdr)) {
-      log_printf("Read file failed!");
-      goto load_failed;
-    }
+  const uint32_t phdr_end =
+      elf_hdr->e_phoff + elf_hdr->e_phnum * elf_hdr->e_phentsize;
+  if (elf_hdr->e_phentsize < sizeof(Elf32_Phdr) || phdr_end > (uint32_t)size) {
+    log_printf("Program headers are out of the first %d bytes!", size);
+    goto load_done;
+  }
 
-    if ((elf_phdr.p_type != PT_LOAD) || (elf_phdr.p_vaddr < MEM_TASK_BASE))
+  for (int i = 0; i < elf_hdr->e_phnum; i++) {
+    const Elf32_Phdr *elf_phdr =
+        (Elf32_Phdr *)(elf_buf + elf_hdr->e_phoff + i * elf_hdr->e_phentsize);
+    if ((elf_phdr->p_type != PT_LOAD) || (elf_phdr->p_vaddr < MEM_TASK_BASE))
       continue;
 
-    if ((load_phdr(file, &elf_phdr, page_dir)) < 0) {
+    if ((load_phdr(file, elf_phdr, page_dir)) < 0) {
       log_printf("Load program failed!");
-      goto load_failed;
+      goto load_done;
     }
     /*
      * Set the heap_start and heap_end to the end of the last program header,
      * which is also the end of .bss section.
      * .text .rodata .data .bss [heap ->] [<- stack]
      */
-    task->heap_start = task->heap_end = elf_phdr.p_vaddr + elf_phdr.p_memsz;
+    task->heap_start = task->heap_end = elf_phdr->p_vaddr + elf_phdr->p_memsz;
   }
 
-  sys_close(file);
-  return elf_hdr.e_entry;
-
-load_failed:
-  if (file)
-    sys_close(file);
+  entry = elf_hdr->e_entry;
 
-  return 0;
+load_done:
+  sys_close(fd);
+  return entry;
 }
 
 static int copy_args(const char *target, uint32_t page_dir, int argc,
@@ -497,6 +607,9 @@ static int copy_args(const char *target, uint32_t page_dir, int argc,
 }
 
 int sys_execve(const char *name, char *const argv[], char *const envp[]) {
+#if EXEC_REPORT
+  const uint64_t exec_start = read_tsc();
+#endif
   task_t *task = get_curr_task();
   kernel_strncpy(task->name, kernel_basename(name), TASK_NAME_SIZE);
 
@@ -529,9 +642,17 @@ int sys_execve(const char *name, char *const argv[], char *const envp[]) {
   frame->manual_push.eflags = EFLAGS_IF | EFLAGS_DEFAULT;
   frame->auto_push.esp = stack_top - sizeof(uint32_t) * SYSCALL_ARGC;
 
+  io_ring_destroy(task); // the ring lives in the old address space
   task->tss.cr3 = new_page_dir;
   mmu_set_page_dir(new_page_dir);
   memory_destroy_uvm(old_page_dir);
+  boot_stamp_finish(); // the first task only execs the shells
+#if EXEC_REPORT
+  const uint32_t khz = vdso_tsc_khz();
+  if (khz)
+    log_printf("exec %s: %d us", name,
+               (uint32_t)kernel_div_u64((read_tsc() - exec_start) * 1000, khz));
+#endif
   return 0;
 
 exec_failed:
@@ -553,6 +674,14 @@ int task_alloc_fd(file_t *file) {
   return -1;
 }
 
+int task_set_fd(int fd, file_t *file) {
+  if (fd < 0 || fd >= TASK_FILE_NUM)
+    return -1;
+
+  get_curr_task()->file_table[fd] = file;
+  return fd;
+}
+
 int task_remove_fd(int fd) {
   if (fd < 0 || fd >= TASK_FILE_NUM)
     return -1;
@@ -570,6 +699,7 @@ file_t *task_file(int fd) {
 
 void sys_exit(int status) {
   task_t *curr_task = get_curr_task();
+  io_ring_destroy(curr_task);
   for (int fd = 0; fd < TASK_FILE_NUM; fd++) {
     const file_t *file = curr_task->file_table[fd];
     if (file) {
@@ -0,0 +1,49 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "core/vdso.h"
+#include "comm/cpu_instr.h"
+#include "core/memory.h"
+#include "dev/rtc.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+
+// Physical page shared by all tasks, written through the identity mapping
+static vdso_data_t *vdso;
+static uint64_t calib_tsc;
+
+void vdso_init() {
+  vdso = (vdso_data_t *)memory_alloc_page();
+  ASSERT(vdso != NULL);
+
+  kernel_memset(vdso, 0, MEM_PAGE_SIZE);
+  vdso->tick_ms = OS_TICKS_MS;
+  vdso->boot_time = rtc_read_time();
+  vdso->boot_tsc = vdso->tick_tsc = read_tsc();
+}
+
+uint32_t vdso_paddr() { return (uint32_t)vdso; }
+
+void vdso_set_pid(int pid) { vdso->pid = pid; }
+
+uint32_t vdso_tsc_khz() { return vdso ? vdso->tsc_khz : 0; }
+
+/*
+ * Called in the timer interrupt. The TSC frequency is calibrated by the
+ * cycles elapsed over VDSO_CALIB_TICKS ticks after the first one.
+ */
+void vdso_tick(uint32_t ticks) {
+  const uint64_t tsc = read_tsc();
+
+  vdso->seq++;
+  vdso->ticks = ticks;
+  vdso->tick_tsc = tsc;
+  vdso->seq++;
+
+  if (ticks == 1)
+    calib_tsc = tsc;
+  else if (ticks == 1 + VDSO_CALIB_TICKS)
+    vdso->tsc_khz =
+        (uint32_t)(tsc - calib_tsc) / (VDSO_CALIB_TICKS * OS_TICKS_MS);
+}
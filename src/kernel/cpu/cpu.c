@@ -10,6 +10,7 @@
 
 static segment_desc_t gdt_table[GDT_TABLE_SIZE];
 static mutex_t mutex;
+static _Bool sysenter_enabled = FALSE;
 
 void segment_desc_set(int selector, uint32_t base, uint32_t limit,
                       uint16_t attr) {
@@ -45,6 +46,12 @@ void init_gdt() {
   segment_desc_set(KERNEL_SELECTOR_DS, 0, 0xFFFFFFFF,
                    SEG_P | SEG_DPL0 | SEG_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW |
                        SEG_D);
+  segment_desc_set(APP_SELECTOR_CS, 0, 0xFFFFFFFF,
+                   SEG_P | SEG_DPL3 | SEG_NORMAL | SEG_TYPE_CODE | SEG_TYPE_RW |
+                       SEG_D);
+  segment_desc_set(APP_SELECTOR_DS, 0, 0xFFFFFFFF,
+                   SEG_P | SEG_DPL3 | SEG_NORMAL | SEG_TYPE_DATA | SEG_TYPE_RW |
+                       SEG_D);
 
   gate_desc_set((gate_desc_t *)(gdt_table + (SYSCALL_SELECTOR >> 3)),
                 KERNEL_SELECTOR_CS, (uint32_t)syscall_handler,
@@ -53,9 +60,31 @@ void init_gdt() {
   lgdt((uint32_t)gdt_table, sizeof(gdt_table));
 }
 
+/*
+ * sysenter loads CS and SS from MSR_SYSENTER_CS, and sysexit loads the
+ * selectors of applications from the following GDT entries.
+ * The call gate is kept for processors without SEP.
+ */
+static void init_sysenter() {
+  if (!cpu_has_sep())
+    return;
+
+  wrmsr(MSR_SYSENTER_CS, KERNEL_SELECTOR_CS);
+  wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_handler);
+  wrmsr(MSR_SYSENTER_ESP, 0);
+  sysenter_enabled = TRUE;
+}
+
 void cpu_init() {
   mutex_init(&mutex);
   init_gdt();
+  init_sysenter();
+}
+
+// Called before switching to a task, since sysenter doesn't read the TSS
+void cpu_set_sysenter_esp(uint32_t esp) {
+  if (sysenter_enabled)
+    wrmsr(MSR_SYSENTER_ESP, esp);
 }
 
 int gdt_alloc_desc() {
@@ -0,0 +1,602 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/ahci.h"
+#include "comm/boot_info.h"
+#include "dev/pci.h"
+#include "fs/poll.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static ahci_hba_t *hba;
+static ahci_disk_t ahci_disks[AHCI_DISK_NUM];
+static int ahci_disk_cnt = 0;
+static _Bool ahci_irq_on = FALSE; // polled if the IRQ line is unsupported
+
+const dev_desc_t ahci_desc = {.name = "ahci",
+                              .major_no = DEV_AHCI,
+                              .open = ahci_open,
+                              .close = ahci_close,
+                              .read = ahci_read,
+                              .write = ahci_write,
+                              .control = ahci_control,
+                              .poll = ahci_poll};
+
+static int ahci_spin(volatile uint32_t *reg, uint32_t mask, uint32_t value) {
+  for (uint32_t polls = AHCI_SPIN_POLLS; polls; polls--) {
+    if ((*reg & mask) == value)
+      return 0;
+  }
+
+  return -1;
+}
+
+static void ahci_port_stop(ahci_port_t *regs) {
+  regs->cmd &= ~AHCI_PORT_CMD_ST;
+  ahci_spin(&regs->cmd, AHCI_PORT_CMD_CR, 0);
+  regs->cmd &= ~AHCI_PORT_CMD_FRE;
+  ahci_spin(&regs->cmd, AHCI_PORT_CMD_FR, 0);
+}
+
+static void ahci_port_start(ahci_port_t *regs) {
+  ahci_spin(&regs->cmd, AHCI_PORT_CMD_CR, 0);
+  regs->cmd |= AHCI_PORT_CMD_SUD | AHCI_PORT_CMD_POD | AHCI_PORT_CMD_FRE;
+  regs->cmd |= AHCI_PORT_CMD_ST;
+}
+
+/*
+ * Clearing ST aborts every command of the port, and clears CI and SACT.
+ * A device still busy afterwards is reset by a COMRESET.
+ */
+static void ahci_port_recover(ahci_disk_t *disk) {
+  ahci_port_t *regs = disk->regs;
+  ahci_port_stop(regs);
+
+  if (regs->tfd & (STATUS_BSY | STATUS_DRQ)) {
+    regs->sctl = (regs->sctl & ~0xF) | AHCI_SCTL_DET_INIT;
+    ahci_spin(&regs->sctl, 0, 1); // hold the reset for a while
+    regs->sctl &= ~0xF;
+    ahci_spin(&regs->ssts, 0xF, AHCI_SSTS_DET_PRESENT);
+  }
+
+  regs->serr = regs->serr;
+  regs->is = regs->is;
+  ahci_port_start(regs);
+}
+
+static uint32_t slot_mask(int slots) {
+  return slots >= AHCI_SLOT_NUM ? 0xFFFFFFFF : (1U << slots) - 1;
+}
+
+/*
+ * Only the first slot of a request may block, a request which already holds
+ * slots never waits for another one, so that requests can't deadlock.
+ * Return -1 if no slot is free and block is false.
+ */
+static int ahci_alloc_slot(ahci_disk_t *disk, _Bool block) {
+  const irq_state_t state = irq_protect();
+
+  int slot = -1;
+  for (;;) {
+    const uint32_t free = disk->slot_mask & ~disk->busy;
+    if (free) {
+      for (slot = 0; !(free & (1U << slot)); slot++)
+        ;
+
+      disk->busy |= 1U << slot;
+      break;
+    }
+
+    if (!block || !get_curr_task())
+      break;
+
+    list_insert_last(&disk->slot_wait.wait_list, &get_curr_task()->wait_node);
+    wait_block(&disk->slot_wait.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+  return slot;
+}
+
+static void ahci_free_slot(ahci_disk_t *disk, int slot) {
+  const irq_state_t state = irq_protect();
+  disk->busy &= ~(1U << slot);
+  irq_unprotect(state);
+
+  wait_queue_wake(&disk->slot_wait, 1);
+}
+
+/*
+ * Describe the buffer by the regions of the command table, merging the pages
+ * which are physically contiguous. Return the number of regions,
+ * or -1 if a page isn't mapped or the table is too small.
+ */
+static int ahci_build_prdt(ahci_cmd_table_t *table, const void *buf,
+                           uint32_t size) {
+  ahci_prd_t *prd = NULL;
+  uint32_t vaddr = (uint32_t)buf;
+
+  while (size) {
+    const uint32_t paddr = memory_dma_paddr(vaddr);
+    if (!paddr)
+      return -1;
+
+    const uint32_t len =
+        min(size, (uint32_t)(MEM_PAGE_SIZE - (vaddr & (MEM_PAGE_SIZE - 1))));
+    if (prd && prd->dba + prd->dbc + 1 == paddr)
+      prd->dbc += len;
+    else {
+      prd = prd ? prd + 1 : table->prdt;
+      if (prd == table->prdt + AHCI_PRDT_NUM)
+        return -1;
+
+      prd->dba = paddr;
+      prd->dbau = prd->reserved = 0;
+      prd->dbc = len - 1;
+    }
+
+    vaddr += len;
+    size -= len;
+  }
+
+  return prd - table->prdt + 1;
+}
+
+static _Bool is_queued(uint8_t cmd) {
+  return cmd == CMD_READ_FPDMA || cmd == CMD_WRITE_FPDMA;
+}
+
+/*
+ * A queued command carries the sector count in the features,
+ * and its tag, the slot, in the count.
+ */
+static int ahci_build_cmd(ahci_disk_t *disk, int slot, uint8_t cmd,
+                          uint32_t sector, void *buf, uint32_t sectors) {
+  ahci_cmd_table_t *table = disk->cmd_table + slot;
+  const int prds = ahci_build_prdt(table, buf, sectors * disk->sector_size);
+  if (prds < 0)
+    return -1;
+
+  fis_h2d_t *fis = (fis_h2d_t *)table->cfis;
+  kernel_memset(fis, 0, sizeof(fis_h2d_t));
+  fis->type = FIS_TYPE_H2D;
+  fis->flags = FIS_H2D_CMD;
+  fis->command = cmd;
+  fis->device = FIS_DEVICE_LBA;
+  fis->lba0 = (uint8_t)sector;
+  fis->lba1 = (uint8_t)(sector >> 8);
+  fis->lba2 = (uint8_t)(sector >> 16);
+  fis->lba3 = (uint8_t)(sector >> 24);
+
+  if (is_queued(cmd)) {
+    fis->feature_lo = (uint8_t)sectors;
+    fis->feature_hi = (uint8_t)(sectors >> 8);
+    fis->count_lo = slot << 3;
+  } else {
+    fis->count_lo = (uint8_t)sectors;
+    fis->count_hi = (uint8_t)(sectors >> 8);
+  }
+
+  const _Bool write = cmd == CMD_WRITE_FPDMA || cmd == CMD_WRITE_DMA;
+  ahci_cmd_header_t *header = disk->cmd_list + slot;
+  header->flags = sizeof(fis_h2d_t) / 4 | (write ? AHCI_CMD_WRITE : 0);
+  header->prdtl = prds;
+  header->prdbc = 0;
+  return 0;
+}
+
+// SACT should be set before CI for a queued command
+static void ahci_issue(ahci_disk_t *disk, int slot, uint8_t cmd) {
+  const uint32_t bit = 1U << slot;
+  const irq_state_t state = irq_protect();
+
+  disk->issued |= bit;
+  if (is_queued(cmd))
+    disk->regs->sact = bit;
+
+  disk->regs->ci = bit;
+  irq_unprotect(state);
+}
+
+// Before multitasking, or without the interrupt
+static int ahci_poll_slot(ahci_disk_t *disk, int slot) {
+  const uint32_t bit = 1U << slot;
+  ahci_port_t *regs = disk->regs;
+
+  uint32_t polls = AHCI_SPIN_POLLS;
+  while (((regs->ci | regs->sact) & bit) && !(regs->is & AHCI_PORT_IS_ERR) &&
+         --polls)
+    ;
+
+  const irq_state_t state = irq_protect();
+  const _Bool err =
+      !polls || (regs->is & AHCI_PORT_IS_ERR) || (regs->tfd & STATUS_ERR);
+  regs->is = regs->is;
+  if (err)
+    ahci_port_recover(disk);
+
+  disk->issued &= ~bit;
+  irq_unprotect(state);
+
+  ahci_free_slot(disk, slot);
+  return err ? -1 : 0;
+}
+
+// Called with interrupts disabled, after the port is acknowledged
+static void ahci_complete(ahci_disk_t *disk, uint32_t done) {
+  for (int slot = 0; done; slot++, done >>= 1) {
+    if (!(done & 1))
+      continue;
+
+    disk->issued &= ~(1U << slot);
+    sem_notify(disk->done + slot);
+  }
+}
+
+/*
+ * Block until the slot is completed by the interrupt, and free it.
+ * On a timeout, the port is stopped and restarted, which takes every
+ * command back from the HBA before the buffers are returned to their
+ * owners, and the other commands of the port fail.
+ */
+static int ahci_wait_slot(ahci_disk_t *disk, int slot) {
+  if (!get_curr_task() || !ahci_irq_on)
+    return ahci_poll_slot(disk, slot);
+
+  const uint32_t bit = 1U << slot;
+  const int timeout = sem_timedwait(disk->done + slot, AHCI_TIMEOUT_MS);
+
+  irq_state_t state = irq_protect();
+  if (timeout < 0 && (disk->issued & bit)) {
+    ahci_port_recover(disk);
+    disk->issued &= ~bit;
+    disk->failed |= disk->issued;
+    ahci_complete(disk, disk->issued);
+    irq_unprotect(state);
+
+    log_printf("Timed out on %s, slot %d", disk->name, slot);
+    ahci_free_slot(disk, slot);
+    return -1;
+  }
+  irq_unprotect(state);
+
+  if (timeout < 0) // completed right after the timeout
+    sem_wait(disk->done + slot);
+
+  state = irq_protect();
+  const int err = (disk->failed & bit) ? -1 : 0;
+  disk->failed &= ~bit;
+  irq_unprotect(state);
+
+  if (err < 0)
+    log_printf("Command failed on %s, slot %d, task file = %x", disk->name,
+               slot, disk->regs->tfd);
+
+  ahci_free_slot(disk, slot);
+  return err;
+}
+
+/*
+ * Every port is acknowledged before any task is woken up, so that no
+ * interrupt of another port is lost while the handler is preempted.
+ * A command is completed once its bits in both CI and SACT are cleared.
+ */
+static void ahci_handle_irq(void *data) {
+  const uint32_t is = hba->is;
+  if (!is)
+    return;
+
+  uint32_t done[AHCI_DISK_NUM];
+  for (int i = 0; i < ahci_disk_cnt; i++) {
+    ahci_disk_t *disk = ahci_disks + i;
+    done[i] = 0;
+    if (!(is & (1U << disk->port)))
+      continue;
+
+    const uint32_t port_is = disk->regs->is;
+    disk->regs->is = port_is;
+    if (port_is & AHCI_PORT_IS_ERR) { // every outstanding command is aborted
+      disk->failed |= disk->issued;
+      ahci_port_recover(disk);
+    }
+
+    done[i] = disk->issued & ~(disk->regs->ci | disk->regs->sact);
+  }
+
+  hba->is = is;
+  for (int i = 0; i < ahci_disk_cnt; i++)
+    ahci_complete(ahci_disks + i, done[i]);
+}
+
+/*
+ * Split the request into commands of AHCI_MAX_SECTORS, and keep up to
+ * AHCI_REQ_SLOTS of them in flight, completed in order.
+ * Return the number of sectors transferred from the start.
+ */
+static size_t ahci_transfer(ahci_disk_t *disk, uint32_t sector, uint8_t *buf,
+                            size_t sectors, _Bool write) {
+  const uint8_t cmd = disk->ncq ? (write ? CMD_WRITE_FPDMA : CMD_READ_FPDMA)
+                                : (write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  int slots[AHCI_REQ_SLOTS];
+  size_t counts[AHCI_REQ_SLOTS];
+  int head = 0, inflight = 0;
+  size_t issued = 0, done = 0;
+  _Bool failed = FALSE;
+
+  while (inflight || (!failed && issued < sectors)) {
+    while (!failed && issued < sectors && inflight < AHCI_REQ_SLOTS) {
+      const int slot = ahci_alloc_slot(disk, !inflight);
+      if (slot < 0)
+        break;
+
+      const size_t cnt = min(sectors - issued, (size_t)AHCI_MAX_SECTORS);
+      if (ahci_build_cmd(disk, slot, cmd, sector + issued,
+                         buf + issued * disk->sector_size, cnt) < 0) {
+        ahci_free_slot(disk, slot);
+        failed = TRUE;
+        break;
+      }
+
+      ahci_issue(disk, slot, cmd);
+      const int tail = (head + inflight++) % AHCI_REQ_SLOTS;
+      slots[tail] = slot;
+      counts[tail] = cnt;
+      issued += cnt;
+    }
+
+    if (!inflight)
+      break;
+
+    if (ahci_wait_slot(disk, slots[head]) < 0)
+      failed = TRUE;
+    else if (!failed)
+      done += counts[head];
+
+    head = (head + 1) % AHCI_REQ_SLOTS;
+    inflight--;
+  }
+
+  return done;
+}
+
+// The regions should be aligned to 2 bytes, copy through a page otherwise
+static size_t ahci_bounce(ahci_disk_t *disk, uint32_t sector, uint8_t *buf,
+                          size_t sectors, _Bool write) {
+  uint8_t *page = (uint8_t *)memory_alloc_page();
+  if (!page)
+    return 0;
+
+  const size_t per_page = MEM_PAGE_SIZE / disk->sector_size;
+  size_t done = 0;
+  while (done < sectors) {
+    const size_t cnt = min(sectors - done, per_page);
+    uint8_t *part = buf + done * disk->sector_size;
+    if (write)
+      kernel_memcpy(page, part, cnt * disk->sector_size);
+
+    if (ahci_transfer(disk, sector + done, page, cnt, write) < cnt)
+      break;
+
+    if (!write)
+      kernel_memcpy(part, page, cnt * disk->sector_size);
+
+    done += cnt;
+  }
+
+  memory_free_page((uint32_t)page);
+  return done;
+}
+
+static size_t ahci_rw(ahci_disk_t *disk, uint32_t sector, void *buf,
+                      size_t sectors, _Bool write) {
+  return ((uint32_t)buf & 1) ? ahci_bounce(disk, sector, buf, sectors, write)
+                             : ahci_transfer(disk, sector, buf, sectors, write);
+}
+
+static int ahci_identify(ahci_disk_t *disk, uint32_t cap) {
+  uint16_t *buf = (uint16_t *)memory_alloc_page();
+  if (!buf)
+    return -1;
+
+  disk->sector_size = SECTOR_SIZE;
+  const int slot = ahci_alloc_slot(disk, FALSE);
+  int err = ahci_build_cmd(disk, slot, CMD_IDENTIFY, 0, buf, 1);
+  if (err < 0)
+    ahci_free_slot(disk, slot);
+  else {
+    ahci_issue(disk, slot, CMD_IDENTIFY);
+    err = ahci_wait_slot(disk, slot);
+  }
+
+  if (err < 0) {
+    memory_free_page((uint32_t)buf);
+    return err;
+  }
+
+  disk->sectors = sectors(buf);
+  disk->ncq = (cap & AHCI_CAP_SNCQ) && (buf[IDENTIFY_SATA_CAP] & SATA_CAP_NCQ);
+  if (disk->ncq) // the smaller one of the HBA and the device
+    disk->slot_mask &= slot_mask((buf[IDENTIFY_QUEUE_DEPTH] & 0x1F) + 1);
+
+  part_info_t *part = disk->part_info;
+  part->disk = disk;
+  kernel_sprintf(part->name, "%s%d", disk->name, 0);
+  part->start_sector = 0;
+  part->total_sector = disk->sectors;
+  part->type = FS_INVALID;
+
+  // The IDENTIFY data isn't needed any more, reuse the page for the MBR
+  if (ahci_rw(disk, 0, buf, 1, FALSE) == 1)
+    disk_parse_mbr((const mbr_t *)buf, disk->name, disk, disk->part_info);
+  else
+    log_printf("Failed to read MBR!");
+
+  memory_free_page((uint32_t)buf);
+  return 0;
+}
+
+static int ahci_port_init(ahci_disk_t *disk, int port, uint32_t cap) {
+  ahci_port_t *regs = hba->ports + port;
+  if (AHCI_SSTS_DET(regs->ssts) != AHCI_SSTS_DET_PRESENT ||
+      regs->sig != AHCI_SIG_ATA)
+    return -1;
+
+  const uint32_t mem = memory_alloc_pages(AHCI_PORT_PAGES);
+  if (!mem)
+    return -1;
+
+  kernel_memset((void *)mem, 0, AHCI_PORT_PAGES * MEM_PAGE_SIZE);
+  disk->port = port;
+  disk->regs = regs;
+  disk->cmd_list = (ahci_cmd_header_t *)mem;
+  disk->cmd_table = (ahci_cmd_table_t *)(mem + MEM_PAGE_SIZE);
+  disk->slot_mask = slot_mask(AHCI_CAP_NCS(cap));
+  wait_queue_init(&disk->slot_wait);
+
+  for (int i = 0; i < AHCI_SLOT_NUM; i++) {
+    disk->cmd_list[i].ctba = (uint32_t)(disk->cmd_table + i);
+    sem_init(disk->done + i, 0);
+  }
+
+  ahci_port_stop(regs);
+  regs->clb = mem;
+  regs->clbu = 0;
+  regs->fb = mem + AHCI_CMD_LIST_SIZE;
+  regs->fbu = 0;
+  regs->serr = regs->serr;
+  regs->is = regs->is;
+  ahci_port_start(regs);
+
+  if (ahci_identify(disk, cap) < 0) {
+    log_printf("Failed to identify disk %s!", disk->name);
+    ahci_port_stop(regs);
+    memory_free_pages(mem, AHCI_PORT_PAGES);
+    return -1;
+  }
+
+  regs->ie = AHCI_PORT_IE;
+  return 0;
+}
+
+static void print_ahci_info(const ahci_disk_t *disk) {
+  log_printf("%s", disk->name);
+  log_printf("Port: %d, NCQ: %d", disk->port, disk->ncq);
+  log_printf("Total size: %d MiB", disk_size_mib(disk));
+
+  for (int i = 0; i < PRIMARY_PART_NUM; i++) {
+    const part_info_t *part_info = disk->part_info + i;
+    if (part_info->type != FS_INVALID) {
+      log_printf("%s: Type = %x, Starting sector = %d, Total sectors: %d",
+                 part_info->name, part_info->type, part_info->start_sector,
+                 part_info->total_sector);
+    }
+  }
+}
+
+/*
+ * Every implemented port with an ATA device becomes a disk,
+ * whose commands are completed by the interrupt of the HBA.
+ */
+void ahci_init() {
+  pci_dev_t pci;
+  if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, &pci) < 0 ||
+      pci.prog_if != PCI_PROG_IF_AHCI)
+    return;
+
+  log_printf("Initializing AHCI...");
+  const uint32_t bar = pci_bar(&pci, AHCI_ABAR);
+  if ((bar & PCI_BAR_IO) ||
+      !(hba = memory_map_mmio(pci_bar_addr(bar), sizeof(ahci_hba_t))))
+    return;
+
+  pci_enable(&pci, PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER);
+  hba->ghc |= AHCI_GHC_AE;
+
+  const uint32_t cap = hba->cap, pi = hba->pi;
+  for (int port = 0; port < AHCI_PORT_NUM && ahci_disk_cnt < AHCI_DISK_NUM;
+       port++) {
+    if (!(pi & (1U << port)))
+      continue;
+
+    ahci_disk_t *disk = ahci_disks + ahci_disk_cnt;
+    kernel_memset(disk, 0, sizeof(ahci_disk_t));
+    kernel_sprintf(disk->name, "SATA: /dev/sd%c", ahci_disk_cnt + 'a');
+    if (ahci_port_init(disk, port, cap) < 0)
+      continue;
+
+    print_ahci_info(disk);
+    ahci_disk_cnt++;
+  }
+
+  if (ahci_disk_cnt && !pci_irq_install(&pci, ahci_handle_irq, NULL)) {
+    hba->is = hba->is;
+    hba->ghc |= AHCI_GHC_IE;
+    ahci_irq_on = TRUE;
+  }
+}
+
+int ahci_open(device_t *dev) {
+  const int disk_id = get_ahci_id(dev->minor_no);
+  const int part_id = get_part_id(dev->minor_no);
+
+  if (disk_id >= ahci_disk_cnt || part_id >= PRIMARY_PART_NUM) {
+    log_printf("Invalid minor number!");
+    return -1;
+  }
+
+  const part_info_t *part_info = ahci_disks[disk_id].part_info + part_id;
+  if (!part_info->total_sector) {
+    log_printf("Partition does not exist: /dev/sd%x", dev->minor_no);
+    return -1;
+  }
+
+  dev->data = (void *)part_info;
+  return 0;
+}
+
+int ahci_close(const device_t *dev) { return -1; }
+
+/*
+ * Several tasks may have commands outstanding on the same port,
+ * a NCQ device reorders and overlaps them by itself.
+ */
+int ahci_read(const device_t *dev, uint32_t start_sector, void *buf,
+              size_t sectors) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info)
+    return -1;
+
+  const size_t sector_read =
+      ahci_rw((ahci_disk_t *)part_info->disk,
+              part_info->start_sector + start_sector, buf, sectors, FALSE);
+  poll_notify();
+  return sector_read;
+}
+
+int ahci_write(const device_t *dev, uint32_t start_sector, const void *buf,
+               size_t sectors) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info || !sectors)
+    return -1;
+
+  const size_t sector_written =
+      ahci_rw((ahci_disk_t *)part_info->disk,
+              part_info->start_sector + start_sector, (void *)buf, sectors,
+              TRUE);
+  poll_notify();
+  return sector_written;
+}
+
+int ahci_control(const device_t *dev, int cmd, va_list arg_list) { return -1; }
+
+// The disk would block while every slot of the port is busy
+int ahci_poll(const device_t *dev) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info)
+    return POLLNVAL;
+
+  const ahci_disk_t *disk = part_info->disk;
+  return (disk->busy & disk->slot_mask) == disk->slot_mask ? 0
+                                                           : POLLIN | POLLOUT;
+}
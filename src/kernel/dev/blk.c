@@ -0,0 +1,359 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/blk.h"
+#include "comm/boot_info.h"
+#include "core/memory.h"
+#include "cpu/irq.h"
+#include "dev/timer.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+void blk_queue_init(blk_queue_t *queue, const char *name,
+                    blk_transfer_t transfer) {
+  kernel_memset(queue, 0, sizeof(blk_queue_t));
+  queue->name = name;
+  queue->transfer = transfer;
+  list_init(&queue->sorted);
+  list_init(queue->fifo);
+  list_init(queue->fifo + 1);
+  wait_queue_init(&queue->worker_wait);
+}
+
+// The order of the elevator, the devices of a queue are never interleaved
+static _Bool blk_before(const void *dev, uint32_t sector, const void *pos_dev,
+                        uint32_t pos_sector) {
+  return (uint32_t)dev < (uint32_t)pos_dev ||
+         (dev == pos_dev && sector < pos_sector);
+}
+
+// The request at which the dispatch starts, called with interrupts disabled
+static blk_req_t *blk_pick(blk_queue_t *queue) {
+  const uint32_t now = timer_get_tick();
+  for (int dir = 0; dir < 2; dir++) { // reads expire first
+    if (list_is_empty(queue->fifo + dir))
+      continue;
+
+    blk_req_t *req =
+        list_node_parent(list_first(queue->fifo + dir), blk_req_t, fifo_node);
+    if ((int)(now - req->deadline) >= 0) {
+      queue->stat.expired++;
+      return req;
+    }
+  }
+
+  // The first one from the position of the head onwards, or wrap around
+  list_for_each_node(&queue->sorted, node) {
+    blk_req_t *req = list_node_parent(node, blk_req_t, sort_node);
+    if (!blk_before(req->dev, req->sector, queue->next_dev,
+                    queue->next_sector))
+      return req;
+  }
+
+  return list_node_parent(list_first(&queue->sorted), blk_req_t, sort_node);
+}
+
+static void blk_dequeue(blk_queue_t *queue, blk_req_t *req) {
+  list_remove(&queue->sorted, &req->sort_node);
+  list_remove(queue->fifo + req->write, &req->fifo_node);
+}
+
+/*
+ * Take the first request and the following ones which continue it on the
+ * same device in the same direction, and flatten their segments.
+ * Return the number of requests, called with interrupts disabled.
+ */
+static int blk_gather(blk_queue_t *queue, blk_req_t *first, int *seg_cnt,
+                      size_t *sectors) {
+  int cnt = 0;
+  *seg_cnt = 0;
+  *sectors = 0;
+
+  for (blk_req_t *req = first; req && cnt < BLK_BATCH_REQS;) {
+    if (req != first &&
+        (req->dev != first->dev || req->write != first->write ||
+         req->sector != first->sector + *sectors ||
+         *sectors + req->sectors > BLK_MAX_SECTORS ||
+         *seg_cnt + req->seg_cnt > BLK_BATCH_SEGS))
+      break;
+
+    list_node_t *next = list_node_next(&req->sort_node);
+    blk_dequeue(queue, req);
+    queue->batch[cnt++] = req;
+    *sectors += req->sectors;
+
+    for (int i = 0; i < req->seg_cnt; i++) {
+      blk_seg_t *last = *seg_cnt ? queue->segs + *seg_cnt - 1 : NULL;
+      if (last && last->paddr + last->len == req->segs[i].paddr)
+        last->len += req->segs[i].len;
+      else
+        queue->segs[(*seg_cnt)++] = req->segs[i];
+    }
+
+    req = next ? list_node_parent(next, blk_req_t, sort_node) : NULL;
+  }
+
+  queue->stat.dispatches++;
+  queue->stat.merged += cnt - 1;
+  return cnt;
+}
+
+static void blk_complete(blk_req_t *req, size_t result) {
+  req->result = result;
+  if (req->done) {
+    req->done(req);
+    return;
+  }
+
+  // The owner may return as soon as it sees completed
+  const irq_state_t state = irq_protect();
+  req->completed = TRUE;
+  wait_queue_wake(&req->wait, TASK_NUM);
+  irq_unprotect(state);
+}
+
+static void blk_worker(void *arg) {
+  blk_queue_t *queue = arg;
+
+  for (;;) {
+    const irq_state_t state = irq_protect();
+    while (list_is_empty(&queue->sorted)) {
+      list_insert_last(&queue->worker_wait.wait_list,
+                       &get_curr_task()->wait_node);
+      wait_block(&queue->worker_wait.wait_list, WAIT_FOREVER);
+    }
+
+    blk_req_t *first = blk_pick(queue);
+    int seg_cnt;
+    size_t sectors;
+    const int cnt = blk_gather(queue, first, &seg_cnt, &sectors);
+    queue->active = TRUE;
+    irq_unprotect(state);
+
+    void *dev = first->dev;
+    const uint32_t sector = first->sector;
+    size_t done = queue->transfer(dev, sector, queue->segs, seg_cnt, sectors,
+                                  first->write);
+    queue->next_dev = dev;
+    queue->next_sector = sector + sectors;
+    queue->active = FALSE;
+
+    for (int i = 0; i < cnt; i++) {
+      blk_req_t *req = queue->batch[i];
+      const size_t result = min(done, req->sectors);
+      done -= result;
+      blk_complete(req, result);
+    }
+  }
+}
+
+// Dispatch by a worker thread, once multitasking is available
+int blk_queue_start(blk_queue_t *queue) {
+  const uint32_t page_dir = memory_create_uvm();
+  if (!page_dir)
+    return -1;
+
+  task_t *worker =
+      task_create_kthread(queue->name, page_dir, blk_worker, queue);
+  if (!worker) {
+    memory_destroy_uvm(page_dir);
+    log_printf("Failed to start %s!", queue->name);
+    return -1;
+  }
+
+  const irq_state_t state = irq_protect();
+  worker->base_priority = BLK_WORKER_PRIORITY;
+  task_set_priority(worker, BLK_WORKER_PRIORITY);
+  queue->worker = worker;
+  irq_unprotect(state);
+  return 0;
+}
+
+// The queue would block a new request while it holds or transfers requests
+_Bool blk_queue_busy(const blk_queue_t *queue) {
+  return queue->active || !list_is_empty(&queue->sorted);
+}
+
+/*
+ * Translate the buffer in the current address space to physical segments,
+ * merging the pages which are physically contiguous.
+ * Return -1 if a page isn't mapped or the buffer has too many segments.
+ */
+int blk_req_init(blk_req_t *req, void *dev, uint32_t sector, void *buf,
+                 size_t sectors, _Bool write) {
+  kernel_memset(req, 0, sizeof(blk_req_t));
+  req->dev = dev;
+  req->sector = sector;
+  req->sectors = sectors;
+  req->write = write;
+  wait_queue_init(&req->wait);
+
+  uint32_t vaddr = (uint32_t)buf, size = sectors * SECTOR_SIZE;
+  while (size) {
+    const uint32_t paddr = memory_dma_paddr(vaddr);
+    if (!paddr)
+      return -1;
+
+    const uint32_t len =
+        min(size, (uint32_t)(MEM_PAGE_SIZE - (vaddr & (MEM_PAGE_SIZE - 1))));
+    blk_seg_t *last = req->seg_cnt ? req->segs + req->seg_cnt - 1 : NULL;
+    if (last && last->paddr + last->len == paddr)
+      last->len += len;
+    else {
+      if (req->seg_cnt == BLK_SEG_NUM)
+        return -1;
+
+      req->segs[req->seg_cnt].paddr = paddr;
+      req->segs[req->seg_cnt++].len = len;
+    }
+
+    vaddr += len;
+    size -= len;
+  }
+
+  return 0;
+}
+
+static uint32_t blk_expire_ticks(_Bool write) {
+  const uint32_t ms = write ? BLK_WRITE_EXPIRE_MS : BLK_READ_EXPIRE_MS;
+  return (ms + OS_TICKS_MS - 1) / OS_TICKS_MS;
+}
+
+// Before the worker starts, the request is transferred by the caller
+void blk_submit(blk_queue_t *queue, blk_req_t *req) {
+  if (!queue->worker || !get_curr_task()) {
+    blk_complete(req, queue->transfer(req->dev, req->sector, req->segs,
+                                      req->seg_cnt, req->sectors, req->write));
+    return;
+  }
+
+  const irq_state_t state = irq_protect();
+  req->deadline = timer_get_tick() + blk_expire_ticks(req->write);
+
+  list_node_t *pos = list_last(&queue->sorted);
+  while (pos) { // mostly appended, so search from the tail
+    const blk_req_t *curr = list_node_parent(pos, blk_req_t, sort_node);
+    if (!blk_before(req->dev, req->sector, curr->dev, curr->sector))
+      break;
+
+    pos = list_node_prev(pos);
+  }
+
+  if (pos)
+    list_insert_after(&queue->sorted, pos, &req->sort_node);
+  else
+    list_insert_first(&queue->sorted, &req->sort_node);
+
+  list_insert_last(queue->fifo + req->write, &req->fifo_node);
+  queue->stat.requests++;
+  irq_unprotect(state);
+
+  wait_queue_wake(&queue->worker_wait, 1);
+}
+
+// Return the number of sectors transferred
+size_t blk_wait(blk_req_t *req) {
+  const irq_state_t state = irq_protect();
+  while (!req->completed) {
+    list_insert_last(&req->wait.wait_list, &get_curr_task()->wait_node);
+    wait_block(&req->wait.wait_list, WAIT_FOREVER);
+  }
+  irq_unprotect(state);
+
+  return req->result;
+}
+
+/*
+ * Split the buffer into requests of BLK_REQ_SECTORS, keeping BLK_RW_DEPTH of
+ * them queued, so that the worker can merge them into one dispatch.
+ * Return the number of sectors transferred from the start.
+ */
+size_t blk_rw(blk_queue_t *queue, void *dev, uint32_t sector, void *buf,
+              size_t sectors, _Bool write) {
+  blk_req_t reqs[BLK_RW_DEPTH];
+  int head = 0, inflight = 0;
+  size_t issued = 0, done = 0;
+  _Bool failed = FALSE;
+
+  while (inflight || (!failed && issued < sectors)) {
+    while (!failed && issued < sectors && inflight < BLK_RW_DEPTH) {
+      blk_req_t *req = reqs + (head + inflight) % BLK_RW_DEPTH;
+      const size_t cnt = min(sectors - issued, (size_t)BLK_REQ_SECTORS);
+      if (blk_req_init(req, dev, sector + issued,
+                       (uint8_t *)buf + issued * SECTOR_SIZE, cnt,
+                       write) < 0) {
+        failed = TRUE;
+        break;
+      }
+
+      blk_submit(queue, req);
+      inflight++;
+      issued += cnt;
+    }
+
+    if (!inflight)
+      break;
+
+    blk_req_t *req = reqs + head;
+    const size_t result = blk_wait(req);
+    if (!failed)
+      done += result;
+
+    if (result < req->sectors)
+      failed = TRUE;
+
+    head = (head + 1) % BLK_RW_DEPTH;
+    inflight--;
+  }
+
+  return done;
+}
+
+void blk_cursor_init(blk_cursor_t *cursor, const blk_seg_t *segs,
+                     uint32_t offset) {
+  while (offset >= segs->len) {
+    offset -= segs->len;
+    segs++;
+  }
+
+  cursor->seg = segs;
+  cursor->offset = offset;
+}
+
+static void blk_cursor_advance(blk_cursor_t *cursor, uint32_t size) {
+  cursor->offset += size;
+  if (cursor->offset == cursor->seg->len) {
+    cursor->seg++;
+    cursor->offset = 0;
+  }
+}
+
+// Return the next size bytes if they are contiguous, NULL otherwise
+void *blk_cursor_take(blk_cursor_t *cursor, uint32_t size) {
+  if (cursor->seg->len - cursor->offset < size)
+    return NULL;
+
+  void *addr = (void *)(cursor->seg->paddr + cursor->offset);
+  blk_cursor_advance(cursor, size);
+  return addr;
+}
+
+// The physical memory is identity mapped in every address space
+void blk_cursor_copy(blk_cursor_t *cursor, void *buf, uint32_t size,
+                     _Bool to_segs) {
+  uint8_t *ptr = buf;
+  while (size) {
+    const uint32_t len = min(size, cursor->seg->len - cursor->offset);
+    void *addr = (void *)(cursor->seg->paddr + cursor->offset);
+    if (to_segs)
+      kernel_memcpy(addr, ptr, len);
+    else
+      kernel_memcpy(ptr, addr, len);
+
+    blk_cursor_advance(cursor, len);
+    ptr += len;
+    size -= len;
+  }
+}
@@ -4,6 +4,7 @@
 
 #include "dev/console.h"
 #include "comm/cpu_instr.h"
+#include "fs/poll.h"
 #include "ipc/mutex.h"
 #include "tools/klib.h"
 
@@ -321,6 +322,9 @@ int console_write(tty_t *tty) {
   if (tty->console_id == curr_console_id)
     update_cursor_pos(console);
 
+  if (len)
+    poll_notify(); // POLLOUT of the tty, as output_sem was notified
+
   return len;
 }
 
@@ -4,16 +4,31 @@
 
 #include "dev/dev.h"
 #include "cpu/irq.h"
+#include "fs/poll.h"
 #include "tools/klib.h"
 
 extern dev_desc_t tty_desc;
 extern dev_desc_t disk_desc;
+extern dev_desc_t trace_desc;
+extern dev_desc_t syslat_desc;
+extern dev_desc_t prof_desc;
+extern dev_desc_t boot_stamp_desc;
+extern dev_desc_t disk_stat_desc;
+extern dev_desc_t ahci_desc;
+extern dev_desc_t virtio_blk_desc;
+extern dev_desc_t ramdisk_desc;
+extern dev_desc_t mutex_stat_desc;
 
 /*
  * dev_desc_table is for different device types
  * dev_table is for specific devices
  */
-static dev_desc_t *dev_desc_table[] = {&tty_desc, &disk_desc};
+static dev_desc_t *dev_desc_table[] = {&tty_desc,    &disk_desc,
+                                      &trace_desc,  &syslat_desc,
+                                      &prof_desc,   &boot_stamp_desc,
+                                      &disk_stat_desc, &ahci_desc,
+                                      &virtio_blk_desc, &ramdisk_desc,
+                                      &mutex_stat_desc};
 static device_t dev_table[DEV_TABLE_SIZE];
 
 static _Bool is_dev_id_valid(int dev_id) {
@@ -120,3 +135,11 @@ int dev_control(int dev_id, int cmd, ...) {
 
   return return_value;
 }
+
+int dev_poll(int dev_id) {
+  if (!is_dev_id_valid(dev_id))
+    return POLLNVAL;
+
+  const device_t *device = dev_table + dev_id;
+  return device->desc->poll ? device->desc->poll(device) : POLL_DEFAULT_MASK;
+}
@@ -5,14 +5,23 @@
 #include "dev/disk.h"
 #include "comm/boot_info.h"
 #include "comm/cpu_instr.h"
+#include "core/vdso.h"
+#include "dev/pci.h"
+#include "fs/bcache.h"
+#include "fs/poll.h"
+#include "ipc/mutex_stat.h"
+#include "os_cfg.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 
 static disk_t disk_buf[DISK_NUM];
-static mutex_t rw_mutex;
-static sem_t rw_sem;
+static ide_channel_t channels[IDE_CHANNEL_NUM];
 
-static _Bool disk_on_task = FALSE;
+static _Bool dma_on = DISK_DMA_DEFAULT; // toggled by DISK_CMD_DMA
+static disk_cycles_t disk_cycles[DISK_MODE_NUM];
+
+static size_t disk_transfer(void *dev, uint32_t sector, const blk_seg_t *segs,
+                            int seg_cnt, size_t sectors, _Bool write);
 
 const dev_desc_t disk_desc = {.name = "tty",
                               .major_no = DEV_DISK,
@@ -20,7 +29,16 @@ const dev_desc_t disk_desc = {.name = "tty",
                               .close = disk_close,
                               .read = disk_read,
                               .write = disk_write,
-                              .control = disk_control};
+                              .control = disk_control,
+                              .poll = disk_poll};
+
+const dev_desc_t disk_stat_desc = {.name = "diskstat",
+                                   .major_no = DEV_DISKSTAT,
+                                   .open = disk_stat_open,
+                                   .close = disk_stat_close,
+                                   .read = disk_stat_read,
+                                   .write = disk_stat_write,
+                                   .control = disk_stat_control};
 
 static void disk_send_cmd(const disk_t *disk, uint32_t start_sector,
                           uint32_t sectors, int cmd) {
@@ -59,37 +77,105 @@ static int disk_wait_data(const disk_t *disk) {
   return (status & STATUS_ERR) ? -1 : 0;
 }
 
-static int detect_part_info(disk_t *disk) {
-  mbr_t mbr;
+// Give up after polls reads of the status, for a drive which may never answer
+static int disk_poll_data(const disk_t *disk, uint32_t polls) {
+  uint8_t status;
+  do {
+    status = inb(STATUS_REG(disk));
+    if ((status & (STATUS_BSY | STATUS_DRQ | STATUS_ERR)) != STATUS_BSY)
+      return (status & STATUS_ERR) ? -1 : 0;
+  } while (--polls);
 
-  disk_send_cmd(disk, 0, 1, CMD_READ);
-  const int err = disk_wait_data(disk);
-  if (err < 0) {
-    log_printf("Failed to read MBR!");
-    return err;
-  }
+  return -1;
+}
 
-  read_disk(disk, &mbr, sizeof(mbr_t));
-  part_entry_t *part_entry = mbr.part_table;
-  part_info_t *part_info = disk->part_info + 1;
-  // The first partition represents the entire disk
+// Give up after polls reads of the status, if the drive stays busy
+static int disk_poll_ready(const disk_t *disk, uint32_t polls) {
+  do {
+    if (!(inb(STATUS_REG(disk)) & STATUS_BSY))
+      return 0;
+  } while (--polls);
+
+  return -1;
+}
+
+/*
+ * Fill the primary partitions from the MBR, shared by the disk drivers.
+ * The first partition represents the entire disk, and is left to the caller.
+ */
+void disk_parse_mbr(const mbr_t *mbr, const char *disk_name, const void *disk,
+                    part_info_t *part_info) {
+  const part_entry_t *part_entry = mbr->part_table;
+  part_info++;
 
   for (int i = 0; i < MBR_PRIMARY_PARTC; i++, part_entry++, part_info++) {
     part_info->type = part_entry->system_id;
     if (part_info->type == FS_INVALID)
       kernel_memset(part_info, 0, sizeof(part_info_t));
     else {
-      kernel_sprintf(part_info->name, "%s%d", disk->name, i + 1);
+      kernel_sprintf(part_info->name, "%s%d", disk_name, i + 1);
       part_info->start_sector = part_entry->relative_sector;
       part_info->total_sector = part_entry->total_sector;
       part_info->disk = disk;
     }
   }
+}
+
+static int detect_part_info(disk_t *disk) {
+  mbr_t mbr;
 
+  disk_send_cmd(disk, 0, 1, CMD_READ);
+  const int err = disk_wait_data(disk);
+  if (err < 0) {
+    log_printf("Failed to read MBR!");
+    return err;
+  }
+
+  read_disk(disk, &mbr, sizeof(mbr_t));
+  disk_parse_mbr(&mbr, disk->name, disk, disk->part_info);
   return 0;
 }
 
+/*
+ * Let PIO transfer blocks of sectors per interrupt by READ/WRITE MULTIPLE.
+ * The count should be a power of 2 no more than the maximum from IDENTIFY,
+ * and the drive keeps transferring one sector per interrupt if it aborts.
+ */
+static int send_multiple_mode(disk_t *disk, uint32_t cnt) {
+  disk_send_cmd(disk, 0, cnt, CMD_SET_MULTIPLE);
+  if (disk_poll_data(disk, DISK_IDENTIFY_POLLS) < 0) {
+    log_printf("Multiple mode isn't supported by disk %s", disk->name);
+    disk->multiple = 1;
+    return -1;
+  }
+
+  disk->multiple = cnt;
+  return 0;
+}
+
+static void set_multiple_mode(disk_t *disk, uint32_t max) {
+  disk->multiple = 1;
+  uint32_t cnt = DISK_MULTIPLE_MAX;
+  while (cnt > max)
+    cnt >>= 1;
+
+  if (cnt >= 2)
+    send_multiple_mode(disk, cnt);
+}
+
+/*
+ * An absent drive is detected from the status before sending IDENTIFY,
+ * and a drive which is not ATA aborts IDENTIFY with a signature in the LBA
+ * registers, so that booting never waits on a drive which can't answer.
+ */
 static int identify_disk(disk_t *disk) {
+  outb(DRIVE_REG(disk), DRIVE_REG_BASE | disk->drive_type);
+  const uint8_t status = inb(STATUS_REG(disk));
+  if (!status || status == 0xFF) { // nothing attached, or a floating bus
+    log_printf("No such disk: %s", disk->name);
+    return -1;
+  }
+
   disk_send_cmd(disk, 0, 0, CMD_IDENTIFY);
 
   if (!inb(STATUS_REG(disk))) {
@@ -97,7 +183,18 @@ static int identify_disk(disk_t *disk) {
     return -1;
   }
 
-  const int err = disk_wait_data(disk);
+  // The signature is only valid once the drive is no longer busy
+  if (disk_poll_ready(disk, DISK_IDENTIFY_POLLS) < 0) {
+    log_printf("Disk %s is busy after IDENTIFY!", disk->name);
+    return -1;
+  }
+
+  if (inb(LBA_MID_REG(disk)) || inb(LBA_HI_REG(disk))) {
+    log_printf("Not an ATA disk: %s", disk->name);
+    return -1;
+  }
+
+  const int err = disk_poll_data(disk, DISK_IDENTIFY_POLLS);
   if (err < 0) {
     log_printf("Failed to read data from disk %s!", disk->name);
     return err;
@@ -107,6 +204,7 @@ static int identify_disk(disk_t *disk) {
   read_disk(disk, disk_buf, sizeof(disk_buf));
   disk->sectors = sectors(disk_buf);
   disk->sector_size = SECTOR_SIZE;
+  set_multiple_mode(disk, disk_buf[ID_MULTIPLE_WORD] & 0xFF);
 
   /*
    * Regard the entire disk as a huge partition,
@@ -127,6 +225,7 @@ static void print_disk_info(disk_t *disk) {
   log_printf("%s", disk->name);
   log_printf("Base Address of Port: 0x%x", disk->port_base);
   log_printf("Total size: %d MiB", disk_size_mib(disk));
+  log_printf("Sectors per interrupt of PIO: %d", disk->multiple);
 
   for (int i = 0; i < PRIMARY_PART_NUM; i++) {
     part_info_t *part_info = disk->part_info + i;
@@ -138,24 +237,79 @@ static void print_disk_info(disk_t *disk) {
   }
 }
 
+/*
+ * The bus master of the IDE controller (e.g. PIIX) has its registers in the
+ * I/O space of BAR4, 8 bytes per channel. Return 0 if the controller can only
+ * do PIO.
+ */
+static uint16_t find_bus_master() {
+  pci_dev_t pci;
+  if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &pci) < 0)
+    return 0;
+
+  const uint32_t bar = pci_bar(&pci, BM_BAR);
+  if (!(bar & PCI_BAR_IO) || !pci_bar_addr(bar))
+    return 0;
+
+  pci_enable(&pci, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+  log_printf("IDE bus master at port 0x%x", pci_bar_addr(bar));
+  return pci_bar_addr(bar);
+}
+
+static void channel_init(ide_channel_t *channel, const char *name,
+                         uint16_t port_base, uint16_t bm_base, int irq,
+                         irq_handler_t handler) {
+  channel->port_base = port_base;
+  channel->irq = irq;
+  channel->handler = handler;
+  mutex_init(&channel->rw_mutex);
+  mutex_stat_add(&channel->rw_mutex, name);
+  sem_init(&channel->rw_sem, 0);
+  blk_queue_init(&channel->queue, name, disk_transfer);
+
+  if (bm_base && (channel->prd_table = (prd_t *)memory_alloc_page()))
+    channel->bm_base = bm_base;
+}
+
 void disk_init() {
   log_printf("Initializing disk...");
 
-  mutex_init(&rw_mutex);
-  sem_init(&rw_sem, 0);
+  const uint16_t bm_base = find_bus_master();
+
+  kernel_memset(channels, 0, sizeof(channels));
+  channel_init(channels, "IDE Primary", PRIMARY_BUS_BASE, bm_base,
+               IRQ14_IDE_PRIMARY, (irq_handler_t)exception_handler_ide_primary);
+  channel_init(channels + 1, "IDE Secondary", SECONDARY_BUS_BASE,
+               bm_base ? bm_base + BM_CHANNEL_SIZE : 0, IRQ15_IDE_SECONDARY,
+               (irq_handler_t)exception_handler_ide_secondary);
+
   kernel_memset(disk_buf, 0, sizeof(disk_buf));
-  for (int i = 0; i < DISK_PER_BUS; i++) {
+  for (int i = 0; i < DISK_NUM; i++) {
     disk_t *disk = disk_buf + i;
+    ide_channel_t *channel = channels + i / DISK_PER_BUS;
     kernel_sprintf(disk->name, "Disk: /dev/hd%c", i + 'a');
-    disk->drive_type = (i == 0) ? MASTER : SLAVE;
-    disk->port_base = PRIMARY_BUS_BASE;
-    disk->rw_mutex = &rw_mutex;
-    disk->rw_sem = &rw_sem;
+    disk->drive_type = (i % DISK_PER_BUS == 0) ? MASTER : SLAVE;
+    disk->port_base = channel->port_base;
+    disk->bm_base = channel->bm_base;
+    disk->channel = channel;
 
     if (identify_disk(disk) < 0)
       log_printf("Failed to identify disk %s!", disk->name);
+    else {
+      channel->disks++;
+      print_disk_info(disk);
+    }
+  }
+}
 
-    print_disk_info(disk);
+/*
+ * Requests are queued once the worker of the channel runs, and transferred
+ * inline before. A channel without disks has no worker.
+ */
+void disk_start() {
+  for (int i = 0; i < IDE_CHANNEL_NUM; i++) {
+    if (channels[i].disks)
+      blk_queue_start(&channels[i].queue);
   }
 }
 
@@ -182,106 +336,438 @@ int disk_open(device_t *dev) {
 
   dev->data = (void *)part_info;
 
-  irq_install(IRQ14_IDE_PRIMARY, (irq_handler_t)exception_handler_ide_primary);
-  irq_enable(IRQ14_IDE_PRIMARY);
+  const ide_channel_t *channel = disk->channel;
+  irq_install(channel->irq, channel->handler);
+  irq_enable(channel->irq);
   return 0;
 }
 
 int disk_close(const device_t *dev) { return -1; }
 
-int disk_read(const device_t *dev, uint32_t start_sector, void *buf,
-              size_t sectors) {
-  const part_info_t *part_info = dev->data;
-  if (!part_info) {
-    log_printf("Failed to get partition information of device %d!",
-               dev->minor_no);
-    return -1;
+/*
+ * Abort the command which timed out by a software reset, called with the
+ * mutex of the channel held. The drives are reset with their interrupts
+ * masked, then the semaphore is cleared, so that a late interrupt of the
+ * aborted command can't complete the next one.
+ */
+static void disk_reset_channel(ide_channel_t *channel) {
+  outb(DEV_CTRL_REG(channel), DEV_CTRL_SRST | DEV_CTRL_NIEN);
+  for (int i = 0; i < DEV_CTRL_SRST_READS; i++)
+    inb(DEV_CTRL_REG(channel));
+
+  outb(DEV_CTRL_REG(channel), DEV_CTRL_NIEN);
+  for (int i = 0; i < DISK_PER_BUS; i++) {
+    disk_t *disk = disk_buf + (channel - channels) * DISK_PER_BUS + i;
+    if (!disk->sectors)
+      continue; // not identified
+
+    // The reset may leave multiple mode to the drive
+    outb(DRIVE_REG(disk), DRIVE_REG_BASE | disk->drive_type);
+    if (disk_poll_data(disk, DISK_IDENTIFY_POLLS) < 0)
+      log_printf("Disk %s is busy after reset!", disk->name);
+    else if (disk->multiple > 1)
+      send_multiple_mode(disk, disk->multiple);
   }
 
-  const disk_t *disk = part_info->disk;
-  if (!disk) {
-    log_printf("Disk %d does not exist!", dev->minor_no);
-    return -1;
+  outb(DEV_CTRL_REG(channel), 0);
+  const irq_state_t state = irq_protect();
+  sem_init(&channel->rw_sem, 0);
+  irq_unprotect(state);
+}
+
+/*
+ * Block until the interrupt of the command, the waiting isn't counted as CPU.
+ * On a timeout, the bus master is stopped before the channel is reset.
+ */
+static int disk_wait_irq(const disk_t *disk) {
+  if (!get_curr_task())
+    return 0; // polled by disk_wait_data before multitasking
+
+  ide_channel_t *channel = disk->channel;
+  const uint64_t start = read_tsc();
+  const int err = sem_timedwait(&channel->rw_sem, DISK_TIMEOUT_MS);
+  channel->wait_cycles += read_tsc() - start;
+  if (err < 0) {
+    // The bus master must not run into the reset
+    if (disk->bm_base)
+      outb(BM_CMD_REG(disk), inb(BM_CMD_REG(disk)) & ~BM_CMD_START);
+
+    disk_reset_channel(channel);
+  } else
+    channel->irqs++;
+
+  return err;
+}
+
+// Sectors go straight to the segments, or through buf if one is split
+static void pio_read_sectors(const disk_t *disk, blk_cursor_t *cursor,
+                             size_t sectors) {
+  uint8_t buf[SECTOR_SIZE];
+  for (size_t i = 0; i < sectors; i++) {
+    void *dest = blk_cursor_take(cursor, disk->sector_size);
+    read_disk(disk, dest ? dest : buf, disk->sector_size);
+    if (!dest)
+      blk_cursor_copy(cursor, buf, disk->sector_size, TRUE);
   }
+}
 
-  mutex_lock(disk->rw_mutex);
-  disk_on_task = TRUE;
-  disk_send_cmd(disk, part_info->start_sector + start_sector, sectors,
-                CMD_READ);
+static void pio_write_sectors(const disk_t *disk, blk_cursor_t *cursor,
+                              size_t sectors) {
+  uint8_t buf[SECTOR_SIZE];
+  for (size_t i = 0; i < sectors; i++) {
+    const void *src = blk_cursor_take(cursor, disk->sector_size);
+    if (!src)
+      blk_cursor_copy(cursor, buf, disk->sector_size, FALSE);
 
-  size_t sector_read;
-  uint8_t *dest = buf;
+    write_disk(disk, src ? src : buf, disk->sector_size);
+  }
+}
 
-  for (sector_read = 0; sector_read < sectors; sector_read++) {
-    if (get_curr_task())
-      sem_wait(disk->rw_sem);
+/*
+ * The drive interrupts once per block of disk->multiple sectors, and the last
+ * block may be shorter. Return the number of sectors transferred.
+ */
+static size_t pio_read(const disk_t *disk, uint32_t sector,
+                       blk_cursor_t *cursor, size_t sectors) {
+  disk_send_cmd(disk, sector, sectors,
+                disk->multiple > 1 ? CMD_READ_MULTIPLE : CMD_READ);
+
+  size_t sector_read = 0;
+  while (sector_read < sectors) {
+    if (disk_wait_irq(disk) < 0) {
+      log_printf("Timed out while reading disk %s!", disk->name);
+      break;
+    }
 
     const int err = disk_wait_data(disk);
     if (err < 0) {
       log_printf("An error occured while reading disk %s!", disk->name);
-      log_printf("Starting sector: %d, Number of sectors: %d", start_sector,
+      log_printf("Starting sector: %d, Number of sectors: %d", sector,
                  sectors);
       break;
     }
 
-    read_disk(disk, dest, disk->sector_size);
-    dest += disk->sector_size;
+    const size_t cnt = min(sectors - sector_read, (size_t)disk->multiple);
+    pio_read_sectors(disk, cursor, cnt);
+    sector_read += cnt;
   }
 
-  mutex_unlock(disk->rw_mutex);
   return sector_read;
 }
 
-int disk_write(const device_t *dev, uint32_t start_sector, const void *buf,
-               size_t sectors) {
-  if (!sectors)
-    return -1;
+// The drive asks for the first block without an interrupt
+static size_t pio_write(const disk_t *disk, uint32_t sector,
+                        blk_cursor_t *cursor, size_t sectors) {
+  disk_send_cmd(disk, sector, sectors,
+                disk->multiple > 1 ? CMD_WRITE_MULTIPLE : CMD_WRITE);
+
+  size_t sector_written = 0;
+  if (disk_wait_data(disk) < 0) {
+    log_printf("Disk %s refused to write!", disk->name);
+    return 0;
+  }
 
+  do {
+    const size_t cnt = min(sectors - sector_written, (size_t)disk->multiple);
+    pio_write_sectors(disk, cursor, cnt);
+
+    if (disk_wait_irq(disk) < 0) {
+      log_printf("Timed out while writing disk %s!", disk->name);
+      break;
+    }
+
+    const int err = disk_wait_data(disk);
+    if (err < 0) {
+      log_printf("An error occured while writing disk %s!", disk->name);
+      log_printf("Starting sector: %d, Number of sectors: %d", sector,
+                 sectors);
+      break;
+    }
+
+    sector_written += cnt;
+  } while (sector_written < sectors);
+
+  return sector_written;
+}
+
+/*
+ * Describe the segments by prd_table, merging the ones which are physically
+ * contiguous until a 64 KiB boundary. Return -1 if the table is full.
+ */
+static int dma_build_prd(prd_t *prd_table, const blk_seg_t *segs,
+                         int seg_cnt) {
+  prd_t *prd = NULL;
+  uint32_t prd_size = 0;
+
+  for (int i = 0; i < seg_cnt; i++) {
+    uint32_t paddr = segs[i].paddr, size = segs[i].len;
+    while (size) {
+      const uint32_t len =
+          min(size, (uint32_t)(PRD_MAX_SIZE - (paddr & (PRD_MAX_SIZE - 1))));
+      if (prd && prd->addr + prd_size == paddr &&
+          prd->addr / PRD_MAX_SIZE == (paddr + len - 1) / PRD_MAX_SIZE)
+        prd_size += len;
+      else {
+        prd = prd ? prd + 1 : prd_table;
+        if (prd == prd_table + PRD_NUM)
+          return -1;
+
+        prd->addr = paddr;
+        prd->flags = 0;
+        prd_size = len;
+      }
+
+      prd->byte_cnt = (uint16_t)prd_size; // 64 KiB is truncated to 0
+      paddr += len;
+      size -= len;
+    }
+  }
+
+  prd->flags = PRD_EOT;
+  return 0;
+}
+
+/*
+ * The controller moves the data by itself, and interrupts once per command.
+ * A dispatch of the queue fits in one command. Return the number of sectors
+ * transferred.
+ */
+static size_t dma_transfer(const disk_t *disk, uint32_t sector,
+                           const blk_seg_t *segs, int seg_cnt, size_t sectors,
+                           _Bool write) {
+  const uint8_t dir = write ? 0 : BM_CMD_READ;
+  prd_t *prd_table = disk->channel->prd_table;
+  if (dma_build_prd(prd_table, segs, seg_cnt) < 0)
+    return 0;
+
+  outb(BM_CMD_REG(disk), dir);
+  outb(BM_STATUS_REG(disk),
+       inb(BM_STATUS_REG(disk)) | BM_STATUS_ERR | BM_STATUS_IRQ);
+  outl(BM_PRDT_REG(disk), (uint32_t)prd_table);
+
+  disk_send_cmd(disk, sector, sectors, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb(BM_CMD_REG(disk), dir | BM_CMD_START);
+
+  const int err = disk_wait_irq(disk);
+  outb(BM_CMD_REG(disk), dir);
+
+  const uint8_t bm_status = inb(BM_STATUS_REG(disk));
+  const uint8_t status = inb(STATUS_REG(disk)); // acknowledge the drive
+  outb(BM_STATUS_REG(disk), bm_status | BM_STATUS_ERR | BM_STATUS_IRQ);
+
+  if (err < 0 || (bm_status & BM_STATUS_ERR) ||
+      (status & (STATUS_ERR | STATUS_DF))) {
+    log_printf("DMA failed on disk %s: status = %x, bus master = %x",
+               disk->name, status, bm_status);
+    log_printf("Starting sector: %d, Number of sectors: %d", sector, sectors);
+    return 0;
+  }
+
+  return sectors;
+}
+
+// DMA needs the interrupt to complete, and segments aligned to 2 bytes
+static _Bool dma_usable(const disk_t *disk, const blk_seg_t *segs,
+                        int seg_cnt) {
+  if (!dma_on || !disk->bm_base || !get_curr_task())
+    return FALSE;
+
+  for (int i = 0; i < seg_cnt; i++) {
+    if ((segs[i].paddr | segs[i].len) & 1)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+// The counters are shared by the workers of both channels
+static void disk_account(const ide_channel_t *channel, int mode,
+                         size_t sectors, uint64_t start) {
+  disk_cycles_t *cycles = disk_cycles + mode;
+  const uint64_t busy = read_tsc() - start;
+
+  const irq_state_t state = irq_protect();
+  cycles->requests++;
+  cycles->sectors += sectors;
+  cycles->irqs += channel->irqs;
+  cycles->busy += busy;
+  cycles->cpu += busy - channel->wait_cycles;
+  irq_unprotect(state);
+}
+
+// Called by the worker of the queue, or by the caller before multitasking
+static size_t disk_transfer(void *dev, uint32_t sector, const blk_seg_t *segs,
+                            int seg_cnt, size_t sectors, _Bool write) {
+  const disk_t *disk = dev;
+  ide_channel_t *channel = disk->channel;
+
+  mutex_lock(&channel->rw_mutex);
+  channel->on_task = TRUE;
+  channel->wait_cycles = 0;
+  channel->irqs = 0;
+
+  uint64_t start = read_tsc();
+  size_t done = 0;
+  if (dma_usable(disk, segs, seg_cnt)) {
+    done = dma_transfer(disk, sector, segs, seg_cnt, sectors, write);
+    disk_account(channel, DISK_DMA, done, start);
+    if (done < sectors) { // the fallback below is accounted as PIO
+      channel->wait_cycles = 0;
+      channel->irqs = 0;
+      start = read_tsc();
+    }
+  }
+
+  if (done < sectors) { // fall back to PIO
+    blk_cursor_t cursor;
+    blk_cursor_init(&cursor, segs, done * disk->sector_size);
+    const size_t pio_done =
+        write ? pio_write(disk, sector + done, &cursor, sectors - done)
+              : pio_read(disk, sector + done, &cursor, sectors - done);
+    disk_account(channel, DISK_PIO, pio_done, start);
+    done += pio_done;
+  }
+
+  mutex_unlock(&channel->rw_mutex);
+  return done;
+}
+
+static const disk_t *disk_of(const device_t *dev) {
   const part_info_t *part_info = dev->data;
   if (!part_info) {
     log_printf("Failed to get partition information of device %d!",
                dev->minor_no);
-    return -1;
+    return NULL;
   }
 
-  const disk_t *disk = part_info->disk;
-  if (!disk) {
+  if (!part_info->disk)
     log_printf("Disk %d does not exist!", dev->minor_no);
+
+  return part_info->disk;
+}
+
+int disk_read(const device_t *dev, uint32_t start_sector, void *buf,
+              size_t sectors) {
+  const disk_t *disk = disk_of(dev);
+  if (!disk)
     return -1;
-  }
 
-  mutex_lock(disk->rw_mutex);
-  disk_on_task = TRUE;
-  disk_send_cmd(disk, part_info->start_sector + start_sector, sectors,
-                CMD_WRITE);
+  const part_info_t *part_info = dev->data;
+  const size_t sector_read =
+      blk_rw(&disk->channel->queue, (void *)disk,
+             part_info->start_sector + start_sector, buf, sectors, FALSE);
 
-  size_t sector_written = 0;
-  const uint8_t *dest = buf;
-  do {
-    write_disk(disk, dest, disk->sector_size);
+  poll_notify();
+  return sector_read;
+}
 
-    if (get_curr_task())
-      sem_wait(disk->rw_sem);
+int disk_write(const device_t *dev, uint32_t start_sector, const void *buf,
+               size_t sectors) {
+  if (!sectors)
+    return -1;
 
-    const int err = disk_wait_data(disk);
-    if (err < 0) {
-      log_printf("An error occured while writing disk %s!", disk->name);
-      log_printf("Starting sector: %d, Number of sectors: %d", start_sector,
-                 sectors);
-      break;
-    }
+  const disk_t *disk = disk_of(dev);
+  if (!disk)
+    return -1;
 
-    dest += disk->sector_size;
-  } while (++sector_written < sectors);
+  const part_info_t *part_info = dev->data;
+  const size_t sector_written =
+      blk_rw(&disk->channel->queue, (void *)disk,
+             part_info->start_sector + start_sector, (void *)buf, sectors,
+             TRUE);
 
-  mutex_unlock(disk->rw_mutex);
+  poll_notify();
   return sector_written;
 }
 
 int disk_control(const device_t *dev, int cmd, va_list arg_list) { return -1; }
 
+// The disk would block while the queue of the channel holds requests
+int disk_poll(const device_t *dev) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info || !part_info->disk)
+    return POLLNVAL;
+
+  const disk_t *disk = part_info->disk;
+  return blk_queue_busy(&disk->channel->queue) ? 0 : POLLIN | POLLOUT;
+}
+
+static void disk_handle_irq(ide_channel_t *channel) {
+  pic_send_eoi(channel->irq);
+  if (channel->on_task && get_curr_task())
+    sem_notify(&channel->rw_sem);
+}
+
 void do_handle_ide_primary(exception_frame_t *frame) {
-  pic_send_eoi(IRQ14_IDE_PRIMARY);
-  if (disk_on_task && get_curr_task())
-    sem_notify(&rw_sem);
+  disk_handle_irq(channels);
+}
+
+void do_handle_ide_secondary(exception_frame_t *frame) {
+  disk_handle_irq(channels + 1);
+}
+
+int disk_stat_open(device_t *dev) { return 0; }
+
+int disk_stat_close(const device_t *dev) { return 0; }
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+  const uint32_t khz = vdso_tsc_khz();
+  return khz ? (uint32_t)kernel_div_u64(cycles * 1000, khz) : 0;
+}
+
+// /dev/diskstat0 holds a disk_stat_t
+int disk_stat_read(const device_t *dev, uint32_t addr, void *buf,
+                   size_t size) {
+  if (addr >= sizeof(disk_stat_t))
+    return 0;
+
+  disk_stat_t stat = {.dma_avail = channels->bm_base != 0, .dma_on = dma_on};
+  const irq_state_t state = irq_protect();
+  for (int i = 0; i < DISK_MODE_NUM; i++) {
+    stat.mode[i].requests = disk_cycles[i].requests;
+    stat.mode[i].sectors = disk_cycles[i].sectors;
+    stat.mode[i].irqs = disk_cycles[i].irqs;
+    stat.mode[i].busy_us = cycles_to_us(disk_cycles[i].busy);
+    stat.mode[i].cpu_us = cycles_to_us(disk_cycles[i].cpu);
+  }
+  irq_unprotect(state);
+
+  size = min(size, (size_t)(sizeof(disk_stat_t) - addr));
+  kernel_memcpy(buf, (const uint8_t *)&stat + addr, size);
+  return size;
+}
+
+int disk_stat_write(const device_t *dev, uint32_t addr, const void *buf,
+                    size_t size) {
+  return -1;
+}
+
+int disk_stat_control(const device_t *dev, int cmd, va_list arg_list) {
+  if (cmd == DISK_CMD_DROP_CACHE) { // the write back goes through the channels
+    if (bcache_sync(-1) < 0)
+      return -1;
+
+    bcache_invalidate(-1);
+    return 0;
+  }
+
+  for (int i = 0; i < IDE_CHANNEL_NUM; i++) // not in the middle of a request
+    mutex_lock(&channels[i].rw_mutex);
+
+  int err = 0;
+  switch (cmd) {
+  case DISK_CMD_DMA:
+    dma_on = va_arg(arg_list, void *) != NULL;
+    break;
+  case DISK_CMD_RESET:
+    kernel_memset(disk_cycles, 0, sizeof(disk_cycles));
+    break;
+  default:
+    err = -1;
+  }
+
+  for (int i = IDE_CHANNEL_NUM - 1; i >= 0; i--)
+    mutex_unlock(&channels[i].rw_mutex);
+
+  return err;
 }
@@ -0,0 +1,194 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/pci.h"
+#include "comm/cpu_instr.h"
+#include "cpu/irq.h"
+#include "tools/log.h"
+
+// Configuration mechanism #1, offset should be aligned to 4 bytes
+static uint32_t pci_config_read(int bus, int slot, int func, uint8_t offset) {
+  const irq_state_t state = irq_protect(); // the address and data port pair
+  outl(PCI_CONFIG_ADDR_PORT, (1U << 31) | (bus << 16) | (slot << 11) |
+                                 (func << 8) | (offset & 0xFC));
+  const uint32_t value = inl(PCI_CONFIG_DATA_PORT);
+  irq_unprotect(state);
+  return value;
+}
+
+uint32_t pci_read(const pci_dev_t *dev, uint8_t offset) {
+  return pci_config_read(dev->bus, dev->slot, dev->func, offset);
+}
+
+void pci_write(const pci_dev_t *dev, uint8_t offset, uint32_t value) {
+  const irq_state_t state = irq_protect();
+  outl(PCI_CONFIG_ADDR_PORT, (1U << 31) | (dev->bus << 16) |
+                                 (dev->slot << 11) | (dev->func << 8) |
+                                 (offset & 0xFC));
+  outl(PCI_CONFIG_DATA_PORT, value);
+  irq_unprotect(state);
+}
+
+uint32_t pci_bar(const pci_dev_t *dev, int index) {
+  return pci_read(dev, PCI_BAR0 + index * 4);
+}
+
+// Set bits of the command register, e.g. to let the device master the bus
+void pci_enable(const pci_dev_t *dev, uint16_t command) {
+  const uint32_t value = pci_read(dev, PCI_COMMAND);
+  pci_write(dev, PCI_COMMAND, (value & 0xFFFF) | command);
+}
+
+static void pci_fill_dev(pci_dev_t *dev, int bus, int slot, int func,
+                         uint32_t id) {
+  dev->bus = bus;
+  dev->slot = slot;
+  dev->func = func;
+  dev->vendor_id = id & 0xFFFF;
+  dev->device_id = id >> 16;
+
+  const uint32_t class = pci_read(dev, PCI_CLASS);
+  dev->class_code = class >> 24;
+  dev->subclass = (class >> 16) & 0xFF;
+  dev->prog_if = (class >> 8) & 0xFF;
+  dev->irq = pci_read(dev, PCI_INTERRUPT_LINE) & 0xFF;
+}
+
+/*
+ * Every function is enumerated once by a brute-force scan at boot,
+ * and the drivers look their devices up in pci_table afterwards.
+ */
+static pci_dev_t pci_table[PCI_DEV_NUM];
+static int pci_dev_cnt = 0;
+
+void pci_init() {
+  for (int bus = 0; bus < PCI_BUS_NUM; bus++) {
+    for (int slot = 0; slot < PCI_SLOT_NUM; slot++) {
+      for (int func = 0; func < PCI_FUNC_NUM; func++) {
+        const uint32_t id = pci_config_read(bus, slot, func, PCI_VENDOR_ID);
+        if ((id & 0xFFFF) == PCI_VENDOR_NONE) {
+          if (!func) // no device in this slot
+            break;
+
+          continue;
+        }
+
+        if (pci_dev_cnt == PCI_DEV_NUM)
+          return;
+
+        pci_dev_t *dev = pci_table + pci_dev_cnt++;
+        pci_fill_dev(dev, bus, slot, func, id);
+        log_printf("PCI %d:%d.%d: %x:%x, class %x:%x, IRQ %d", bus, slot, func,
+                   dev->vendor_id, dev->device_id, dev->class_code,
+                   dev->subclass, dev->irq);
+
+        const uint32_t header = pci_read(dev, PCI_HEADER_TYPE) >> 16;
+        if (!func && !(header & PCI_HEADER_MULTI_FUNC))
+          break;
+      }
+    }
+  }
+}
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_dev_t *dev) {
+  for (int i = 0; i < pci_dev_cnt; i++) {
+    if (pci_table[i].class_code == class_code &&
+        pci_table[i].subclass == subclass) {
+      *dev = pci_table[i];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+// Find the index-th function of the device, counting from 0
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index,
+                    pci_dev_t *dev) {
+  for (int i = 0; i < pci_dev_cnt; i++) {
+    if (pci_table[i].vendor_id == vendor_id &&
+        pci_table[i].device_id == device_id && !index--) {
+      *dev = pci_table[i];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * The firmware routes the PCI interrupts to the free lines of the PIC,
+ * which may be shared by several devices, so every handler of the line runs.
+ */
+typedef struct _pci_irq_t {
+  uint8_t irq;
+  pci_irq_handler_t handler;
+  void *data;
+} pci_irq_t;
+
+static pci_irq_t pci_irq_table[PCI_IRQ_HANDLER_NUM];
+static int pci_irq_cnt = 0;
+
+static irq_handler_t pci_irq_entry(uint8_t irq) {
+  switch (irq) {
+  case 5:
+    return (irq_handler_t)exception_handler_pci_irq5;
+  case 9:
+    return (irq_handler_t)exception_handler_pci_irq9;
+  case 10:
+    return (irq_handler_t)exception_handler_pci_irq10;
+  case 11:
+    return (irq_handler_t)exception_handler_pci_irq11;
+  default:
+    return NULL;
+  }
+}
+
+// Return -1 if the device isn't routed to a line handled here
+int pci_irq_install(const pci_dev_t *dev, pci_irq_handler_t handler,
+                    void *data) {
+  const irq_handler_t entry = pci_irq_entry(dev->irq);
+  if (!entry || pci_irq_cnt == PCI_IRQ_HANDLER_NUM) {
+    log_printf("Unsupported IRQ %d of PCI %d:%d.%d!", dev->irq, dev->bus,
+               dev->slot, dev->func);
+    return -1;
+  }
+
+  const irq_state_t state = irq_protect();
+  pci_irq_t *pci_irq = pci_irq_table + pci_irq_cnt++;
+  pci_irq->irq = dev->irq;
+  pci_irq->handler = handler;
+  pci_irq->data = data;
+
+  irq_install(IRQ_PIC_START + dev->irq, entry);
+  irq_enable(IRQ_PIC_START + dev->irq);
+  irq_unprotect(state);
+  return 0;
+}
+
+static void pci_handle_irq(const exception_frame_t *frame) {
+  const uint8_t irq = frame->num - IRQ_PIC_START;
+  pic_send_eoi(frame->num);
+
+  for (int i = 0; i < pci_irq_cnt; i++) {
+    if (pci_irq_table[i].irq == irq)
+      pci_irq_table[i].handler(pci_irq_table[i].data);
+  }
+}
+
+void do_handle_pci_irq5(const exception_frame_t *frame) {
+  pci_handle_irq(frame);
+}
+
+void do_handle_pci_irq9(const exception_frame_t *frame) {
+  pci_handle_irq(frame);
+}
+
+void do_handle_pci_irq10(const exception_frame_t *frame) {
+  pci_handle_irq(frame);
+}
+
+void do_handle_pci_irq11(const exception_frame_t *frame) {
+  pci_handle_irq(frame);
+}
@@ -0,0 +1,125 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/prof.h"
+#include "core/memory.h"
+#include "dev/timer.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+const dev_desc_t prof_desc = {.name = "prof",
+                              .major_no = DEV_PROF,
+                              .open = prof_open,
+                              .close = prof_close,
+                              .read = prof_read,
+                              .write = prof_write,
+                              .control = prof_control};
+
+/*
+ * Samples are taken by the timer interrupt into a buffer allocated on the
+ * first start, which is kept until the next start so that it can be read
+ * after stopping.
+ */
+static prof_header_t prof_header;
+static prof_sample_t *prof_buf = NULL;
+static volatile _Bool prof_running = FALSE;
+
+#define PROF_BUF_SAMPLES (PROF_BUF_PAGES * MEM_PAGE_SIZE / sizeof(prof_sample_t))
+
+// Called by the timer interrupt
+void prof_sample(const exception_frame_t *frame) {
+  if (!prof_running)
+    return;
+
+  if (prof_header.cnt == PROF_BUF_SAMPLES) {
+    prof_header.lost++;
+    return;
+  }
+
+  prof_sample_t *sample = prof_buf + prof_header.cnt++;
+  sample->eip = frame->eip;
+  sample->cs = frame->cs;
+  sample->pid = get_curr_task()->pid;
+}
+
+static int prof_start(uint32_t hz) {
+  const uint32_t tick_hz = 1000 / OS_TICKS_MS;
+  if (hz < tick_hz || hz > PROF_HZ_MAX || hz % tick_hz) {
+    log_printf("Invalid sampling rate: %d Hz", hz);
+    return -1;
+  }
+
+  if (!prof_buf && !(prof_buf = (prof_sample_t *)memory_alloc_pages(
+                         PROF_BUF_PAGES))) {
+    log_printf("Allocate profiling buffer failed!");
+    return -1;
+  }
+
+  const irq_state_t state = irq_protect();
+
+  prof_header.magic = PROF_MAGIC;
+  prof_header.hz = hz;
+  prof_header.cnt = prof_header.lost = 0;
+  prof_running = TRUE;
+  timer_set_rate(hz);
+
+  irq_unprotect(state);
+  return 0;
+}
+
+static void prof_stop() {
+  const irq_state_t state = irq_protect();
+  prof_running = FALSE;
+  timer_set_rate(1000 / OS_TICKS_MS);
+  irq_unprotect(state);
+}
+
+int prof_open(device_t *dev) { return 0; }
+
+int prof_close(const device_t *dev) { return 0; }
+
+// Read the header and the samples as a whole starting from addr
+int prof_read(const device_t *dev, uint32_t addr, void *buf, size_t size) {
+  if (prof_running || !prof_buf)
+    return -1;
+
+  const uint32_t total =
+      sizeof(prof_header_t) + prof_header.cnt * sizeof(prof_sample_t);
+  if (addr >= total)
+    return 0;
+
+  size = min(size, (size_t)(total - addr));
+  uint8_t *dest = buf;
+  size_t remain = size;
+
+  if (addr < sizeof(prof_header_t)) {
+    const size_t len = min(remain, (size_t)(sizeof(prof_header_t) - addr));
+    kernel_memcpy(dest, (const uint8_t *)&prof_header + addr, len);
+    dest += len;
+    addr += len;
+    remain -= len;
+  }
+
+  kernel_memcpy(dest, (const uint8_t *)prof_buf + addr - sizeof(prof_header_t),
+                remain);
+  return size;
+}
+
+int prof_write(const device_t *dev, uint32_t addr, const void *buf,
+               size_t size) {
+  return -1;
+}
+
+int prof_control(const device_t *dev, int cmd, va_list arg_list) {
+  switch (cmd) {
+  case PROF_CMD_START:
+    return prof_start((uint32_t)va_arg(arg_list, void *));
+  case PROF_CMD_STOP:
+    prof_stop();
+    return 0;
+  default:
+    return -1;
+  }
+}
@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/ramdisk.h"
+#include "core/memory.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+const dev_desc_t ramdisk_desc = {.name = "ram",
+                                 .major_no = DEV_RAMDISK,
+                                 .open = ramdisk_open,
+                                 .close = ramdisk_close,
+                                 .read = ramdisk_read,
+                                 .write = ramdisk_write,
+                                 .control = ramdisk_control};
+
+/*
+ * The pages needn't be contiguous, and are accessed by their identity
+ * mapping. Resizing keeps the data below the new size.
+ */
+static uint32_t ram_pages[RAMDISK_MAX_PAGES];
+static uint32_t ram_page_cnt;
+static mutex_t ram_mutex;
+
+#define RAMDISK_PAGE_SECTORS (MEM_PAGE_SIZE / SECTOR_SIZE)
+
+static int ramdisk_resize(uint32_t size) {
+  const uint32_t pages = up2(size, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+  if (pages > RAMDISK_MAX_PAGES) {
+    log_printf("RAM disk is limited to %d pages!", RAMDISK_MAX_PAGES);
+    return -1;
+  }
+
+  while (ram_page_cnt > pages)
+    memory_free_page(ram_pages[--ram_page_cnt]);
+
+  const uint32_t old_cnt = ram_page_cnt;
+  while (ram_page_cnt < pages) {
+    const uint32_t page = memory_alloc_page();
+    if (!page) { // keep the old size
+      log_printf("No memory for %d pages of the RAM disk", pages);
+      while (ram_page_cnt > old_cnt)
+        memory_free_page(ram_pages[--ram_page_cnt]);
+
+      return -1;
+    }
+
+    kernel_memset((void *)page, 0, MEM_PAGE_SIZE);
+    ram_pages[ram_page_cnt++] = page;
+  }
+
+  return 0;
+}
+
+void ramdisk_init() {
+  mutex_init(&ram_mutex);
+  if (RAMDISK_SIZE && !ramdisk_resize(RAMDISK_SIZE))
+    log_printf("RAM disk: /dev/ram0, %d KiB", RAMDISK_SIZE / 1024);
+}
+
+int ramdisk_open(device_t *dev) {
+  if (dev->minor_no) {
+    log_printf("Invalid minor number!");
+    return -1;
+  }
+
+  return 0;
+}
+
+int ramdisk_close(const device_t *dev) { return 0; }
+
+// Copy between buf and the sectors, return the number of sectors copied
+static int ramdisk_copy(uint32_t start_sector, void *buf, size_t sectors,
+                        _Bool write) {
+  mutex_lock(&ram_mutex);
+  const uint32_t total = ram_page_cnt * RAMDISK_PAGE_SECTORS;
+  if (start_sector >= total) {
+    mutex_unlock(&ram_mutex);
+    return 0;
+  }
+
+  sectors = min(sectors, (size_t)(total - start_sector));
+  uint8_t *ptr = buf;
+  for (size_t done = 0; done < sectors;) {
+    const uint32_t sector = start_sector + done;
+    const uint32_t offset = sector % RAMDISK_PAGE_SECTORS * SECTOR_SIZE;
+    const size_t cnt =
+        min(sectors - done,
+            (size_t)(RAMDISK_PAGE_SECTORS - sector % RAMDISK_PAGE_SECTORS));
+    uint8_t *page = (uint8_t *)ram_pages[sector / RAMDISK_PAGE_SECTORS];
+
+    if (write)
+      kernel_memcpy(page + offset, ptr, cnt * SECTOR_SIZE);
+    else
+      kernel_memcpy(ptr, page + offset, cnt * SECTOR_SIZE);
+
+    ptr += cnt * SECTOR_SIZE;
+    done += cnt;
+  }
+
+  mutex_unlock(&ram_mutex);
+  return sectors;
+}
+
+int ramdisk_read(const device_t *dev, uint32_t start_sector, void *buf,
+                 size_t sectors) {
+  return ramdisk_copy(start_sector, buf, sectors, FALSE);
+}
+
+int ramdisk_write(const device_t *dev, uint32_t start_sector, const void *buf,
+                  size_t sectors) {
+  return ramdisk_copy(start_sector, (void *)buf, sectors, TRUE);
+}
+
+// Resizing is refused while another user (e.g. a mounted fs) holds the disk
+int ramdisk_control(const device_t *dev, int cmd, va_list arg_list) {
+  mutex_lock(&ram_mutex);
+  int ret;
+  switch (cmd) {
+  case RAMDISK_CMD_RESIZE:
+    ret = dev->open_cnt > 1
+              ? -1
+              : ramdisk_resize((uint32_t)va_arg(arg_list, void *));
+    break;
+  case RAMDISK_CMD_SECTORS:
+    ret = ram_page_cnt * RAMDISK_PAGE_SECTORS;
+    break;
+  default:
+    ret = -1;
+  }
+
+  mutex_unlock(&ram_mutex);
+  return ret;
+}
@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/rtc.h"
+#include "comm/cpu_instr.h"
+
+static uint8_t cmos_read(uint8_t reg) {
+  outb(CMOS_ADDR_PORT, reg);
+  return inb(CMOS_DATA_PORT);
+}
+
+// Days from 1970-01-01 to the date
+static uint32_t days_from_civil(int year, int month, int day) {
+  year -= month <= 2;
+  const int era = year / 400;
+  const int year_of_era = year - era * 400;
+  const int day_of_year =
+      (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const int day_of_era = year_of_era * 365 + year_of_era / 4 -
+                         year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+// Return the current time in seconds since the Epoch, assuming 20xx
+uint32_t rtc_read_time() {
+  while (cmos_read(RTC_STATUS_A) & RTC_UPDATING)
+    ;
+
+  uint8_t second = cmos_read(RTC_SECOND), minute = cmos_read(RTC_MINUTE);
+  uint8_t hour = cmos_read(RTC_HOUR), day = cmos_read(RTC_DAY);
+  uint8_t month = cmos_read(RTC_MONTH), year = cmos_read(RTC_YEAR);
+  const uint8_t status = cmos_read(RTC_STATUS_B);
+
+  const _Bool pm = hour & RTC_PM;
+  hour &= ~RTC_PM;
+  if (!(status & RTC_BINARY)) {
+    second = bcd2bin(second);
+    minute = bcd2bin(minute);
+    hour = bcd2bin(hour);
+    day = bcd2bin(day);
+    month = bcd2bin(month);
+    year = bcd2bin(year);
+  }
+
+  if (!(status & RTC_24HOUR) && pm)
+    hour = (hour % 12) + 12;
+  else if (!(status & RTC_24HOUR) && hour == 12)
+    hour = 0;
+
+  const uint32_t days = days_from_civil(2000 + year, month, day);
+  return ((days * 24 + hour) * 60 + minute) * 60 + second;
+}
@@ -4,22 +4,52 @@
 
 #include "dev/timer.h"
 #include "comm/cpu_instr.h"
+#include "core/vdso.h"
 #include "cpu/irq.h"
+#include "dev/prof.h"
 #include "os_cfg.h"
 
 static uint32_t sys_tick;
 
+/*
+ * The PIT runs faster than the tick while profiling,
+ * and only every tick_div-th interrupt counts as a tick.
+ */
+static uint32_t tick_div = 1, tick_sub = 0;
+
 void do_handle_time(const exception_frame_t *frame) {
+  prof_sample(frame);
+
+  if (++tick_sub < tick_div) {
+    pic_send_eoi(IRQ0_TIMER);
+    return;
+  }
+
+  tick_sub = 0;
   sys_tick++;
+  vdso_tick(sys_tick);
   pic_send_eoi(IRQ0_TIMER);
   task_time_tick();
 }
 
-static void init_pit() {
-  const uint32_t reload_cnt = PIT_OSC_FREQ * OS_TICKS_MS / 1000;
+uint32_t timer_get_tick() { return sys_tick; }
+
+static void pit_set_hz(uint32_t hz) {
+  const uint32_t reload_cnt = PIT_OSC_FREQ / hz;
   outb(PIT_COMMAND_MODE_PORT, PIT_CHANNEL0 | PIT_LOAD_LOHI | PIT_MODE3);
   outb(PIT_CHANNEL0_DATA_PORT, reload_cnt & 0xFF);        // load lower 8 bit
   outb(PIT_CHANNEL0_DATA_PORT, (reload_cnt >> 8) & 0xFF); // load higher 8 bit
+}
+
+// hz should be a multiple of the tick rate, and interrupts should be disabled
+void timer_set_rate(uint32_t hz) {
+  tick_div = hz * OS_TICKS_MS / 1000;
+  tick_sub = 0;
+  pit_set_hz(hz);
+}
+
+static void init_pit() {
+  pit_set_hz(1000 / OS_TICKS_MS);
 
   irq_install(IRQ0_TIMER, (irq_handler_t)exception_handler_time);
   irq_enable(IRQ0_TIMER);
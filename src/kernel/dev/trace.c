@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/trace.h"
+#include "core/task.h"
+#include "cpu/irq.h"
+#include "tools/klib.h"
+
+const dev_desc_t trace_desc = {.name = "trace",
+                               .major_no = DEV_TRACE,
+                               .open = trace_open,
+                               .close = trace_close,
+                               .read = trace_read,
+                               .write = trace_write,
+                               .control = trace_control};
+
+const dev_desc_t syslat_desc = {.name = "syslat",
+                                .major_no = DEV_SYSLAT,
+                                .open = trace_open,
+                                .close = trace_close,
+                                .read = syslat_read,
+                                .write = trace_write,
+                                .control = trace_control};
+
+/*
+ * Events of every traced task share one ring tagged by pid, so that they
+ * outlive the task and can be read by its parent after wait().
+ * When the ring is full, the oldest events are overwritten.
+ * Reading /dev/traceN consumes the events of the task whose pid is N.
+ */
+static trace_event_t trace_ring[TRACE_RING_SIZE];
+static uint32_t trace_tail = 0; // number of events ever recorded
+
+// Latency histograms of all syscalls, whether the task is traced or not
+static trace_hist_t trace_hist[TRACE_SYSCALL_NUM];
+
+static int hist_bucket(uint32_t cycles) {
+  return cycles ? 31 - __builtin_clz(cycles) : 0;
+}
+
+void trace_syscall(const syscall_frame_t *frame, int ret, uint64_t cycles) {
+  const int num = frame->auto_push.func_id;
+  const uint32_t cycles32 = cycles >> 32 ? 0xFFFFFFFF : (uint32_t)cycles;
+  const task_t *curr = get_curr_task();
+
+  const irq_state_t state = irq_protect();
+
+  if (num < TRACE_SYSCALL_NUM) {
+    trace_hist_t *hist = trace_hist + num;
+    hist->cnt++;
+    hist->max_cycles = max(hist->max_cycles, cycles32);
+    hist->buckets[hist_bucket(cycles32)]++;
+  }
+
+  if (curr->trace) {
+    trace_event_t *event = trace_ring + (trace_tail++ & (TRACE_RING_SIZE - 1));
+    event->pid = curr->pid;
+    event->num = num;
+    event->args[0] = (uint32_t)frame->auto_push.arg0;
+    event->args[1] = (uint32_t)frame->auto_push.arg1;
+    event->args[2] = (uint32_t)frame->auto_push.arg2;
+    event->args[3] = (uint32_t)frame->auto_push.arg3;
+    event->ret = ret;
+    event->cycles = cycles32;
+  }
+
+  irq_unprotect(state);
+}
+
+int trace_open(device_t *dev) { return 0; }
+
+int trace_close(const device_t *dev) { return 0; }
+
+// Copy the pending events of task dev->minor_no in the order of recording
+int trace_read(const device_t *dev, uint32_t addr, void *buf, size_t size) {
+  trace_event_t *dest = buf;
+  const size_t cnt = size / sizeof(trace_event_t);
+  size_t copied = 0;
+
+  const irq_state_t state = irq_protect();
+
+  const uint32_t head =
+      trace_tail > TRACE_RING_SIZE ? trace_tail - TRACE_RING_SIZE : 0;
+  for (uint32_t i = head; i != trace_tail && copied < cnt; i++) {
+    trace_event_t *event = trace_ring + (i & (TRACE_RING_SIZE - 1));
+    if (event->pid == dev->minor_no) {
+      dest[copied++] = *event;
+      event->pid = -1; // consumed
+    }
+  }
+
+  irq_unprotect(state);
+  return copied * sizeof(trace_event_t);
+}
+
+int trace_write(const device_t *dev, uint32_t addr, const void *buf,
+                size_t size) {
+  return -1;
+}
+
+int trace_control(const device_t *dev, int cmd, va_list arg_list) {
+  task_t *curr = get_curr_task();
+
+  switch (cmd) {
+  case TRACE_CMD_ENABLE:
+    curr->trace = TRUE;
+    break;
+  case TRACE_CMD_DISABLE:
+    curr->trace = FALSE;
+    break;
+  case TRACE_CMD_RESET: {
+    const irq_state_t state = irq_protect();
+    kernel_memset(trace_hist, 0, sizeof(trace_hist));
+    irq_unprotect(state);
+    break;
+  }
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+// /dev/syslat0 holds trace_hist_t of syscalls 0 ~ TRACE_SYSCALL_NUM - 1
+int syslat_read(const device_t *dev, uint32_t addr, void *buf, size_t size) {
+  if (addr >= sizeof(trace_hist))
+    return 0;
+
+  size = min(size, (size_t)(sizeof(trace_hist) - addr));
+
+  const irq_state_t state = irq_protect();
+  kernel_memcpy(buf, (const uint8_t *)trace_hist + addr, size);
+  irq_unprotect(state);
+
+  return size;
+}
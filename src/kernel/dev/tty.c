@@ -6,6 +6,7 @@
 #include "cpu/irq.h"
 #include "dev/console.h"
 #include "dev/keyboard.h"
+#include "fs/poll.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 
@@ -15,7 +16,8 @@ const dev_desc_t tty_desc = {.name = "tty",
                              .close = tty_close,
                              .read = tty_read,
                              .write = tty_write,
-                             .control = tty_control};
+                             .control = tty_control,
+                             .poll = tty_poll};
 
 static tty_t tty_dev_table[TTY_NUM];
 static int curr_tty_id = 0;
@@ -82,6 +84,7 @@ int tty_open(device_t *dev) {
   tty->console_id = tty_id;
   tty->output_crlf_esc = tty->input_crlf_esc = TRUE; // enable CRLF escape
   tty->input_echo = TRUE;
+  tty->input_lines = 0;
   sem_init(&tty->output_sem, TTY_OUTPUT_BUF_SIZE);
   sem_init(&tty->input_sem, 0);
 
@@ -104,6 +107,12 @@ int tty_read(const device_t *dev, uint32_t addr, void *buf, size_t size) {
     sem_wait(&tty->input_sem);
     char ch;
     tty_dequeue(&tty->input_queue, &ch);
+    if (ch == '\n') {
+      const irq_state_t state = irq_protect();
+      tty->input_lines--;
+      irq_unprotect(state);
+    }
+
     switch (ch) {
     case '\b':
     case ASCII_DEL:
@@ -198,10 +207,34 @@ int tty_in(char data) {
     return -1; // buffer is full
 
   tty_enqueue(&tty->input_queue, data);
+  if (data == '\n')
+    tty->input_lines++;
+
   sem_notify(&tty->input_sem);
+  poll_notify();
   return 0;
 }
 
+/*
+ * Input is ready once a whole line (or a full buffer) is queued,
+ * as tty_read only returns at the end of a line.
+ */
+int tty_poll(const device_t *dev) {
+  const int tty_id = get_tty_id(dev);
+  if (tty_id < 0)
+    return POLLNVAL;
+
+  const tty_t *tty = tty_dev_table + tty_id;
+  int events = 0;
+  if (tty->input_lines || tty->input_queue.count >= TTY_INPUT_BUF_SIZE)
+    events |= POLLIN;
+
+  if (sem_cnt(&tty->output_sem) > 0)
+    events |= POLLOUT;
+
+  return events;
+}
+
 void tty_switch_to(int tty_id) {
   if (tty_id != curr_tty_id) {
     console_switch_to(tty_id);
@@ -0,0 +1,584 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dev/virtio_blk.h"
+#include "comm/boot_info.h"
+#include "comm/cpu_instr.h"
+#include "dev/pci.h"
+#include "fs/poll.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static virtio_disk_t virtio_disks[VIRTIO_DISK_NUM];
+static int virtio_disk_cnt = 0;
+static _Bool virtio_irq_on[VIRTIO_DISK_NUM]; // polled if the IRQ is unusable
+
+const dev_desc_t virtio_blk_desc = {.name = "virtio",
+                                    .major_no = DEV_VIRTIO,
+                                    .open = virtio_blk_open,
+                                    .close = virtio_blk_close,
+                                    .read = virtio_blk_read,
+                                    .write = virtio_blk_write,
+                                    .control = virtio_blk_control,
+                                    .poll = virtio_blk_poll};
+
+static uint32_t slot_mask(int slots) {
+  return slots >= VIRTIO_SLOT_NUM ? 0xFFFFFFFF : (1U << slots) - 1;
+}
+
+// The first descriptor of the slot in the ring
+static uint16_t slot_head(const virtio_disk_t *disk, int slot) {
+  return disk->indirect ? slot : slot * VIRTIO_DESC_NUM;
+}
+
+/*
+ * Only the first slot of a transfer may block, a transfer which already holds
+ * slots never waits for another one, so that transfers can't deadlock.
+ */
+static int virtio_alloc_slot(virtio_disk_t *disk, _Bool block) {
+  const irq_state_t state = irq_protect();
+
+  int slot = -1;
+  for (;;) {
+    const uint32_t free = disk->slot_mask & ~disk->busy;
+    if (free) {
+      for (slot = 0; !(free & (1U << slot)); slot++)
+        ;
+
+      disk->busy |= 1U << slot;
+      break;
+    }
+
+    if (!block || !get_curr_task())
+      break;
+
+    list_insert_last(&disk->slot_wait.wait_list, &get_curr_task()->wait_node);
+    wait_block(&disk->slot_wait.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+  return slot;
+}
+
+static void virtio_free_slot(virtio_disk_t *disk, int slot) {
+  const irq_state_t state = irq_protect();
+  disk->busy &= ~(1U << slot);
+  irq_unprotect(state);
+
+  wait_queue_wake(&disk->slot_wait, 1);
+}
+
+/*
+ * Describe the buffer by data descriptors after desc, merging the pages
+ * which are physically contiguous. Return the number of descriptors,
+ * or -1 if a page isn't mapped or seg_max is exceeded.
+ */
+static int virtio_build_segs(const virtio_disk_t *disk, virtq_desc_t *desc,
+                             const void *buf, uint32_t size, uint16_t flags) {
+  virtq_desc_t *seg = NULL;
+  uint32_t vaddr = (uint32_t)buf;
+
+  while (size) {
+    const uint32_t paddr = memory_dma_paddr(vaddr);
+    if (!paddr)
+      return -1;
+
+    const uint32_t len =
+        min(size, (uint32_t)(MEM_PAGE_SIZE - (vaddr & (MEM_PAGE_SIZE - 1))));
+    if (seg && seg->addr + seg->len == paddr)
+      seg->len += len;
+    else {
+      seg = seg ? seg + 1 : desc;
+      if (seg == desc + disk->seg_max)
+        return -1;
+
+      seg->addr = paddr;
+      seg->addr_hi = 0;
+      seg->len = len;
+      seg->flags = flags;
+    }
+
+    vaddr += len;
+    size -= len;
+  }
+
+  return seg - desc + 1;
+}
+
+/*
+ * A request is a chain of the header, the data and the status byte.
+ * With indirect descriptors, the chain lives in the request of the slot,
+ * and takes a single descriptor of the ring.
+ */
+static int virtio_build_req(virtio_disk_t *disk, int slot, uint32_t sector,
+                            void *buf, uint32_t sectors, _Bool write) {
+  virtio_req_t *req = disk->req + slot;
+  const uint16_t head = slot_head(disk, slot);
+  virtq_desc_t *desc = disk->indirect ? req->desc : disk->desc + head;
+  const uint16_t first = disk->indirect ? 0 : head; // index of desc[0]
+
+  req->hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->hdr.reserved = 0;
+  req->hdr.sector = sector;
+  req->hdr.sector_hi = 0;
+  req->status = 0xFF;
+
+  const int segs =
+      virtio_build_segs(disk, desc + 1, buf, sectors * disk->sector_size,
+                        VIRTQ_DESC_F_NEXT | (write ? 0 : VIRTQ_DESC_F_WRITE));
+  if (segs < 0)
+    return -1;
+
+  desc[0].addr = (uint32_t)&req->hdr;
+  desc[0].len = sizeof(virtio_blk_hdr_t);
+  desc[0].flags = VIRTQ_DESC_F_NEXT;
+
+  virtq_desc_t *status = desc + segs + 1;
+  status->addr = (uint32_t)&req->status;
+  status->len = 1;
+  status->flags = VIRTQ_DESC_F_WRITE;
+
+  for (int i = 0; i <= segs + 1; i++) {
+    desc[i].addr_hi = 0;
+    desc[i].next = first + i + 1;
+  }
+
+  if (disk->indirect) {
+    virtq_desc_t *ring_desc = disk->desc + head;
+    ring_desc->addr = (uint32_t)req->desc;
+    ring_desc->addr_hi = 0;
+    ring_desc->len = (segs + 2) * sizeof(virtq_desc_t);
+    ring_desc->flags = VIRTQ_DESC_F_INDIRECT;
+  }
+
+  return 0;
+}
+
+/*
+ * Publish a batch of requests with a single update of the available index,
+ * and notify the device once, unless it is already processing the queue.
+ */
+static void virtio_submit(virtio_disk_t *disk, const int *slots, int cnt) {
+  const irq_state_t state = irq_protect();
+
+  uint16_t idx = disk->avail->idx;
+  for (int i = 0; i < cnt; i++) {
+    disk->avail->ring[idx++ % disk->queue_size] = slot_head(disk, slots[i]);
+    disk->issued |= 1U << slots[i];
+  }
+
+  memory_barrier(); // the ring entries before the index
+  disk->avail->idx = idx;
+  memory_barrier(); // the index before the flags of the device
+
+  if (!(disk->used->flags & VIRTQ_USED_F_NO_NOTIFY))
+    outw(VIRTIO_QUEUE_NOTIFY(disk), 0);
+
+  irq_unprotect(state);
+}
+
+// Collect the slots used by the device, with interrupts disabled
+static uint32_t virtio_reap(virtio_disk_t *disk) {
+  uint32_t done = 0;
+  while (disk->last_used != disk->used->idx) {
+    const virtq_used_elem_t *elem =
+        disk->used->ring + disk->last_used++ % disk->queue_size;
+    done |= 1U << (disk->indirect ? elem->id : elem->id / VIRTIO_DESC_NUM);
+  }
+
+  return done;
+}
+
+// Called with interrupts disabled
+static void virtio_complete(virtio_disk_t *disk, uint32_t done) {
+  for (int slot = 0; done; slot++, done >>= 1) {
+    if (!(done & 1))
+      continue;
+
+    disk->issued &= ~(1U << slot);
+    sem_notify(disk->done + slot);
+  }
+}
+
+static void virtq_start(virtio_disk_t *disk);
+
+/*
+ * Take the queue back from a device which doesn't complete a request:
+ * after the reset, the device no longer accesses the ring nor the buffers.
+ * Called with interrupts disabled.
+ */
+static void virtio_reset(virtio_disk_t *disk) {
+  outb(VIRTIO_DEVICE_STATUS(disk), 0);
+  outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_ACK);
+  outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+  outl(VIRTIO_GUEST_FEATURES(disk),
+       inl(VIRTIO_DEVICE_FEATURES(disk)) & VIRTIO_FEATURES);
+
+  virtq_start(disk);
+  outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER |
+                                       VIRTIO_STATUS_DRIVER_OK);
+}
+
+// Reading the ISR status acknowledges the interrupt
+static void virtio_handle_irq(void *data) {
+  virtio_disk_t *disk = data;
+  if (inb(VIRTIO_ISR_STATUS(disk)) & 1)
+    virtio_complete(disk, virtio_reap(disk));
+}
+
+// Before multitasking, or without the interrupt
+static int virtio_poll_slot(virtio_disk_t *disk, int slot) {
+  const uint32_t bit = 1U << slot;
+  for (uint32_t polls = VIRTIO_SPIN_POLLS; polls; polls--) {
+    const irq_state_t state = irq_protect();
+    virtio_complete(disk, virtio_reap(disk));
+    irq_unprotect(state);
+
+    if (!(disk->issued & bit))
+      return sem_timedwait(disk->done + slot, VIRTIO_TIMEOUT_MS);
+  }
+
+  return -1;
+}
+
+/*
+ * Block until the slot is completed, and free it.
+ * On a timeout the device is reset before the buffer is returned,
+ * and the other requests in flight fail with it.
+ */
+static int virtio_wait_slot(virtio_disk_t *disk, int slot) {
+  const uint32_t bit = 1U << slot;
+  const _Bool polled =
+      !get_curr_task() || !virtio_irq_on[disk - virtio_disks];
+  const int timeout = polled
+                          ? virtio_poll_slot(disk, slot)
+                          : sem_timedwait(disk->done + slot, VIRTIO_TIMEOUT_MS);
+
+  const irq_state_t state = irq_protect();
+  if (timeout < 0 && (disk->issued & bit)) {
+    virtio_reset(disk);
+    disk->issued &= ~bit;
+    for (int i = 0; i < VIRTIO_SLOT_NUM; i++) {
+      if (disk->issued & (1U << i))
+        disk->req[i].status = 0xFF;
+    }
+    virtio_complete(disk, disk->issued);
+    irq_unprotect(state);
+
+    log_printf("Timed out on %s, slot %d, device reset", disk->name, slot);
+    virtio_free_slot(disk, slot);
+    return -1;
+  }
+  irq_unprotect(state);
+
+  if (timeout < 0) // completed right after the timeout
+    sem_wait(disk->done + slot);
+
+  const uint8_t status = disk->req[slot].status;
+  if (status != VIRTIO_BLK_S_OK)
+    log_printf("Request failed on %s, slot %d, status = %d", disk->name, slot,
+               status);
+
+  virtio_free_slot(disk, slot);
+  return status == VIRTIO_BLK_S_OK ? 0 : -1;
+}
+
+/*
+ * Split the transfer into requests of max_sectors, and keep up to
+ * VIRTIO_REQ_SLOTS of them in flight, published in batches.
+ * Return the number of sectors transferred from the start.
+ */
+static size_t virtio_transfer(virtio_disk_t *disk, uint32_t sector,
+                              uint8_t *buf, size_t sectors, _Bool write) {
+  int slots[VIRTIO_REQ_SLOTS];
+  size_t counts[VIRTIO_REQ_SLOTS];
+  int head = 0, inflight = 0;
+  size_t issued = 0, done = 0;
+  _Bool failed = FALSE;
+
+  while (inflight || (!failed && issued < sectors)) {
+    int batch[VIRTIO_REQ_SLOTS], batch_cnt = 0;
+    while (!failed && issued < sectors && inflight < VIRTIO_REQ_SLOTS) {
+      const int slot = virtio_alloc_slot(disk, !inflight);
+      if (slot < 0)
+        break;
+
+      const size_t cnt = min(sectors - issued, (size_t)disk->max_sectors);
+      if (virtio_build_req(disk, slot, sector + issued,
+                           buf + issued * disk->sector_size, cnt, write) < 0) {
+        virtio_free_slot(disk, slot);
+        failed = TRUE;
+        break;
+      }
+
+      const int tail = (head + inflight++) % VIRTIO_REQ_SLOTS;
+      slots[tail] = batch[batch_cnt++] = slot;
+      counts[tail] = cnt;
+      issued += cnt;
+    }
+
+    if (batch_cnt)
+      virtio_submit(disk, batch, batch_cnt);
+
+    if (!inflight)
+      break;
+
+    if (virtio_wait_slot(disk, slots[head]) < 0)
+      failed = TRUE;
+    else if (!failed)
+      done += counts[head];
+
+    head = (head + 1) % VIRTIO_REQ_SLOTS;
+    inflight--;
+  }
+
+  return done;
+}
+
+static int virtio_read_mbr(virtio_disk_t *disk) {
+  mbr_t *mbr = (mbr_t *)memory_alloc_page();
+  if (!mbr)
+    return -1;
+
+  const _Bool read = virtio_transfer(disk, 0, (uint8_t *)mbr, 1, FALSE) == 1;
+  if (read)
+    disk_parse_mbr(mbr, disk->name, disk, disk->part_info);
+  else
+    log_printf("Failed to read MBR!");
+
+  memory_free_page((uint32_t)mbr);
+  return read ? 0 : -1;
+}
+
+/*
+ * The legacy layout of a virtqueue: the descriptors, the available ring,
+ * and the used ring which starts at the next VIRTQ_ALIGN boundary.
+ */
+static uint32_t virtq_avail_end(uint16_t size) {
+  return sizeof(virtq_desc_t) * size + sizeof(virtq_avail_t) +
+         sizeof(uint16_t) * (size + 1);
+}
+
+static uint32_t virtq_pages(uint16_t size) {
+  const uint32_t used_size = sizeof(virtq_used_t) +
+                             sizeof(virtq_used_elem_t) * size +
+                             sizeof(uint16_t);
+  return (up2(virtq_avail_end(size), VIRTQ_ALIGN) +
+          up2(used_size, VIRTQ_ALIGN)) /
+         MEM_PAGE_SIZE;
+}
+
+/*
+ * Hand the empty rings to the device, at probe or after a reset.
+ * The descriptors are kept, slots may be built but not yet submitted.
+ */
+static void virtq_start(virtio_disk_t *disk) {
+  disk->avail->flags = disk->avail->idx = 0;
+  disk->used->flags = disk->used->idx = 0;
+  disk->last_used = 0;
+
+  outw(VIRTIO_QUEUE_SELECT(disk), 0);
+  outl(VIRTIO_QUEUE_PFN(disk), (uint32_t)disk->desc / MEM_PAGE_SIZE);
+}
+
+static int virtq_init(virtio_disk_t *disk) {
+  outw(VIRTIO_QUEUE_SELECT(disk), 0);
+  disk->queue_size = inw(VIRTIO_QUEUE_SIZE(disk));
+  if (!disk->queue_size)
+    return -1;
+
+  const int slots = disk->indirect ? disk->queue_size
+                                   : disk->queue_size / VIRTIO_DESC_NUM;
+  if (!slots)
+    return -1;
+
+  const int ring_pages = virtq_pages(disk->queue_size);
+  const int req_pages =
+      up2(sizeof(virtio_req_t) * VIRTIO_SLOT_NUM, MEM_PAGE_SIZE) /
+      MEM_PAGE_SIZE;
+  const uint32_t ring = memory_alloc_pages(ring_pages);
+  const uint32_t req = memory_alloc_pages(req_pages);
+  if (!ring || !req) {
+    if (ring)
+      memory_free_pages(ring, ring_pages);
+
+    return -1;
+  }
+
+  kernel_memset((void *)ring, 0, ring_pages * MEM_PAGE_SIZE);
+  kernel_memset((void *)req, 0, req_pages * MEM_PAGE_SIZE);
+  disk->desc = (virtq_desc_t *)ring;
+  disk->avail = (virtq_avail_t *)(ring + sizeof(virtq_desc_t) *
+                                             disk->queue_size);
+  disk->used = (virtq_used_t *)(ring + up2(virtq_avail_end(disk->queue_size),
+                                           VIRTQ_ALIGN));
+  disk->req = (virtio_req_t *)req;
+  disk->slot_mask = slot_mask(slots);
+
+  virtq_start(disk);
+  return 0;
+}
+
+/*
+ * Only the features which change the layout of requests are negotiated,
+ * a legacy device accepts the subset written back without FEATURES_OK.
+ */
+static int virtio_blk_probe(virtio_disk_t *disk, const pci_dev_t *pci) {
+  const uint32_t bar = pci_bar(pci, 0);
+  if (!(bar & PCI_BAR_IO))
+    return -1;
+
+  disk->io_base = pci_bar_addr(bar);
+  pci_enable(pci, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+
+  outb(VIRTIO_DEVICE_STATUS(disk), 0); // reset
+  outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_ACK);
+  outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+  const uint32_t features =
+      inl(VIRTIO_DEVICE_FEATURES(disk)) & VIRTIO_FEATURES;
+  outl(VIRTIO_GUEST_FEATURES(disk), features);
+  disk->indirect = (features & VIRTIO_F_INDIRECT_DESC) != 0;
+  disk->read_only = (features & VIRTIO_BLK_F_RO) != 0;
+
+  disk->seg_max = VIRTIO_SEG_NUM;
+  if (features & VIRTIO_BLK_F_SEG_MAX)
+    disk->seg_max = min(disk->seg_max,
+                        (int)inl(VIRTIO_CONFIG(disk) + VIRTIO_BLK_SEG_MAX));
+
+  // Every page of a request may take a segment
+  disk->max_sectors = min(VIRTIO_MAX_SECTORS,
+                          (disk->seg_max - 1) * MEM_PAGE_SIZE / SECTOR_SIZE);
+
+  const uint32_t capacity_hi =
+      inl(VIRTIO_CONFIG(disk) + VIRTIO_BLK_CAPACITY + 4);
+  disk->sectors = capacity_hi ? 0xFFFFFFFF
+                              : inl(VIRTIO_CONFIG(disk) + VIRTIO_BLK_CAPACITY);
+  disk->sector_size = SECTOR_SIZE;
+
+  if (disk->max_sectors <= 0 || virtq_init(disk) < 0) {
+    outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_FAILED);
+    return -1;
+  }
+
+  wait_queue_init(&disk->slot_wait);
+  for (int i = 0; i < VIRTIO_SLOT_NUM; i++)
+    sem_init(disk->done + i, 0);
+
+  outb(VIRTIO_DEVICE_STATUS(disk), VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER |
+                                       VIRTIO_STATUS_DRIVER_OK);
+
+  part_info_t *part = disk->part_info;
+  part->disk = disk;
+  kernel_sprintf(part->name, "%s%d", disk->name, 0);
+  part->start_sector = 0;
+  part->total_sector = disk->sectors;
+  part->type = FS_INVALID;
+
+  virtio_read_mbr(disk);
+  return 0;
+}
+
+static void print_virtio_info(const virtio_disk_t *disk) {
+  log_printf("%s", disk->name);
+  log_printf("Base Address of Port: 0x%x, queue size: %d, indirect: %d",
+             disk->io_base, disk->queue_size, disk->indirect);
+  log_printf("Total size: %d MiB", disk_size_mib(disk));
+
+  for (int i = 0; i < PRIMARY_PART_NUM; i++) {
+    const part_info_t *part_info = disk->part_info + i;
+    if (part_info->type != FS_INVALID) {
+      log_printf("%s: Type = %x, Starting sector = %d, Total sectors: %d",
+                 part_info->name, part_info->type, part_info->start_sector,
+                 part_info->total_sector);
+    }
+  }
+}
+
+void virtio_blk_init() {
+  pci_dev_t pci;
+  for (int i = 0; virtio_disk_cnt < VIRTIO_DISK_NUM &&
+                  !pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, i,
+                                   &pci);
+       i++) {
+    virtio_disk_t *disk = virtio_disks + virtio_disk_cnt;
+    kernel_memset(disk, 0, sizeof(virtio_disk_t));
+    kernel_sprintf(disk->name, "Virtio: /dev/vd%c", virtio_disk_cnt + 'a');
+    if (virtio_blk_probe(disk, &pci) < 0) {
+      log_printf("Failed to initialize disk %s!", disk->name);
+      continue;
+    }
+
+    print_virtio_info(disk);
+    virtio_irq_on[virtio_disk_cnt++] =
+        !pci_irq_install(&pci, virtio_handle_irq, disk);
+  }
+}
+
+int virtio_blk_open(device_t *dev) {
+  const int disk_id = get_virtio_id(dev->minor_no);
+  const int part_id = get_part_id(dev->minor_no);
+
+  if (disk_id >= virtio_disk_cnt || part_id >= PRIMARY_PART_NUM) {
+    log_printf("Invalid minor number!");
+    return -1;
+  }
+
+  const part_info_t *part_info = virtio_disks[disk_id].part_info + part_id;
+  if (!part_info->total_sector) {
+    log_printf("Partition does not exist: /dev/vd%x", dev->minor_no);
+    return -1;
+  }
+
+  dev->data = (void *)part_info;
+  return 0;
+}
+
+int virtio_blk_close(const device_t *dev) { return -1; }
+
+int virtio_blk_read(const device_t *dev, uint32_t start_sector, void *buf,
+                    size_t sectors) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info)
+    return -1;
+
+  const size_t sector_read =
+      virtio_transfer((virtio_disk_t *)part_info->disk,
+                      part_info->start_sector + start_sector, buf, sectors,
+                      FALSE);
+  poll_notify();
+  return sector_read;
+}
+
+int virtio_blk_write(const device_t *dev, uint32_t start_sector,
+                     const void *buf, size_t sectors) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info || !sectors)
+    return -1;
+
+  virtio_disk_t *disk = (virtio_disk_t *)part_info->disk;
+  if (disk->read_only)
+    return -1;
+
+  const size_t sector_written =
+      virtio_transfer(disk, part_info->start_sector + start_sector,
+                      (void *)buf, sectors, TRUE);
+  poll_notify();
+  return sector_written;
+}
+
+int virtio_blk_control(const device_t *dev, int cmd, va_list arg_list) {
+  return -1;
+}
+
+// The disk would block while every slot is busy
+int virtio_blk_poll(const device_t *dev) {
+  const part_info_t *part_info = dev->data;
+  if (!part_info)
+    return POLLNVAL;
+
+  const virtio_disk_t *disk = part_info->disk;
+  return (disk->busy & disk->slot_mask) == disk->slot_mask ? 0
+                                                           : POLLIN | POLLOUT;
+}
@@ -0,0 +1,532 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fs/bcache.h"
+#include "cpu/irq.h"
+#include "dev/dev.h"
+#include "dev/timer.h"
+#include "ipc/mutex_stat.h"
+#include "ipc/wait.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static bcache_buf_t bcache_bufs[BCACHE_BUF_NUM];
+static list_t hash_table[BCACHE_HASH_SIZE];
+static list_t lru_list;   // unpinned buffers, the least recently used first
+static list_t dirty_list; // in the order of becoming dirty
+static int dirty_cnt;
+
+static wait_queue_t io_wait;    // tasks waiting for a busy buffer
+static wait_queue_t flush_wait; // the flusher sleeps on it
+static mutex_t flush_mutex;     // protect flush_buf
+static uint8_t *flush_buf;      // gathers a run of dirty blocks
+
+// Ranges to read ahead, taken by the read-ahead thread in FIFO order
+static struct {
+  int dev_id;
+  uint32_t block;
+  size_t blocks;
+} ra_queue[BCACHE_RA_NUM];
+static int ra_head, ra_cnt;
+static wait_queue_t ra_wait;
+static uint8_t *ra_buf; // a run of blocks read ahead
+static task_t *ra_task;
+
+#define bcache_hash(dev_id, block)                                             \
+  (hash_table + ((uint32_t)(dev_id) * 31 + (block)) % BCACHE_HASH_SIZE)
+
+void bcache_init() {
+  const int pages = BCACHE_BUF_NUM * BCACHE_BLOCK_SIZE / MEM_PAGE_SIZE;
+  uint8_t *data = (uint8_t *)memory_alloc_pages(pages);
+  flush_buf = (uint8_t *)memory_alloc_pages(
+      BCACHE_FLUSH_BLOCKS * BCACHE_BLOCK_SIZE / MEM_PAGE_SIZE);
+  ra_buf = (uint8_t *)memory_alloc_pages(BCACHE_RUN_MAX * BCACHE_BLOCK_SIZE /
+                                         MEM_PAGE_SIZE);
+  ASSERT(data != NULL && flush_buf != NULL && ra_buf != NULL);
+
+  for (int i = 0; i < BCACHE_HASH_SIZE; i++)
+    list_init(hash_table + i);
+
+  list_init(&lru_list);
+  list_init(&dirty_list);
+  wait_queue_init(&io_wait);
+  wait_queue_init(&flush_wait);
+  wait_queue_init(&ra_wait);
+  mutex_init(&flush_mutex);
+  mutex_stat_add(&flush_mutex, "bcache flush");
+
+  kernel_memset(bcache_bufs, 0, sizeof(bcache_bufs));
+  for (int i = 0; i < BCACHE_BUF_NUM; i++) {
+    bcache_buf_t *buf = bcache_bufs + i;
+    buf->dev_id = -1;
+    buf->data = data + i * BCACHE_BLOCK_SIZE;
+    list_insert_last(&lru_list, &buf->lru_node);
+  }
+}
+
+// Called with interrupts disabled, as every helper below
+static bcache_buf_t *bcache_lookup(int dev_id, uint32_t block) {
+  list_for_each_node(bcache_hash(dev_id, block), node) {
+    bcache_buf_t *buf = list_node_parent(node, bcache_buf_t, hash_node);
+    if (buf->dev_id == dev_id && buf->block == block)
+      return buf;
+  }
+
+  return NULL;
+}
+
+static void bcache_pin(bcache_buf_t *buf) {
+  if (!buf->pin_cnt++)
+    list_remove(&lru_list, &buf->lru_node);
+}
+
+// A buffer without valid data is reused first
+static void bcache_unpin(bcache_buf_t *buf) {
+  if (--buf->pin_cnt)
+    return;
+
+  if (buf->valid)
+    list_insert_last(&lru_list, &buf->lru_node);
+  else
+    list_insert_first(&lru_list, &buf->lru_node);
+}
+
+// The least recently used buffer which can be reused without writing
+static bcache_buf_t *bcache_victim() {
+  list_for_each_node(&lru_list, node) {
+    bcache_buf_t *buf = list_node_parent(node, bcache_buf_t, lru_node);
+    if (!buf->busy && !buf->dirty)
+      return buf;
+  }
+
+  return NULL;
+}
+
+// Take the buffer for the block, which should be filled by the caller
+static void bcache_claim(bcache_buf_t *buf, int dev_id, uint32_t block) {
+  if (buf->dev_id >= 0)
+    list_remove(bcache_hash(buf->dev_id, buf->block), &buf->hash_node);
+
+  buf->dev_id = dev_id;
+  buf->block = block;
+  buf->valid = FALSE;
+  buf->busy = TRUE;
+  list_insert_first(bcache_hash(dev_id, block), &buf->hash_node);
+  bcache_pin(buf);
+}
+
+/*
+ * Claim the missing blocks following the run, without waiting or writing
+ * back, and stop at a block which is cached or being filled.
+ * Return the number of buffers in the run.
+ */
+static size_t bcache_claim_run(int dev_id, uint32_t block, size_t max,
+                               bcache_buf_t **run, size_t cnt) {
+  while (cnt < max && !bcache_lookup(dev_id, block + cnt)) {
+    bcache_buf_t *victim = bcache_victim();
+    if (!victim)
+      break;
+
+    bcache_claim(victim, dev_id, block + cnt);
+    run[cnt++] = victim;
+  }
+
+  return cnt;
+}
+
+static void bcache_wait_io() {
+  list_insert_last(&io_wait.wait_list, &get_curr_task()->wait_node);
+  wait_block(&io_wait.wait_list, WAIT_FOREVER);
+}
+
+// The oldest dirty buffer of the device (-1 for any), which isn't busy
+static bcache_buf_t *bcache_first_dirty(int dev_id, _Bool expired_only) {
+  const uint32_t now = timer_get_tick();
+  list_for_each_node(&dirty_list, node) {
+    bcache_buf_t *buf = list_node_parent(node, bcache_buf_t, dirty_node);
+    if (expired_only && (int)(now - buf->dirty_tick) <
+                            BCACHE_DIRTY_EXPIRE_MS / OS_TICKS_MS)
+      return NULL;
+
+    if (!buf->busy && (dev_id < 0 || buf->dev_id == dev_id))
+      return buf;
+  }
+
+  return NULL;
+}
+
+/*
+ * Write back the oldest dirty block with the dirty blocks following it,
+ * by one request through flush_buf. The blocks which weren't written stay
+ * dirty. Return 1 if a run was written, 0 if nothing is left, -1 on failure.
+ */
+static int bcache_flush_run(int dev_id, _Bool expired_only) {
+  mutex_lock(&flush_mutex);
+  irq_state_t state = irq_protect();
+  bcache_buf_t *buf = bcache_first_dirty(dev_id, expired_only);
+  if (!buf) {
+    irq_unprotect(state);
+    mutex_unlock(&flush_mutex);
+    return 0;
+  }
+
+  bcache_buf_t *run[BCACHE_FLUSH_BLOCKS];
+  const int run_dev = buf->dev_id;
+  const uint32_t run_block = buf->block;
+  int cnt = 0;
+  while (buf && buf->dirty && !buf->busy && cnt < BCACHE_FLUSH_BLOCKS) {
+    buf->busy = TRUE;
+    buf->dirty = FALSE;
+    list_remove(&dirty_list, &buf->dirty_node);
+    kernel_memcpy(flush_buf + cnt * BCACHE_BLOCK_SIZE, buf->data,
+                  BCACHE_BLOCK_SIZE);
+    run[cnt++] = buf;
+    buf = bcache_lookup(run_dev, run_block + cnt);
+  }
+
+  dirty_cnt -= cnt;
+  irq_unprotect(state);
+
+  const int written = max(dev_write(run_dev, run_block, flush_buf, cnt), 0);
+  if (written < cnt)
+    log_printf("Failed to write back block %d of device %d, kept dirty!",
+               run_block + written, run_dev);
+
+  state = irq_protect();
+  for (int i = 0; i < cnt; i++) {
+    if (i >= written) { // retried by a later flush
+      run[i]->dirty = TRUE;
+      run[i]->dirty_tick = timer_get_tick();
+      list_insert_last(&dirty_list, &run[i]->dirty_node);
+      dirty_cnt++;
+    }
+
+    run[i]->busy = FALSE;
+  }
+
+  irq_unprotect(state);
+  wait_queue_wake(&io_wait, TASK_NUM);
+  mutex_unlock(&flush_mutex);
+  return written < cnt ? -1 : 1;
+}
+
+/*
+ * Return the buffer of the block pinned, or NULL if every buffer is pinned.
+ * A buffer without valid data is returned busy, and the caller should fill it
+ * and call bcache_filled.
+ */
+static bcache_buf_t *bcache_getblk(int dev_id, uint32_t block) {
+  for (;;) {
+    const irq_state_t state = irq_protect();
+    bcache_buf_t *buf = bcache_lookup(dev_id, block);
+    if (buf && buf->busy) {
+      bcache_wait_io();
+      irq_unprotect(state);
+      continue;
+    }
+
+    if (buf) {
+      bcache_pin(buf);
+      buf->busy = !buf->valid; // filling failed before
+    } else if ((buf = bcache_victim()))
+      bcache_claim(buf, dev_id, block);
+
+    irq_unprotect(state);
+    if (buf)
+      return buf;
+
+    // Every unpinned buffer is dirty, write back the oldest ones
+    if (bcache_flush_run(-1, FALSE) <= 0) {
+      log_printf("No free buffer for block %d of device %d!", block, dev_id);
+      return NULL;
+    }
+  }
+}
+
+static void bcache_filled(bcache_buf_t *buf, _Bool valid) {
+  const irq_state_t state = irq_protect();
+  buf->valid = valid;
+  buf->busy = FALSE;
+  irq_unprotect(state);
+  wait_queue_wake(&io_wait, TASK_NUM);
+}
+
+// Return the buffer holding the block pinned, or NULL if it can't be read
+bcache_buf_t *bcache_get(int dev_id, uint32_t block) {
+  bcache_buf_t *buf = bcache_getblk(dev_id, block);
+  if (!buf || buf->valid)
+    return buf;
+
+  const _Bool valid = dev_read(dev_id, block, buf->data, 1) == 1;
+  bcache_filled(buf, valid);
+  if (!valid) {
+    bcache_put(buf);
+    return NULL;
+  }
+
+  return buf;
+}
+
+void bcache_put(bcache_buf_t *buf) {
+  const irq_state_t state = irq_protect();
+  bcache_unpin(buf);
+  irq_unprotect(state);
+}
+
+// The block is written back by the flusher after BCACHE_DIRTY_EXPIRE_MS
+void bcache_mark_dirty(bcache_buf_t *buf) {
+  const irq_state_t state = irq_protect();
+  if (!buf->dirty) {
+    buf->dirty = TRUE;
+    buf->dirty_tick = timer_get_tick();
+    list_insert_last(&dirty_list, &buf->dirty_node);
+    dirty_cnt++;
+  }
+
+  const _Bool high = dirty_cnt > BCACHE_DIRTY_HIGH;
+  irq_unprotect(state);
+
+  if (high)
+    wait_queue_wake(&flush_wait, 1);
+}
+
+/*
+ * Read the claimed run by one request into buf, and copy the blocks to the
+ * buffers. Return the number of blocks read from the start.
+ */
+static size_t bcache_fill_run(bcache_buf_t **run, size_t cnt, uint8_t *buf) {
+  const int read = dev_read(run[0]->dev_id, run[0]->block, buf, cnt);
+  const size_t valid_cnt = read > 0 ? read : 0;
+  for (size_t i = 0; i < valid_cnt; i++)
+    kernel_memcpy(run[i]->data, buf + i * BCACHE_BLOCK_SIZE,
+                  BCACHE_BLOCK_SIZE);
+
+  const irq_state_t state = irq_protect();
+  for (size_t i = 0; i < cnt; i++) {
+    run[i]->valid = i < valid_cnt;
+    run[i]->busy = FALSE;
+    bcache_unpin(run[i]);
+  }
+  irq_unprotect(state);
+
+  wait_queue_wake(&io_wait, TASK_NUM);
+  return valid_cnt;
+}
+
+/*
+ * Copy the cached blocks to buf, and fill each run of missing blocks by one
+ * request straight into buf, copying the blocks to the cache afterwards.
+ * Return the number of blocks read from the start.
+ */
+int bcache_read(int dev_id, uint32_t block, void *buf, size_t blocks) {
+  uint8_t *dest = buf;
+  size_t done = 0;
+
+  while (done < blocks) {
+    irq_state_t state = irq_protect();
+    bcache_buf_t *cached = bcache_lookup(dev_id, block + done);
+    if (cached && cached->valid && !cached->busy) {
+      kernel_memcpy(dest + done * BCACHE_BLOCK_SIZE, cached->data,
+                    BCACHE_BLOCK_SIZE);
+      if (!cached->pin_cnt) { // used recently
+        list_remove(&lru_list, &cached->lru_node);
+        list_insert_last(&lru_list, &cached->lru_node);
+      }
+
+      irq_unprotect(state);
+      done++;
+      continue;
+    }
+    irq_unprotect(state);
+
+    bcache_buf_t *run[BCACHE_RUN_MAX];
+    if (!(run[0] = bcache_getblk(dev_id, block + done)))
+      break;
+
+    if (run[0]->valid) { // filled by another task in the meantime
+      kernel_memcpy(dest + done * BCACHE_BLOCK_SIZE, run[0]->data,
+                    BCACHE_BLOCK_SIZE);
+      bcache_put(run[0]);
+      done++;
+      continue;
+    }
+
+    state = irq_protect();
+    const size_t cnt = bcache_claim_run(
+        dev_id, block + done, min(blocks - done, (size_t)BCACHE_RUN_MAX), run,
+        1);
+    irq_unprotect(state);
+
+    const size_t valid_cnt =
+        bcache_fill_run(run, cnt, dest + done * BCACHE_BLOCK_SIZE);
+    done += valid_cnt;
+    if (valid_cnt < cnt)
+      break;
+  }
+
+  return done;
+}
+
+// Blocks are only copied to the cache, and written back later
+int bcache_write(int dev_id, uint32_t block, const void *buf, size_t blocks) {
+  const uint8_t *src = buf;
+  size_t done = 0;
+
+  for (; done < blocks; done++) {
+    bcache_buf_t *cached = bcache_getblk(dev_id, block + done);
+    if (!cached)
+      break;
+
+    kernel_memcpy(cached->data, src + done * BCACHE_BLOCK_SIZE,
+                  BCACHE_BLOCK_SIZE);
+    if (!cached->valid) // overwritten entirely, no need to read it
+      bcache_filled(cached, TRUE);
+
+    bcache_mark_dirty(cached);
+    bcache_put(cached);
+  }
+
+  return done;
+}
+
+// Write back every dirty block of the device (-1 for all devices),
+// stopping at the first failure as the blocks which failed stay dirty
+int bcache_sync(int dev_id) {
+  int ret;
+  while ((ret = bcache_flush_run(dev_id, FALSE)) > 0)
+    ;
+
+  return ret;
+}
+
+/*
+ * Drop the blocks of a device which is going away, after bcache_sync,
+ * or of every device if dev_id is -1. Blocks in use are kept.
+ */
+void bcache_invalidate(int dev_id) {
+  const irq_state_t state = irq_protect();
+  for (int i = 0; i < BCACHE_BUF_NUM; i++) {
+    bcache_buf_t *buf = bcache_bufs + i;
+    if (buf->dev_id < 0 || (dev_id >= 0 && buf->dev_id != dev_id) ||
+        buf->pin_cnt || buf->busy)
+      continue;
+
+    if (buf->dirty) {
+      list_remove(&dirty_list, &buf->dirty_node);
+      buf->dirty = FALSE;
+      dirty_cnt--;
+    }
+
+    list_remove(bcache_hash(buf->dev_id, buf->block), &buf->hash_node);
+    buf->dev_id = -1;
+    buf->valid = FALSE;
+    list_remove(&lru_list, &buf->lru_node);
+    list_insert_first(&lru_list, &buf->lru_node);
+  }
+
+  irq_unprotect(state);
+}
+
+/*
+ * Queue the range to be read into the cache by the read-ahead thread.
+ * The range is dropped if the queue is full, or before multitasking.
+ */
+void bcache_readahead(int dev_id, uint32_t block, size_t blocks) {
+  if (!ra_task)
+    return;
+
+  const irq_state_t state = irq_protect();
+  const _Bool queued = ra_cnt < BCACHE_RA_NUM;
+  if (queued) {
+    const int idx = (ra_head + ra_cnt++) % BCACHE_RA_NUM;
+    ra_queue[idx].dev_id = dev_id;
+    ra_queue[idx].block = block;
+    ra_queue[idx].blocks = blocks;
+  }
+  irq_unprotect(state);
+
+  if (queued)
+    wait_queue_wake(&ra_wait, 1);
+}
+
+/*
+ * Fill the missing blocks of the range through ra_buf. The blocks which are
+ * cached or being filled are skipped, and the reading stops when no clean
+ * buffer is left, since the range is only a guess.
+ */
+static void bcache_prefetch(int dev_id, uint32_t block, size_t blocks) {
+  bcache_buf_t *run[BCACHE_RUN_MAX];
+  size_t done = 0;
+
+  while (done < blocks) {
+    const irq_state_t state = irq_protect();
+    const size_t cnt = bcache_claim_run(
+        dev_id, block + done, min(blocks - done, (size_t)BCACHE_RUN_MAX), run,
+        0);
+    const _Bool present = !cnt && bcache_lookup(dev_id, block + done);
+    irq_unprotect(state);
+
+    if (present) {
+      done++;
+      continue;
+    }
+
+    if (!cnt || bcache_fill_run(run, cnt, ra_buf) < cnt)
+      break;
+
+    done += cnt;
+  }
+}
+
+static void bcache_reader(void *arg) {
+  for (;;) {
+    irq_state_t state = irq_protect();
+    while (!ra_cnt) {
+      list_insert_last(&ra_wait.wait_list, &get_curr_task()->wait_node);
+      wait_block(&ra_wait.wait_list, WAIT_FOREVER);
+    }
+
+    const int dev_id = ra_queue[ra_head].dev_id;
+    const uint32_t block = ra_queue[ra_head].block;
+    const size_t blocks = ra_queue[ra_head].blocks;
+    ra_head = (ra_head + 1) % BCACHE_RA_NUM;
+    ra_cnt--;
+    irq_unprotect(state);
+
+    bcache_prefetch(dev_id, block, blocks);
+  }
+}
+
+// Write back the expired blocks, or all of them when too many are dirty
+static void bcache_flusher(void *arg) {
+  for (;;) {
+    wait_queue_wait(&flush_wait, BCACHE_FLUSH_MS);
+    while (bcache_flush_run(-1, dirty_cnt <= BCACHE_DIRTY_HIGH) > 0)
+      ;
+  }
+}
+
+static task_t *bcache_create_kthread(const char *name, void (*entry)(void *)) {
+  const uint32_t page_dir = memory_create_uvm();
+  if (!page_dir)
+    return NULL;
+
+  task_t *task = task_create_kthread(name, page_dir, entry, NULL);
+  if (!task) {
+    memory_destroy_uvm(page_dir);
+    log_printf("Failed to start %s!", name);
+  }
+
+  return task;
+}
+
+/*
+ * Before multitasking, dirty blocks are left until the flusher starts,
+ * and nothing is read ahead.
+ */
+void bcache_start() {
+  bcache_create_kthread("Buffer Flush", bcache_flusher);
+  ra_task = bcache_create_kthread("Read Ahead", bcache_reader);
+}
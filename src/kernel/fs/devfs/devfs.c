@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "fs/devfs/devfs.h"
+#include "comm/boot_info.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 
@@ -14,10 +15,18 @@ fs_api_t devfs_api = {.mount = devfs_mount,
                       .write = devfs_write,
                       .seek = devfs_seek,
                       .stat = devfs_stat,
-                      .ioctl = devfs_ioctl};
+                      .ioctl = devfs_ioctl,
+                      .poll = devfs_poll};
 
 static const devfs_type_t dev_type_table[] = {
-    {.name = "tty", .dev_type = TTY_DEV, .file_type = TTY_FILE}};
+    {.name = "tty", .dev_type = TTY_DEV, .file_type = TTY_FILE},
+    {.name = "trace", .dev_type = DEV_TRACE, .file_type = DEV_FILE},
+    {.name = "syslat", .dev_type = DEV_SYSLAT, .file_type = DEV_FILE},
+    {.name = "prof", .dev_type = DEV_PROF, .file_type = DEV_FILE},
+    {.name = "boot", .dev_type = DEV_BOOT, .file_type = DEV_FILE},
+    {.name = "diskstat", .dev_type = DEV_DISKSTAT, .file_type = DEV_FILE},
+    {.name = "lockstat", .dev_type = DEV_LOCKSTAT, .file_type = DEV_FILE},
+    {.name = "ram", .dev_type = DEV_RAMDISK, .file_type = BLOCK_FILE}};
 
 int devfs_mount(fs_t *fs, int major_no, int minor_no) {
   fs->type = DEVFS;
@@ -57,18 +66,64 @@ int devfs_open(fs_t *fs, const char *path, file_t *file) {
 
 int devfs_close(file_t *file) { return dev_close(file->dev_id); }
 
+/*
+ * pos and size are converted to sectors for a block device, so they must be
+ * multiples of a sector. Return the number of bytes transferred.
+ */
+static int devfs_block_rw(file_t *file, void *buf, size_t size,
+                          _Bool write) {
+  if ((file->pos | size) % SECTOR_SIZE) {
+    log_printf("Unaligned access to a block device: pos = %d, size = %d",
+               file->pos, size);
+    return -1;
+  }
+
+  const uint32_t sector = file->pos / SECTOR_SIZE;
+  int len = write ? dev_write(file->dev_id, sector, buf, size / SECTOR_SIZE)
+                  : dev_read(file->dev_id, sector, buf, size / SECTOR_SIZE);
+  if (len > 0) {
+    len *= SECTOR_SIZE;
+    file->pos += len;
+  }
+
+  return len;
+}
+
+// pos is only meaningful to the devices which read from an address
 int devfs_read(void *buf, size_t size, file_t *file) {
-  return dev_read(file->dev_id, file->pos, buf, size);
+  if (file->type == BLOCK_FILE)
+    return devfs_block_rw(file, buf, size, FALSE);
+
+  const int len = dev_read(file->dev_id, file->pos, buf, size);
+  if (len > 0)
+    file->pos += len;
+
+  return len;
 }
 
 int devfs_write(const void *buf, size_t size, file_t *file) {
-  return dev_write(file->dev_id, file->pos, buf, size);
+  if (file->type == BLOCK_FILE)
+    return devfs_block_rw(file, (void *)buf, size, TRUE);
+
+  const int len = dev_write(file->dev_id, file->pos, buf, size);
+  if (len > 0)
+    file->pos += len;
+
+  return len;
 }
 
-int devfs_seek(file_t *file, uint32_t offset, int dir) { return dir ? -1 : 0; }
+int devfs_seek(file_t *file, uint32_t offset, int dir) {
+  if (dir)
+    return -1;
+
+  file->pos = offset;
+  return 0;
+}
 
 int devfs_stat(file_t *file, struct stat *stat) { return -1; }
 
 int devfs_ioctl(file_t *file, int cmd, void *arg0, void *arg1) {
   return dev_control(file->dev_id, cmd, arg0, arg1);
 }
+
+int devfs_poll(file_t *file) { return dev_poll(file->dev_id); }
@@ -5,6 +5,7 @@
 #include "fs/fatfs/fatfs.h"
 #include "core/memory.h"
 #include "dev/dev.h"
+#include "fs/bcache.h"
 #include "fs/fs.h"
 #include "sys/_default_fcntl.h"
 #include "tools/klib.h"
@@ -31,17 +32,13 @@ int fatfs_mount(fs_t *fs, int major_no, int minor_no) {
     return -1;
   }
 
-  dbr_t *dbr = (dbr_t *)memory_alloc_page();
-  if (!dbr) {
-    log_printf("Failed to allocate memory for the DBR!");
-    goto mount_failed;
-  }
-
-  if (dev_read(dev_id, 0, dbr, 1) < 1) {
+  bcache_buf_t *buf = bcache_get(dev_id, 0);
+  if (!buf) {
     log_printf("Failed to read DBR!");
     goto mount_failed;
   }
 
+  const dbr_t *dbr = (const dbr_t *)buf->data;
   fat_t *fat = &fs->fat_data;
   // DBR - FAT1 - FAT2 - root dir - file data
   fat->fat_start = dbr->bpb.rsvd_sectors;
@@ -54,11 +51,9 @@ int fatfs_mount(fs_t *fs, int major_no, int minor_no) {
   fat->data_start =
       fat->root_start + fat->root_entries * ROOT_ENTRY_SIZE / SECTOR_SIZE;
   fat->bytes_per_cluster = fat->sectors_per_cluster * dbr->bpb.bytes_per_sector;
-  fat->curr_sector = -1;
-  fat->fat_buf = dbr;
   fat->fs = fs;
-  mutex_init(&fat->mutex);
-  fs->mutex = &fat->mutex;
+  rwlock_init(&fat->rwlock);
+  fs->rwlock = &fat->rwlock;
 
   if (fat->fat_num != 2)
     log_printf("Warning: The number of FAT is not 2 (major number = %x, minor "
@@ -70,24 +65,27 @@ int fatfs_mount(fs_t *fs, int major_no, int minor_no) {
     goto mount_failed;
   }
 
+  bcache_put(buf);
   fs->type = FAT16;
   fs->data = &fs->fat_data;
   fs->dev_id = dev_id;
   return 0;
 
 mount_failed:
-  if (dbr)
-    memory_free_page((uint32_t)dbr);
+  if (buf)
+    bcache_put(buf);
 
+  bcache_invalidate(dev_id);
   dev_close(dev_id);
   return -1;
 }
 
+// The dirty blocks are written back before the device is closed
 int fatfs_unmount(fs_t *fs) {
-  fat_t *fat = fs->data;
+  const int err = bcache_sync(fs->dev_id);
+  bcache_invalidate(fs->dev_id);
   dev_close(fs->dev_id);
-  memory_free_page((uint32_t)fat->fat_buf);
-  return 0;
+  return err;
 }
 
 static void read_from_dirent(file_t *file, const dirent_t *dirent,
@@ -98,6 +96,7 @@ static void read_from_dirent(file_t *file, const dirent_t *dirent,
   file->dirent_index = index;
   file->cluster_start = get_cluster_no(dirent);
   file->curr_cluster = file->cluster_start;
+  file->ra_pos = file->ra_window = file->ra_end = 0;
 }
 
 static int get_next_cluster(fat_t *fat, cluster_t curr) {
@@ -112,10 +111,13 @@ static int get_next_cluster(fat_t *fat, cluster_t curr) {
     return FAT_CLUSTER_INVALID;
   }
 
-  if (buf_read_sector(fat, fat->fat_start + sector_no) < 0)
+  bcache_buf_t *buf = bcache_get(fat->fs->dev_id, fat->fat_start + sector_no);
+  if (!buf)
     return FAT_CLUSTER_INVALID;
 
-  return *(cluster_t *)(fat->fat_buf + sector_offset);
+  const cluster_t next = *(cluster_t *)(buf->data + sector_offset);
+  bcache_put(buf);
+  return next;
 }
 
 static int set_next_cluster(fat_t *fat, cluster_t curr, cluster_t next) {
@@ -130,15 +132,17 @@ static int set_next_cluster(fat_t *fat, cluster_t curr, cluster_t next) {
     return -1;
   }
 
-  if (buf_read_sector(fat, fat->fat_start + sector_no) < 0)
-    return -1;
-
-  *(cluster_t *)(fat->fat_buf + sector_offset) = next;
   for (size_t i = 0; i < fat->fat_num; i++, sector_no += fat->sectors_per_fat) {
-    if (buf_write_sector(fat, fat->fat_start + sector_no) < 0) {
+    bcache_buf_t *buf =
+        bcache_get(fat->fs->dev_id, fat->fat_start + sector_no);
+    if (!buf) {
       log_printf("Failed to write cluster in FAT%d!", i);
       return -1;
     }
+
+    *(cluster_t *)(buf->data + sector_offset) = next;
+    bcache_mark_dirty(buf);
+    bcache_put(buf);
   }
 
   return 0;
@@ -162,6 +166,42 @@ static int move_file_pos(file_t *file, fat_t *fat, uint32_t bytes,
   return 0;
 }
 
+/*
+ * Extend the bytes left in the cluster from offset over the following
+ * clusters while their numbers are consecutive, until size is covered.
+ * Return the last cluster of the run, and its length in *run_bytes.
+ */
+static cluster_t cluster_run(fat_t *fat, cluster_t first, uint32_t offset,
+                             uint32_t size, uint32_t *run_bytes) {
+  cluster_t last = first;
+  *run_bytes = fat->bytes_per_cluster - offset;
+  while (*run_bytes < size) {
+    const cluster_t next = get_next_cluster(fat, last);
+    if (next != last + 1)
+      break;
+
+    last = next;
+    *run_bytes += fat->bytes_per_cluster;
+  }
+
+  return last;
+}
+
+// Move over the bytes of a run transferred at once, ending in cluster last
+static int move_file_run(file_t *file, fat_t *fat, cluster_t last,
+                         uint32_t bytes, _Bool expand) {
+  if (last != file->curr_cluster) {
+    const uint32_t skipped =
+        fat->bytes_per_cluster - file->pos % fat->bytes_per_cluster +
+        (last - file->curr_cluster - 1) * fat->bytes_per_cluster;
+    file->pos += skipped;
+    file->curr_cluster = last;
+    bytes -= skipped;
+  }
+
+  return move_file_pos(file, fat, bytes, expand);
+}
+
 static cluster_t cluster_alloc_free(fat_t *fat, size_t clusters) {
   cluster_t prev = FAT_CLUSTER_INVALID, start = FAT_CLUSTER_INVALID;
   const size_t total =
@@ -220,46 +260,30 @@ int expand_file(file_t *file, size_t incr) {
   return 0;
 }
 
-int buf_read_sector(fat_t *fat, int sector_no) {
-  if (sector_no == fat->curr_sector)
-    return 0;
-
-  if (dev_read(fat->fs->dev_id, sector_no, fat->fat_buf, 1) == 1) {
-    fat->curr_sector = sector_no;
-    return 0;
-  }
-
-  return -1;
-}
-
-int buf_write_sector(fat_t *fat, int sector_no) {
-  return dev_write(fat->fs->dev_id, sector_no, fat->fat_buf, 1) == 1 ? 0 : -1;
-}
-
 int fatfs_open(fs_t *fs, const char *path, file_t *file) {
   fat_t *fat = fs->data;
-  dirent_t *dirent = NULL;
+  dirent_t dirent;
+  _Bool found = FALSE;
   int dirent_index = -1;
 
   for (size_t i = 0; i < fat->root_entries; i++) {
-    dirent_t *curr_dirent = read_dirent(fat, i);
-    if (!curr_dirent)
+    if (read_dirent(fat, i, &dirent) < 0)
       return -1;
 
-    if (*curr_dirent->filename == DIRENT_NAME_END) {
+    if (*dirent.filename == DIRENT_NAME_END) {
       dirent_index = i;
       break;
     }
 
-    if (*curr_dirent->filename == DIRENT_NAME_FREE) {
+    if (*dirent.filename == DIRENT_NAME_FREE) {
       dirent_index = i;
       continue;
     }
 
     char curr_filename[FAT_FILENAME_LEN + 2]; // '.' & '\0'
-    dirent_get_name(curr_dirent, curr_filename);
+    dirent_get_name(&dirent, curr_filename);
     if (streq(kernel_strlwr(curr_filename), path)) {
-      dirent = curr_dirent;
+      found = TRUE;
       dirent_index = i;
       break;
     }
@@ -269,8 +293,8 @@ int fatfs_open(fs_t *fs, const char *path, file_t *file) {
    * if - Found a valid directory entry
    * else if - Found a free directory entry, while the file should be created
    */
-  if (dirent) {
-    read_from_dirent(file, dirent, dirent_index);
+  if (found) {
+    read_from_dirent(file, &dirent, dirent_index);
     if (file->mode & O_TRUNC) {
       // cluster_unlink(fat, file->cluster_start);
       file->curr_cluster = file->cluster_start = FAT_CLUSTER_INVALID;
@@ -304,24 +328,93 @@ int fatfs_open(fs_t *fs, const char *path, file_t *file) {
 }
 
 int fatfs_close(file_t *file) {
-  if (file->mode == O_RDONLY)
+  if (file_acc_mode(file) == O_RDONLY)
     return 0;
 
   fat_t *fat = file->fs->data;
-  dirent_t *dirent = read_dirent(fat, file->dirent_index);
-  if (!dirent)
+  dirent_t dirent;
+  if (read_dirent(fat, file->dirent_index, &dirent) < 0)
     return -1;
 
-  dirent->file_size = file->size;
-  dirent->first_cluster_hi = file->cluster_start >> (CLUSTER_BITS / 2);
-  dirent->first_cluster_lo = file->cluster_start & 0xFF;
-  write_dirent(fat, dirent, file->dirent_index);
+  dirent.file_size = file->size;
+  dirent.first_cluster_hi = file->cluster_start >> (CLUSTER_BITS / 2);
+  dirent.first_cluster_lo = file->cluster_start & 0xFF;
+  write_dirent(fat, &dirent, file->dirent_index);
 
   return 0;
 }
 
+static uint32_t cluster_sector(const fat_t *fat, cluster_t cluster) {
+  return fat->data_start +
+         (cluster - CLUSTER_START_NO) * fat->sectors_per_cluster;
+}
+
+/*
+ * A read continuing the previous one doubles the window, and any other read
+ * closes it. Once half of the window has been consumed, the clusters up to a
+ * window after the position are queued to the buffer cache, a request per run
+ * of consecutive clusters.
+ */
+static void fat_readahead(fat_t *fat, file_t *file, uint32_t start_pos) {
+  if (start_pos != file->ra_pos) {
+    file->ra_window = file->ra_end = 0;
+    file->ra_pos = file->pos;
+    return;
+  }
+
+  // Large clusters mustn't let the window evict the blocks just read
+  const uint32_t max_window =
+      max(min((uint32_t)FAT_RA_MAX_CLUSTERS,
+              (uint32_t)FAT_RA_MAX_BLOCKS / fat->sectors_per_cluster),
+          (uint32_t)1);
+
+  file->ra_pos = file->pos;
+  if (!file->ra_window)
+    file->ra_window = min((uint32_t)FAT_RA_MIN_CLUSTERS, max_window);
+  else
+    file->ra_window = min(file->ra_window * 2, max_window);
+
+  const uint32_t curr = file->pos / fat->bytes_per_cluster;
+  const uint32_t last = (file->size + fat->bytes_per_cluster - 1) /
+                        fat->bytes_per_cluster; // after the last cluster
+  if (file->ra_end > curr + file->ra_window / 2)
+    return;
+
+  const uint32_t end = min(curr + 1 + file->ra_window, last);
+  cluster_t cluster = file->curr_cluster;
+  cluster_t run_start = FAT_CLUSTER_INVALID;
+  uint32_t run_len = 0;
+  for (uint32_t idx = curr + 1; idx < end; idx++) {
+    cluster = get_next_cluster(fat, cluster);
+    if (!is_cluster_valid(cluster))
+      break;
+
+    if (idx < file->ra_end)
+      continue; // queued before
+
+    if (run_len && cluster == run_start + run_len) {
+      run_len++;
+      continue;
+    }
+
+    if (run_len)
+      bcache_readahead(fat->fs->dev_id, cluster_sector(fat, run_start),
+                       run_len * fat->sectors_per_cluster);
+
+    run_start = cluster;
+    run_len = 1;
+  }
+
+  if (run_len)
+    bcache_readahead(fat->fs->dev_id, cluster_sector(fat, run_start),
+                     run_len * fat->sectors_per_cluster);
+
+  file->ra_end = max(file->ra_end, end);
+}
+
 int fatfs_read(void *buf, size_t size, file_t *file) {
   fat_t *fat = file->fs->data;
+  const uint32_t start_pos = file->pos;
 
   if (file->pos + size > file->size)
     size = file->size - file->pos;
@@ -335,40 +428,51 @@ int fatfs_read(void *buf, size_t size, file_t *file) {
         (file->curr_cluster - CLUSTER_START_NO) * fat->sectors_per_cluster;
 
     /*
-     * if - The number of read clusters is a integer, and the starting position
-     * is at the end(start) of a cluster.
+     * if - The position is at the start of a sector, and at least one whole
+     * sector is requested: copy all the whole sectors left in the run of
+     * consecutive clusters from the cache, filling the missing ones straight
+     * into buf by one request.
      *
-     * else - The number of read clusters is not a integer, or the starting
-     * position is in the middle of a cluster.
+     * else - The position is in the middle of a sector, or less than a sector
+     * is requested: copy from the cached sector.
      */
-    if (!cluster_offset && curr_read_bytes == fat->bytes_per_cluster) {
-      if (dev_read(fat->fs->dev_id, start_sector, buf,
-                   fat->sectors_per_cluster) < 0) {
+    const uint32_t sector_offset = cluster_offset % fat->bytes_per_sector;
+    const uint32_t sector_no =
+        start_sector + cluster_offset / fat->bytes_per_sector;
+    cluster_t last = file->curr_cluster;
+    if (!sector_offset && curr_read_bytes >= fat->bytes_per_sector) {
+      uint32_t run_bytes;
+      last = cluster_run(fat, file->curr_cluster, cluster_offset,
+                         curr_read_bytes, &run_bytes);
+      const uint32_t sectors =
+          min(curr_read_bytes, run_bytes) / fat->bytes_per_sector;
+      if (bcache_read(fat->fs->dev_id, sector_no, buf, sectors) <
+          (int)sectors) {
         return read_bytes;
       }
 
-      curr_read_bytes = fat->bytes_per_cluster;
+      curr_read_bytes = sectors * fat->bytes_per_sector;
     } else {
-      if (cluster_offset + curr_read_bytes > fat->bytes_per_cluster)
-        curr_read_bytes = fat->bytes_per_cluster - cluster_offset;
+      if (sector_offset + curr_read_bytes > fat->bytes_per_sector)
+        curr_read_bytes = fat->bytes_per_sector - sector_offset;
 
-      fat->curr_sector = -1;
-      if (dev_read(fat->fs->dev_id, start_sector, fat->fat_buf,
-                   fat->sectors_per_cluster) < 0) {
+      bcache_buf_t *sector_buf = bcache_get(fat->fs->dev_id, sector_no);
+      if (!sector_buf)
         return read_bytes;
-      }
 
-      kernel_memcpy(buf, fat->fat_buf + cluster_offset, curr_read_bytes);
+      kernel_memcpy(buf, sector_buf->data + sector_offset, curr_read_bytes);
+      bcache_put(sector_buf);
     }
 
     buf += curr_read_bytes;
     size -= curr_read_bytes;
     read_bytes += curr_read_bytes;
 
-    if (move_file_pos(file, fat, curr_read_bytes, FALSE) < 0)
+    if (move_file_run(file, fat, last, curr_read_bytes, FALSE) < 0)
       return read_bytes;
   }
 
+  fat_readahead(fat, file, start_pos);
   return read_bytes;
 }
 
@@ -387,34 +491,41 @@ int fatfs_write(const void *buf, size_t size, file_t *file) {
         (file->curr_cluster - CLUSTER_START_NO) * fat->sectors_per_cluster;
 
     /*
-     * if - The number of read clusters is a integer, and the starting position
-     * is at the end(start) of a cluster.
+     * if - The position is at the start of a sector, and at least one whole
+     * sector is written: copy all the whole sectors left in the run of
+     * consecutive clusters to the cache, without reading them. The flusher
+     * writes the run back by large requests.
      *
-     * else - The number of read clusters is not a integer, or the starting
-     * position is in the middle of a cluster.
+     * else - The position is in the middle of a sector, or less than a sector
+     * is written: update the cached sector.
      */
-    if (!cluster_offset && curr_written_bytes == fat->bytes_per_cluster) {
-      if (dev_write(fat->fs->dev_id, start_sector, buf,
-                    fat->sectors_per_cluster) < 0) {
+    const uint32_t sector_offset = cluster_offset % fat->bytes_per_sector;
+    const uint32_t sector_no =
+        start_sector + cluster_offset / fat->bytes_per_sector;
+    cluster_t last = file->curr_cluster;
+    if (!sector_offset && curr_written_bytes >= fat->bytes_per_sector) {
+      uint32_t run_bytes;
+      last = cluster_run(fat, file->curr_cluster, cluster_offset,
+                         curr_written_bytes, &run_bytes);
+      const uint32_t sectors =
+          min(curr_written_bytes, run_bytes) / fat->bytes_per_sector;
+      if (bcache_write(fat->fs->dev_id, sector_no, buf, sectors) <
+          (int)sectors) {
         return written_bytes;
       }
 
-      curr_written_bytes = fat->bytes_per_cluster;
+      curr_written_bytes = sectors * fat->bytes_per_sector;
     } else {
-      if (cluster_offset + curr_written_bytes > fat->bytes_per_cluster)
-        curr_written_bytes = fat->bytes_per_cluster - cluster_offset;
+      if (sector_offset + curr_written_bytes > fat->bytes_per_sector)
+        curr_written_bytes = fat->bytes_per_sector - sector_offset;
 
-      fat->curr_sector = -1;
-      if (dev_read(fat->fs->dev_id, start_sector, fat->fat_buf,
-                   fat->sectors_per_cluster) < 0) {
+      bcache_buf_t *sector_buf = bcache_get(fat->fs->dev_id, sector_no);
+      if (!sector_buf)
         return written_bytes;
-      }
 
-      kernel_memcpy(fat->fat_buf + cluster_offset, buf, curr_written_bytes);
-      if (dev_write(fat->fs->dev_id, start_sector, fat->fat_buf,
-                    fat->sectors_per_cluster) < 0) {
-        return written_bytes;
-      }
+      kernel_memcpy(sector_buf->data + sector_offset, buf, curr_written_bytes);
+      bcache_mark_dirty(sector_buf);
+      bcache_put(sector_buf);
     }
 
     buf += curr_written_bytes;
@@ -422,7 +533,7 @@ int fatfs_write(const void *buf, size_t size, file_t *file) {
     written_bytes += curr_written_bytes;
     file->size += curr_written_bytes;
 
-    if (move_file_pos(file, fat, curr_written_bytes, TRUE) < 0)
+    if (move_file_run(file, fat, last, curr_written_bytes, TRUE) < 0)
       return written_bytes;
   }
 
@@ -460,7 +571,8 @@ int fatfs_seek(file_t *file, uint32_t offset, int dir) {
 
 int fatfs_stat(file_t *file, struct stat *stat) { return -1; }
 
-void cluster_unlink(fat_t *fat, const dirent_t *prev, const dirent_t *curr) {
+void cluster_unlink(fat_t *fat, const dirent_t *prev, const dirent_t *curr,
+                    const dirent_t *next) {
   size_t prev_cluster =
       get_cluster_no(prev) + prev->file_size / fat->bytes_per_cluster;
   size_t curr_cluster = get_cluster_no(curr);
@@ -472,32 +584,33 @@ void cluster_unlink(fat_t *fat, const dirent_t *prev, const dirent_t *curr) {
     curr_cluster = tmp_next;
   }
 
-  const dirent_t *next = get_next_dirent(fat, curr);
   set_next_cluster(fat, prev_cluster, get_cluster_no(next));
 }
 
 int fatfs_unlink(fs_t *fs, const char *path) {
   fat_t *fat = fs->data;
 
-  dirent_t *prev_dirent = read_dirent(fat, 0);
-  dirent_t *curr_dirent = get_next_dirent(fat, prev_dirent);
-  if (!prev_dirent)
+  dirent_t prev_dirent, curr_dirent, next_dirent;
+  if (read_dirent(fat, 0, &prev_dirent) < 0)
     return -1; // prev_dirent matches?
 
   for (size_t i = 0; i < fat->root_entries - 2; i++) {
-    if (!prev_dirent || !curr_dirent)
+    if (read_dirent(fat, i + 1, &curr_dirent) < 0)
       return -1;
 
-    if (*curr_dirent->filename == DIRENT_NAME_END)
+    if (*curr_dirent.filename == DIRENT_NAME_END)
       break;
 
-    if (*curr_dirent->filename == DIRENT_NAME_FREE)
+    if (*curr_dirent.filename == DIRENT_NAME_FREE)
       continue;
 
     char curr_filename[FAT_FILENAME_LEN + 2]; // '.' & '\0'
-    dirent_get_name(curr_dirent, curr_filename);
+    dirent_get_name(&curr_dirent, curr_filename);
     if (streq(kernel_strlwr(curr_filename), path)) {
-      cluster_unlink(fat, prev_dirent, curr_dirent);
+      if (read_dirent(fat, i + 2, &next_dirent) < 0)
+        return -1;
+
+      cluster_unlink(fat, &prev_dirent, &curr_dirent, &next_dirent);
 
       dirent_t null_dirent;
       kernel_memset(&null_dirent, 0, sizeof(dirent_t));
@@ -505,7 +618,6 @@ int fatfs_unlink(fs_t *fs, const char *path) {
     }
 
     prev_dirent = curr_dirent;
-    curr_dirent = get_next_dirent(fat, curr_dirent);
   }
 
   // When i = fat->root_entries
@@ -540,18 +652,23 @@ file_type_t dirent_get_type(const dirent_t *dirent) {
   return dirent->file_attr & DIRENT_DIR ? DIR_FILE : NORMAL_FILE;
 }
 
-dirent_t *read_dirent(fat_t *fat, size_t index) {
+// Copy the entry out of the cache, whose buffers may be reused afterwards
+int read_dirent(fat_t *fat, size_t index, dirent_t *dirent) {
   if (index > fat->root_entries)
-    return NULL;
+    return -1;
 
   // DBR - FAT1 - FAT2 - Root directory - File data
   const size_t offset = index * sizeof(dirent_t);
   const size_t sector_no = fat->root_start + offset / fat->bytes_per_sector;
 
-  if (buf_read_sector(fat, sector_no) < 0)
-    return NULL;
+  bcache_buf_t *buf = bcache_get(fat->fs->dev_id, sector_no);
+  if (!buf)
+    return -1;
 
-  return (dirent_t *)(fat->fat_buf + offset % fat->bytes_per_sector);
+  kernel_memcpy(dirent, buf->data + offset % fat->bytes_per_sector,
+                sizeof(dirent_t));
+  bcache_put(buf);
+  return 0;
 }
 
 int write_dirent(fat_t *fat, const dirent_t *dirent, size_t index) {
@@ -562,13 +679,15 @@ int write_dirent(fat_t *fat, const dirent_t *dirent, size_t index) {
   const size_t offset = index * sizeof(dirent_t);
   const size_t sector_no = fat->root_start + offset / fat->bytes_per_sector;
 
-  const int err = buf_read_sector(fat, sector_no);
-  if (err < 0)
-    return err;
+  bcache_buf_t *buf = bcache_get(fat->fs->dev_id, sector_no);
+  if (!buf)
+    return -1;
 
-  kernel_memcpy(fat->fat_buf + offset % fat->bytes_per_sector, dirent,
+  kernel_memcpy(buf->data + offset % fat->bytes_per_sector, dirent,
                 sizeof(dirent_t));
-  return buf_write_sector(fat, sector_no);
+  bcache_mark_dirty(buf);
+  bcache_put(buf);
+  return 0;
 }
 
 int fatfs_opendir(fs_t *fs, const char *name, DIR *dir) {
@@ -578,30 +697,32 @@ int fatfs_opendir(fs_t *fs, const char *name, DIR *dir) {
 
 int fatfs_readdir(fs_t *fs, DIR *dir, struct dirent *dirent) {
   fat_t *fat = fs->data;
+  int err = -1;
 
   while (dir->index < fat->root_entries) {
-    const dirent_t *curr_dirent = read_dirent(fat, dir->index);
-    if (!curr_dirent)
-      return -1;
+    dirent_t curr_dirent;
+    if (read_dirent(fat, dir->index, &curr_dirent) < 0)
+      break;
 
-    if (*curr_dirent->filename == DIRENT_NAME_END)
+    if (*curr_dirent.filename == DIRENT_NAME_END)
       break;
 
-    if (*curr_dirent->filename != DIRENT_NAME_FREE) {
-      file_type_t type = dirent_get_type(curr_dirent);
+    if (*curr_dirent.filename != DIRENT_NAME_FREE) {
+      file_type_t type = dirent_get_type(&curr_dirent);
       if (type == NORMAL_FILE || type == DIR_FILE) {
-        dirent_get_name(curr_dirent, dirent->name);
-        dirent->size = curr_dirent->file_size;
+        dirent_get_name(&curr_dirent, dirent->name);
+        dirent->size = curr_dirent.file_size;
         dirent->type = type;
         dirent->index = dir->index++;
-        return 0;
+        err = 0;
+        break;
       }
     }
 
     dir->index++;
   }
 
-  return -1;
+  return err;
 }
 
 int fatfs_closedir(fs_t *fs, DIR *dir) { return 0; }
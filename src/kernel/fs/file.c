@@ -4,6 +4,7 @@
 
 #include "fs/file.h"
 #include "ipc/mutex.h"
+#include "ipc/mutex_stat.h"
 #include "tools/klib.h"
 
 static file_t file_table[FILE_TABLE_SIZE];
@@ -17,6 +18,7 @@ file_t *file_alloc() {
     file_t *curr_file = file_table + i;
     if (!curr_file->ref) {
       kernel_memset(curr_file, 0, sizeof(file_t));
+      mutex_init(&curr_file->mutex);
       curr_file->ref = 1;
       file = curr_file;
       break;
@@ -37,6 +39,7 @@ void file_free(file_t *file) {
 
 void file_table_init() {
   mutex_init(&file_alloc_mutex);
+  mutex_stat_add(&file_alloc_mutex, "file table");
   kernel_memset(file_table, 0, sizeof(file_table));
 }
 
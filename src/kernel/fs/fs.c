@@ -4,9 +4,13 @@
 
 #include "fs/fs.h"
 #include "dev/dev.h"
+#include "fs/bcache.h"
+#include "fs/pipe.h"
+#include "fs/poll.h"
 #include "os_cfg.h"
 #include "tools/klib.h"
 #include "tools/log.h"
+#include <errno.h>
 #include <sys/file.h>
 
 static list_t mounted_list;
@@ -17,18 +21,25 @@ static fs_t *root_fs;
 extern fs_api_t devfs_api;
 extern fs_api_t fatfs_api;
 
+// Exclusive for the operations which may change the metadata
 static void fs_protect(fs_t *fs) {
-  if (fs->mutex)
-    mutex_lock(fs->mutex);
+  if (fs->rwlock)
+    rwlock_write_lock(fs->rwlock);
+}
+
+// Shared for the read-only operations
+static void fs_protect_shared(fs_t *fs) {
+  if (fs->rwlock)
+    rwlock_read_lock(fs->rwlock);
 }
 
 static void fs_unprotect(fs_t *fs) {
-  if (fs->mutex)
-    mutex_unlock(fs->mutex);
+  if (fs->rwlock)
+    rwlock_unlock(fs->rwlock);
 }
 
 int sys_open(const char *path, flag_t flag, ...) {
-  _cleanup_file_ file_t *file = file_alloc();
+  file_t *file = file_alloc();
   if (!file)
     return -1;
 
@@ -54,7 +65,11 @@ int sys_open(const char *path, flag_t flag, ...) {
   file->mode = flag;
   file->fs = fs;
 
-  fs_protect(fs);
+  if (flag & (O_CREAT | O_TRUNC))
+    fs_protect(fs);
+  else
+    fs_protect_shared(fs);
+
   if (fs->fs_api->open(fs, path, file) < 0) {
     fs_unprotect(fs);
     goto open_failed;
@@ -67,59 +82,132 @@ open_failed:
   if (fd >= 0)
     task_remove_fd(fd);
 
+  file_free(file);
   return -1;
 }
 
-ssize_t sys_read(int fd, void *buf, size_t len) {
-  file_t *file = task_file(fd);
-  if (!file || !buf || !len)
-    return -1;
+// The tasks which must stay stoppable, e.g. I/O ring workers, never block
+_Bool file_nonblock(const file_t *file) {
+  const task_t *curr = get_curr_task();
+  return (file->mode & O_NONBLOCK) || (curr && curr->io_nonblock);
+}
 
+/*
+ * A O_NONBLOCK file fails with -EAGAIN instead of blocking if it isn't ready.
+ * A closed peer or an invalid device doesn't block, and is left to the file
+ * system to report.
+ */
+static _Bool fs_would_block(file_t *file, int events) {
+  return file_nonblock(file) &&
+         !(file_poll(file) & (events | POLLERR | POLLHUP | POLLNVAL));
+}
+
+/*
+ * Serialize the tasks sharing the position of a file. A TTY or a pipe keeps
+ * no position and may block for long, e.g. a shared stdin waiting for input,
+ * so it isn't locked, and serializes the transfers by itself.
+ */
+static void file_lock_pos(file_t *file) {
+  if (file->type != TTY_FILE && file->type != PIPE_FILE)
+    mutex_lock(&file->mutex);
+}
+
+static void file_unlock_pos(file_t *file) {
+  if (file->type != TTY_FILE && file->type != PIPE_FILE)
+    mutex_unlock(&file->mutex);
+}
+
+ssize_t fs_read(file_t *file, void *buf, size_t len) {
   fs_t *fs = file->fs;
-  fs_protect(fs);
+  file_lock_pos(file);
+  if (fs_would_block(file, POLLIN)) {
+    file_unlock_pos(file);
+    return -EAGAIN;
+  }
+
+  fs_protect_shared(fs);
   const int err = fs->fs_api->read(buf, len, file);
   fs_unprotect(fs);
+  file_unlock_pos(file);
   return err;
 }
 
-ssize_t sys_write(int fd, const void *buf, size_t len) {
+ssize_t sys_read(int fd, void *buf, size_t len) {
   file_t *file = task_file(fd);
   if (!file || !buf || !len)
     return -1;
 
-  if (file->mode == O_RDONLY) {
+  return fs_read(file, buf, len);
+}
+
+ssize_t fs_write(file_t *file, const void *buf, size_t len) {
+  if (file_acc_mode(file) == O_RDONLY) {
     log_printf("File is read-only!");
     return -1;
   }
 
   fs_t *fs = file->fs;
+  file_lock_pos(file);
+  if (fs_would_block(file, POLLOUT)) {
+    file_unlock_pos(file);
+    return -EAGAIN;
+  }
+
   fs_protect(fs);
   const int err = fs->fs_api->write(buf, len, file);
   fs_unprotect(fs);
+  file_unlock_pos(file);
   return err;
 }
 
-int sys_lseek(int fd, int offset, int whence) {
+/*
+ * Read or write at offset, keeping the position of the file for the other
+ * tasks sharing it, like pread/pwrite.
+ */
+ssize_t fs_rw_at(file_t *file, void *buf, size_t len, int offset,
+                 _Bool write) {
+  file_lock_pos(file);
+  const int pos = file->pos;
+  int err = fs_seek(file, offset, 0);
+  if (err >= 0) {
+    err = write ? fs_write(file, buf, len) : fs_read(file, buf, len);
+    fs_seek(file, pos, 0);
+  }
+
+  file_unlock_pos(file);
+  return err;
+}
+
+ssize_t sys_write(int fd, const void *buf, size_t len) {
   file_t *file = task_file(fd);
-  if (!file) {
-    log_printf("File descriptor is invalid or file is not opened!");
+  if (!file || !buf || !len)
     return -1;
-  }
 
+  return fs_write(file, buf, len);
+}
+
+int fs_seek(file_t *file, int offset, int whence) {
   fs_t *fs = file->fs;
-  fs_protect(fs);
+  mutex_lock(&file->mutex);
+  fs_protect_shared(fs);
   const int err = fs->fs_api->seek(file, offset, whence);
   fs_unprotect(fs);
+  mutex_unlock(&file->mutex);
   return err;
 }
 
-int sys_close(int fd) {
+int sys_lseek(int fd, int offset, int whence) {
   file_t *file = task_file(fd);
   if (!file) {
     log_printf("File descriptor is invalid or file is not opened!");
     return -1;
   }
 
+  return fs_seek(file, offset, whence);
+}
+
+// Drop a reference to the file, and close it when nobody refers to it
+void fs_close(file_t *file) {
   ASSERT(file->ref > 0);
   if (--file->ref == 0) {
     fs_t *fs = file->fs;
@@ -128,7 +216,16 @@ int sys_close(int fd) {
     fs_unprotect(fs);
     file_free(file);
   }
+}
 
+int sys_close(int fd) {
+  file_t *file = task_file(fd);
+  if (!file) {
+    log_printf("File descriptor is invalid or file is not opened!");
+    return -1;
+  }
+
+  fs_close(file);
   task_remove_fd(fd);
   return 0;
 }
@@ -140,16 +237,41 @@ int sys_ioctl(int fd, int cmd, void *arg0, void *arg1) {
     return -1;
   }
 
+  if (cmd == FIONBIO) // common to all files
+    return sys_fcntl(fd, F_SETFL,
+                     arg0 ? file->mode | O_NONBLOCK : file->mode & ~O_NONBLOCK);
+
   fs_t *fs = file->fs;
-  fs_protect(fs);
   if (!fs->fs_api->ioctl)
     return -1;
 
+  fs_protect(fs);
   const int err = fs->fs_api->ioctl(file, cmd, arg0, arg1);
   fs_unprotect(fs);
   return err;
 }
 
+// Only O_NONBLOCK can be changed by F_SETFL
+int sys_fcntl(int fd, int cmd, int arg) {
+  file_t *file = task_file(fd);
+  if (!file) {
+    log_printf("File descriptor is invalid or file is not opened!");
+    return -1;
+  }
+
+  switch (cmd) {
+  case F_GETFL:
+    return file->mode;
+  case F_SETFL:
+    mutex_lock(&file->mutex);
+    file->mode = (file->mode & ~O_NONBLOCK) | (arg & O_NONBLOCK);
+    mutex_unlock(&file->mutex);
+    return 0;
+  default:
+    return -1;
+  }
+}
+
 int sys_isatty(int fd) {
   file_t *file = task_file(fd);
   if (!file) {
@@ -169,7 +291,7 @@ int sys_fstat(int fd, struct stat *buf) {
 
   fs_t *fs = file->fs;
   kernel_memset(buf, 0, sizeof(struct stat));
-  fs_protect(fs);
+  fs_protect_shared(fs);
   const int err = fs->fs_api->stat(file, buf);
   fs_unprotect(fs);
   return err;
@@ -239,6 +361,9 @@ mount_failed:
 void fs_init() {
   mounted_list_init();
   file_table_init();
+  bcache_init();
+  pipe_init();
+  poll_init();
 
   fs_t *fs = mount(DEVFS, "/dev", 0, 0);
   ASSERT(fs != NULL);
@@ -247,6 +372,22 @@ void fs_init() {
   ASSERT(root_fs != NULL);
 }
 
+/*
+ * Write back and unmount the file systems before powering off or rebooting.
+ * Their locks are kept, so that no task changes them afterwards.
+ */
+void fs_shutdown() {
+  for (list_node_t *node = list_first(&mounted_list); node;
+       node = list_node_next(node)) {
+    fs_t *fs = list_node_parent(node, fs_t, node);
+    fs_protect(fs);
+    if (fs->fs_api->unmount(fs) < 0)
+      log_printf("Failed to unmount %s!", fs->mount_point);
+  }
+
+  bcache_sync(-1);
+}
+
 int sys_dup(int fd) {
   file_t *file = task_file(fd);
   if (!file) {
@@ -265,6 +406,24 @@ int sys_dup(int fd) {
   return -1;
 }
 
+// Make new_fd refer to the file of old_fd, closing the file new_fd refers to
+int sys_dup2(int old_fd, int new_fd) {
+  file_t *file = task_file(old_fd);
+  if (!file || new_fd < 0 || new_fd >= TASK_FILE_NUM) {
+    log_printf("The dup2 system call for fd = %d is invalid!", old_fd);
+    return -1;
+  }
+
+  if (new_fd == old_fd)
+    return new_fd;
+
+  if (task_file(new_fd))
+    sys_close(new_fd);
+
+  file_ref_inc(file);
+  return task_set_fd(new_fd, file);
+}
+
 int sys_unlink(const char *pathname) {
   fs_protect(root_fs);
   const int err = root_fs->fs_api->unlink(root_fs, pathname);
@@ -273,21 +432,21 @@ int sys_unlink(const char *pathname) {
 }
 
 int sys_opendir(const char *name, DIR *dir) {
-  fs_protect(root_fs);
+  fs_protect_shared(root_fs);
   const int err = root_fs->fs_api->opendir(root_fs, name, dir);
   fs_unprotect(root_fs);
   return err;
 }
 
 int sys_readdir(DIR *dir, struct dirent *dirent) {
-  fs_protect(root_fs);
+  fs_protect_shared(root_fs);
   const int err = root_fs->fs_api->readdir(root_fs, dir, dirent);
   fs_unprotect(root_fs);
   return err;
 }
 
 int sys_closedir(DIR *dir) {
-  fs_protect(root_fs);
+  fs_protect_shared(root_fs);
   const int err = root_fs->fs_api->closedir(root_fs, dir);
   fs_unprotect(root_fs);
   return err;
@@ -0,0 +1,259 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fs/io_ring.h"
+#include "core/memory.h"
+#include "cpu/irq.h"
+#include "fs/fs.h"
+#include "fs/poll.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <errno.h>
+
+/*
+ * Every ring is served by a kernel thread sharing the page table of its owner,
+ * which performs the submitted entries in order, so that the owner can keep
+ * running while the file, disk or TTY operations are in progress.
+ */
+static io_ring_ctx_t ctx_table[IO_RING_NUM];
+static mutex_t ctx_table_mutex;
+
+void io_ring_init() {
+  kernel_memset(ctx_table, 0, sizeof(ctx_table));
+  mutex_init(&ctx_table_mutex);
+}
+
+static io_ring_ctx_t *alloc_ctx() {
+  mutex_lock(&ctx_table_mutex);
+
+  io_ring_ctx_t *ctx = NULL;
+  for (int i = 0; i < IO_RING_NUM; i++) {
+    if (!ctx_table[i].owner) {
+      ctx = ctx_table + i;
+      kernel_memset(ctx, 0, sizeof(io_ring_ctx_t));
+      ctx->owner = get_curr_task();
+      break;
+    }
+  }
+
+  mutex_unlock(&ctx_table_mutex);
+  return ctx;
+}
+
+static void free_ctx(io_ring_ctx_t *ctx) {
+  mutex_lock(&ctx_table_mutex);
+  ctx->owner = NULL;
+  mutex_unlock(&ctx_table_mutex);
+}
+
+// Check that the range is mapped in the user space of the owner
+static _Bool user_is_mapped(const io_ring_ctx_t *ctx, const void *addr,
+                            uint32_t size) {
+  const uint32_t start = (uint32_t)addr;
+  const uint32_t end = start + size;
+  if (start < MEM_TASK_BASE || end < start)
+    return FALSE;
+
+  for (uint32_t page = down2(start, MEM_PAGE_SIZE); page < end;
+       page += MEM_PAGE_SIZE) {
+    if (!memory_get_paddr(ctx->owner->tss.cr3, page))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * The worker never blocks in a file (io_nonblock), but waits until the file
+ * is ready, so that io_ring_destroy can stop it by exiting. A read completes
+ * with the data available, a write once all the data is written, unless the
+ * file itself is O_NONBLOCK.
+ */
+static int io_ring_rw(io_ring_ctx_t *ctx, file_t *file, const io_sqe_t *sqe) {
+  const _Bool write = sqe->opcode == IO_RING_WRITE;
+  uint32_t done = 0;
+
+  for (;;) {
+    uint8_t *buf = (uint8_t *)sqe->buf + done;
+    const uint32_t len = sqe->len - done;
+    int err;
+    if (sqe->offset >= 0)
+      err = fs_rw_at(file, buf, len, sqe->offset + done, write);
+    else
+      err = write ? fs_write(file, buf, len) : fs_read(file, buf, len);
+
+    if (err == -EAGAIN && !(file->mode & O_NONBLOCK)) {
+      if (poll_wait_file(file, write ? POLLOUT : POLLIN, &ctx->exiting) < 0)
+        return done ? (int)done : -EINTR;
+
+      continue;
+    }
+
+    if (err <= 0)
+      return done ? (int)done : err;
+
+    done += err;
+    if (!write || done == sqe->len)
+      return done;
+  }
+}
+
+static int io_ring_do(io_ring_ctx_t *ctx, const io_sqe_t *sqe) {
+  if (sqe->opcode == IO_RING_NOP)
+    return 0;
+
+  if (sqe->opcode != IO_RING_READ && sqe->opcode != IO_RING_WRITE)
+    return -1;
+
+  if (sqe->fd < 0 || sqe->fd >= TASK_FILE_NUM)
+    return -1;
+
+  // The worker runs in ring 0, so the buffer mustn't reach the kernel
+  if (!sqe->len || !user_is_mapped(ctx, sqe->buf, sqe->len))
+    return -1;
+
+  file_t *file = ctx->owner->file_table[sqe->fd];
+  if (!file)
+    return -1;
+
+  file_ref_inc(file); // the owner may close the fd in the meantime
+  const int err = io_ring_rw(ctx, file, sqe);
+  fs_close(file);
+  return err;
+}
+
+static void io_ring_worker(void *arg) {
+  io_ring_ctx_t *ctx = arg;
+  get_curr_task()->io_nonblock = TRUE;
+  io_ring_t *ring = ctx->ring;
+  const uint32_t mask = ctx->entries - 1;
+  // The layout comes from ctx, as the owner may rewrite ring->entries
+  io_sqe_t *sqes = io_ring_sqes(ring);
+  io_cqe_t *cqes = (io_cqe_t *)(sqes + ctx->entries);
+
+  while (!ctx->exiting) {
+    sem_wait(&ctx->sq_sem);
+
+    // Stop when the completion queue is full until the owner consumes it
+    while (!ctx->exiting && ring->sq_head != ring->sq_tail &&
+           ring->cq_tail - ring->cq_head < ctx->entries) {
+      const io_sqe_t sqe = sqes[ring->sq_head & mask];
+      ring->sq_head++;
+
+      io_cqe_t *cqe = cqes + (ring->cq_tail & mask);
+      cqe->user_data = sqe.user_data;
+      cqe->res = io_ring_do(ctx, &sqe);
+      ring->cq_tail++;
+
+      wait_queue_wake(&ctx->cq_wait, TASK_NUM);
+    }
+  }
+
+  // Block before waking the owner, which destroys this thread at once
+  irq_protect();
+  task_set_block(get_curr_task());
+  ctx->done = TRUE;
+  wait_queue_wake(&ctx->cq_wait, TASK_NUM);
+}
+
+
+int sys_io_ring_setup(io_ring_t *ring, uint32_t entries) {
+  task_t *curr = get_curr_task();
+  if (curr->io_ring) {
+    log_printf("The task has set up an I/O ring already!");
+    return -1;
+  }
+
+  if (!entries || entries > IO_RING_MAX_ENTRIES ||
+      (entries & (entries - 1))) {
+    log_printf("Invalid I/O ring entries: %d", entries);
+    return -1;
+  }
+
+  io_ring_ctx_t *ctx = alloc_ctx();
+  if (!ctx) {
+    log_printf("No free I/O ring!");
+    return -1;
+  }
+
+  if ((uint32_t)ring % sizeof(uint32_t) ||
+      !user_is_mapped(ctx, ring, io_ring_size(entries))) {
+    log_printf("Invalid I/O ring address: 0x%x", ring);
+    free_ctx(ctx);
+    return -1;
+  }
+
+  ring->entries = ctx->entries = entries;
+  ring->sq_head = ring->sq_tail = ring->cq_head = ring->cq_tail = 0;
+  ctx->ring = ring;
+  sem_init(&ctx->sq_sem, 0);
+  wait_queue_init(&ctx->cq_wait);
+
+  ctx->worker = task_create_kthread("I/O Ring", curr->tss.cr3, io_ring_worker,
+                                    ctx);
+  if (!ctx->worker) {
+    free_ctx(ctx);
+    return -1;
+  }
+
+  curr->io_ring = ctx;
+  return 0;
+}
+
+/*
+ * Hand the submitted entries to the worker,
+ * and wait until at least min_complete completions are available.
+ * Return the number of available completions.
+ */
+int sys_io_ring_enter(uint32_t to_submit, uint32_t min_complete) {
+  io_ring_ctx_t *ctx = get_curr_task()->io_ring;
+  if (!ctx)
+    return -1;
+
+  const io_ring_t *ring = ctx->ring;
+  min_complete = min(min_complete, ctx->entries);
+
+  // Also sent without new entries, as the worker may wait for free completions
+  if (to_submit || min_complete)
+    sem_notify(&ctx->sq_sem);
+
+  const irq_state_t state = irq_protect();
+
+  while (ring->cq_tail - ring->cq_head < min_complete) {
+    list_insert_last(&ctx->cq_wait.wait_list, &get_curr_task()->wait_node);
+    wait_block(&ctx->cq_wait.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+  return ring->cq_tail - ring->cq_head;
+}
+
+/*
+ * Stop the worker of the ring set up by the task, and release the ring.
+ * An entry waiting for its file is completed with -EINTR, any other one
+ * being performed is completed first.
+ */
+void io_ring_destroy(task_t *task) {
+  io_ring_ctx_t *ctx = task->io_ring;
+  if (!ctx)
+    return;
+
+  ctx->exiting = TRUE;
+  sem_notify(&ctx->sq_sem);
+  poll_notify(); // may be waiting in poll_wait_file
+
+  const irq_state_t state = irq_protect();
+
+  while (!ctx->done) {
+    list_insert_last(&ctx->cq_wait.wait_list, &task->wait_node);
+    wait_block(&ctx->cq_wait.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+
+  task_destroy_kthread(ctx->worker);
+  task->io_ring = NULL;
+  free_ctx(ctx);
+}
@@ -0,0 +1,350 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fs/pipe.h"
+#include "cpu/irq.h"
+#include "fs/fs.h"
+#include "fs/poll.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <errno.h>
+#include <sys/file.h>
+
+static pipe_t pipe_table[PIPE_NUM];
+static mutex_t pipe_table_mutex;
+
+static int pipefs_close(file_t *file);
+static int pipefs_read(void *buf, size_t size, file_t *file);
+static int pipefs_write(const void *buf, size_t size, file_t *file);
+static int pipefs_seek(file_t *file, uint32_t offset, int dir);
+static int pipefs_stat(file_t *file, struct stat *stat);
+static int pipefs_poll(file_t *file);
+
+static fs_api_t pipefs_api = {.close = pipefs_close,
+                              .read = pipefs_read,
+                              .write = pipefs_write,
+                              .seek = pipefs_seek,
+                              .stat = pipefs_stat,
+                              .poll = pipefs_poll};
+
+// Never mounted, only referred by the files of both ends
+static fs_t pipe_fs = {
+    .mount_point = "pipe:", .type = PIPEFS, .fs_api = &pipefs_api};
+
+void pipe_init() {
+  kernel_memset(pipe_table, 0, sizeof(pipe_table));
+  mutex_init(&pipe_table_mutex);
+}
+
+static pipe_t *alloc_pipe() {
+  pipe_t *pipe = NULL;
+  mutex_lock(&pipe_table_mutex);
+
+  for (int i = 0; i < PIPE_NUM; i++) {
+    if (!pipe_table[i].buf) {
+      const uint32_t page = memory_alloc_page();
+      if (!page)
+        break;
+
+      pipe = pipe_table + i;
+      kernel_memset(pipe, 0, sizeof(pipe_t));
+      pipe->buf = (uint8_t *)page;
+      pipe->reader = pipe->writer = TRUE;
+      mutex_init(&pipe->read_mutex);
+      mutex_init(&pipe->write_mutex);
+      wait_queue_init(&pipe->read_wait);
+      wait_queue_init(&pipe->write_wait);
+      break;
+    }
+  }
+
+  mutex_unlock(&pipe_table_mutex);
+  return pipe;
+}
+
+static void free_pipe(pipe_t *pipe) {
+  mutex_lock(&pipe_table_mutex);
+  memory_free_page((uint32_t)pipe->buf);
+  pipe->buf = NULL;
+  mutex_unlock(&pipe_table_mutex);
+}
+
+/*
+ * Block until the pipe holds data, return 0 if the write end is closed,
+ * or if the pipe is empty and nonblock is set.
+ */
+static uint32_t pipe_wait_data(pipe_t *pipe, _Bool nonblock) {
+  const irq_state_t state = irq_protect();
+
+  while (pipe->head == pipe->tail && pipe->writer && !nonblock) {
+    list_insert_last(&pipe->read_wait.wait_list, &get_curr_task()->wait_node);
+    wait_block(&pipe->read_wait.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+  return pipe->head - pipe->tail;
+}
+
+/*
+ * Block until the pipe has free space, return 0 if the read end is closed,
+ * or if the pipe is full and nonblock is set.
+ */
+static uint32_t pipe_wait_space(pipe_t *pipe, _Bool nonblock) {
+  const irq_state_t state = irq_protect();
+
+  while (pipe->head - pipe->tail == PIPE_SIZE && pipe->reader && !nonblock) {
+    list_insert_last(&pipe->write_wait.wait_list, &get_curr_task()->wait_node);
+    wait_block(&pipe->write_wait.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+  return pipe->reader ? PIPE_SIZE - (pipe->head - pipe->tail) : 0;
+}
+
+/*
+ * The bytes are copied without disabling interrupts,
+ * only the index owned by the copying end is advanced afterwards.
+ */
+static void pipe_consume(pipe_t *pipe, uint32_t size) {
+  pipe->tail += size;
+  wait_queue_wake(&pipe->write_wait, TASK_NUM);
+  poll_notify();
+}
+
+static void pipe_produce(pipe_t *pipe, uint32_t size) {
+  pipe->head += size;
+  wait_queue_wake(&pipe->read_wait, TASK_NUM);
+  poll_notify();
+}
+
+// Return a part of the available data, or 0 if all writers are gone
+static int pipefs_read(void *buf, size_t size, file_t *file) {
+  if (file_acc_mode(file) != O_RDONLY)
+    return -1;
+
+  pipe_t *pipe = file->data;
+  for (;;) {
+    if (!pipe_wait_data(pipe, file_nonblock(file)))
+      return pipe->writer ? -EAGAIN : 0;
+
+    // Another reader may have taken the data before the mutex is acquired
+    mutex_lock(&pipe->read_mutex);
+    const uint32_t avail = pipe->head - pipe->tail;
+    if (avail) {
+      size = min(size, (size_t)avail);
+      const uint32_t offset = pipe->tail % PIPE_SIZE;
+      const uint32_t first = min(size, (size_t)(PIPE_SIZE - offset));
+      kernel_memcpy(buf, pipe->buf + offset, first);
+      kernel_memcpy((uint8_t *)buf + first, pipe->buf, size - first);
+
+      pipe_consume(pipe, size);
+      mutex_unlock(&pipe->read_mutex);
+      return size;
+    }
+
+    mutex_unlock(&pipe->read_mutex);
+  }
+}
+
+/*
+ * Block until all data is written, fail if the read end is closed.
+ * A O_NONBLOCK write stops when the pipe is full.
+ * Each chunk is copied as a whole, but the chunks of concurrent writers
+ * may interleave, as a write larger than the pipe does on Unix.
+ */
+static int pipefs_write(const void *buf, size_t size, file_t *file) {
+  pipe_t *pipe = file->data;
+  size_t written = 0;
+
+  while (written < size) {
+    if (!pipe_wait_space(pipe, file_nonblock(file)))
+      return written ? (int)written : (pipe->reader ? -EAGAIN : -1);
+
+    // Another writer may have filled the space before the mutex is acquired
+    mutex_lock(&pipe->write_mutex);
+    const uint32_t space = PIPE_SIZE - (pipe->head - pipe->tail);
+    const uint32_t chunk = min(size - written, (size_t)space);
+    const uint32_t offset = pipe->head % PIPE_SIZE;
+    const uint32_t first = min((size_t)chunk, (size_t)(PIPE_SIZE - offset));
+    kernel_memcpy(pipe->buf + offset, (uint8_t *)buf + written, first);
+    kernel_memcpy(pipe->buf, (uint8_t *)buf + written + first, chunk - first);
+
+    if (chunk)
+      pipe_produce(pipe, chunk);
+
+    mutex_unlock(&pipe->write_mutex);
+    written += chunk;
+  }
+
+  return written;
+}
+
+static int pipefs_close(file_t *file) {
+  pipe_t *pipe = file->data;
+
+  const irq_state_t state = irq_protect();
+  if (file_acc_mode(file) == O_RDONLY)
+    pipe->reader = FALSE;
+  else
+    pipe->writer = FALSE;
+
+  const _Bool unused = !pipe->reader && !pipe->writer;
+  irq_unprotect(state);
+
+  // The other end sees EOF or a broken pipe
+  wait_queue_wake(&pipe->read_wait, TASK_NUM);
+  wait_queue_wake(&pipe->write_wait, TASK_NUM);
+  poll_notify();
+
+  if (unused)
+    free_pipe(pipe);
+
+  return 0;
+}
+
+static int pipefs_seek(file_t *file, uint32_t offset, int dir) { return -1; }
+
+static int pipefs_stat(file_t *file, struct stat *stat) {
+  const pipe_t *pipe = file->data;
+  stat->st_mode = S_IFIFO;
+  stat->st_size = pipe->head - pipe->tail;
+  return 0;
+}
+
+static int pipefs_poll(file_t *file) {
+  const pipe_t *pipe = file->data;
+  const uint32_t used = pipe->head - pipe->tail;
+
+  if (file_acc_mode(file) == O_RDONLY)
+    return (used ? POLLIN : 0) | (pipe->writer ? 0 : POLLHUP);
+
+  return pipe->reader ? (used < PIPE_SIZE ? POLLOUT : 0) : POLLERR;
+}
+
+static void pipe_file_init(file_t *file, pipe_t *pipe, int mode) {
+  kernel_strncpy(file->name, "pipe", FILENAME_SIZE);
+  file->type = PIPE_FILE;
+  file->mode = mode;
+  file->fs = &pipe_fs;
+  file->data = pipe;
+}
+
+/*
+ * Create a pipe, fds[0] refers to the read end and fds[1] to the write end.
+ * Return -1 if the pipe, a file or a file descriptor is unavailable.
+ */
+int sys_pipe(int fds[2]) {
+  if (!fds)
+    return -1;
+
+  pipe_t *pipe = alloc_pipe();
+  if (!pipe) {
+    log_printf("Available pipe not found!");
+    return -1;
+  }
+
+  file_t *read_file = file_alloc(), *write_file = file_alloc();
+  int read_fd = -1, write_fd = -1;
+  if (!read_file || !write_file)
+    goto pipe_failed;
+
+  read_fd = task_alloc_fd(read_file);
+  if (read_fd < 0)
+    goto pipe_failed;
+
+  write_fd = task_alloc_fd(write_file);
+  if (write_fd < 0)
+    goto pipe_failed;
+
+  pipe_file_init(read_file, pipe, O_RDONLY);
+  pipe_file_init(write_file, pipe, O_WRONLY);
+  fds[0] = read_fd;
+  fds[1] = write_fd;
+  return 0;
+
+pipe_failed:
+  if (read_fd >= 0)
+    task_remove_fd(read_fd);
+
+  if (read_file)
+    file_free(read_file);
+
+  if (write_file)
+    file_free(write_file);
+
+  free_pipe(pipe);
+  return -1;
+}
+
+// Move a chunk from the ring of the read end to out, without a user buffer
+static int splice_from_pipe(file_t *in, file_t *out, size_t len) {
+  pipe_t *pipe = in->data;
+  for (;;) {
+    if (!pipe_wait_data(pipe, file_nonblock(in)))
+      return pipe->writer ? -EAGAIN : 0;
+
+    mutex_lock(&pipe->read_mutex);
+    const uint32_t avail = pipe->head - pipe->tail;
+    if (avail) {
+      const uint32_t offset = pipe->tail % PIPE_SIZE;
+      len = min(min(len, (size_t)avail), (size_t)(PIPE_SIZE - offset));
+      const int err = fs_write(out, pipe->buf + offset, len);
+      if (err > 0)
+        pipe_consume(pipe, err);
+
+      mutex_unlock(&pipe->read_mutex);
+      return err;
+    }
+
+    mutex_unlock(&pipe->read_mutex);
+  }
+}
+
+// Fill the free space of the ring of the write end from in directly
+static int splice_to_pipe(file_t *in, file_t *out, size_t len) {
+  pipe_t *pipe = out->data;
+  for (;;) {
+    if (!pipe_wait_space(pipe, file_nonblock(out)))
+      return pipe->reader ? -EAGAIN : -1;
+
+    mutex_lock(&pipe->write_mutex);
+    const uint32_t space = PIPE_SIZE - (pipe->head - pipe->tail);
+    if (space) {
+      const uint32_t offset = pipe->head % PIPE_SIZE;
+      len = min(min(len, (size_t)space), (size_t)(PIPE_SIZE - offset));
+      const int err = fs_read(in, pipe->buf + offset, len);
+      if (err > 0)
+        pipe_produce(pipe, err);
+
+      mutex_unlock(&pipe->write_mutex);
+      return err;
+    }
+
+    mutex_unlock(&pipe->write_mutex);
+  }
+}
+
+/*
+ * Move at most len bytes between a pipe and another file inside the kernel.
+ * One contiguous part of the ring is moved per call,
+ * return the number of bytes moved, 0 at the end of input, or -1 on error.
+ */
+int sys_splice(int fd_in, int fd_out, size_t len) {
+  file_t *in = task_file(fd_in), *out = task_file(fd_out);
+  if (!in || !out || !len)
+    return -1;
+
+  const _Bool in_pipe =
+      in->type == PIPE_FILE && file_acc_mode(in) == O_RDONLY;
+  const _Bool out_pipe =
+      out->type == PIPE_FILE && file_acc_mode(out) == O_WRONLY;
+  if (in_pipe == out_pipe) {
+    log_printf("Exactly one end of splice should be a pipe!");
+    return -1;
+  }
+
+  return in_pipe ? splice_from_pipe(in, out, len)
+                 : splice_to_pipe(in, out, len);
+}
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fs/poll.h"
+#include "cpu/irq.h"
+#include "dev/timer.h"
+#include "fs/fs.h"
+#include "ipc/wait.h"
+#include "os_cfg.h"
+
+/*
+ * A task only has one wait_node, so it can't wait on the queues of all the
+ * files it polls. Instead, every polling task waits on poll_queue, and every
+ * change which may make a file ready wakes them to check their files again.
+ */
+static wait_queue_t poll_queue;
+
+void poll_init() { wait_queue_init(&poll_queue); }
+
+// Called after the readiness of a file may have changed, also from IRQs
+void poll_notify() {
+  if (list_cnt(&poll_queue.wait_list))
+    wait_queue_wake(&poll_queue, TASK_NUM);
+}
+
+// Files without a poll callback never block, e.g. FAT files
+int file_poll(file_t *file) {
+  const fs_api_t *api = file->fs->fs_api;
+  return api->poll ? api->poll(file) : POLL_DEFAULT_MASK;
+}
+
+/*
+ * Block until the file is ready for events, or return -1 once *cancel is
+ * set, which should be followed by poll_notify.
+ */
+int poll_wait_file(file_t *file, int events, volatile _Bool *cancel) {
+  const irq_state_t state = irq_protect();
+
+  int err = 0;
+  while (!(file_poll(file) & (events | POLLERR | POLLHUP | POLLNVAL))) {
+    if (*cancel) {
+      err = -1;
+      break;
+    }
+
+    list_insert_last(&poll_queue.wait_list, &get_curr_task()->wait_node);
+    wait_block(&poll_queue.wait_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+  return err;
+}
+
+// Fill revents of every entry, and return the number of ready entries
+static int poll_scan(struct pollfd *fds, nfds_t nfds) {
+  int cnt = 0;
+  for (nfds_t i = 0; i < nfds; i++) {
+    struct pollfd *pfd = fds + i;
+    if (pfd->fd < 0) {
+      pfd->revents = 0;
+      continue;
+    }
+
+    file_t *file = task_file(pfd->fd);
+    if (file) // errors are reported even if not requested
+      pfd->revents =
+          file_poll(file) & (pfd->events | POLLERR | POLLHUP | POLLNVAL);
+    else
+      pfd->revents = POLLNVAL;
+
+    if (pfd->revents)
+      cnt++;
+  }
+
+  return cnt;
+}
+
+/*
+ * Wait until one of the files is ready for the requested events,
+ * or timeout_ms expires (return 0). Never block if timeout_ms is 0,
+ * and wait forever if it is negative (POLL_INFINITE).
+ * Return the number of entries whose revents is not 0.
+ */
+int sys_poll(struct pollfd *fds, nfds_t nfds, int timeout_ms) {
+  if (!fds && nfds)
+    return -1;
+
+  const uint32_t start = timer_get_tick();
+  const irq_state_t state = irq_protect();
+
+  int cnt;
+  while (!(cnt = poll_scan(fds, nfds)) && timeout_ms) {
+    uint32_t wait_ms = WAIT_FOREVER;
+    if (timeout_ms > 0) {
+      const uint32_t elapsed_ms = (timer_get_tick() - start) * OS_TICKS_MS;
+      if (elapsed_ms >= (uint32_t)timeout_ms)
+        break;
+
+      wait_ms = timeout_ms - elapsed_ms;
+    }
+
+    list_insert_last(&poll_queue.wait_list, &get_curr_task()->wait_node);
+    wait_block(&poll_queue.wait_list, wait_ms);
+  }
+
+  irq_unprotect(state);
+  return cnt;
+}
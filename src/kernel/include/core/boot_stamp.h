@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef BOOT_STAMP_H
+#define BOOT_STAMP_H
+
+#include "comm/boot_info.h"
+#include "dev/dev.h"
+
+#define BOOT_STAMP_MAX 24
+#define BOOT_REPORT_SIZE 2048
+
+typedef struct _boot_stamp_t {
+  const char *name; // the phase which ends at tsc
+  uint64_t tsc;
+} boot_stamp_t;
+
+void boot_stamp_init(const boot_info_t *boot_info);
+void boot_stamp(const char *name);
+void boot_stamp_finish();
+
+int boot_stamp_open(device_t *dev);
+int boot_stamp_close(const device_t *dev);
+int boot_stamp_read(const device_t *dev, uint32_t addr, void *buf,
+                    size_t size);
+int boot_stamp_write(const device_t *dev, uint32_t addr, const void *buf,
+                     size_t size);
+int boot_stamp_control(const device_t *dev, int cmd, va_list arg_list);
+
+#endif
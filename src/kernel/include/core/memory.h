@@ -14,6 +14,8 @@
 #define MEM_PAGE_SIZE 4096
 #define MEM_EBDA_START 0x80000
 #define MEM_TASK_BASE 0x80000000
+#define MEM_MMIO_BASE 0x7FC00000 // device registers, below the tasks
+#define MEM_MMIO_SIZE 0x400000   // covered by one page table
 
 #define MEM_TASK_STACK_TOP 0xE0000000
 #define MEM_TASK_STACK_SIZE (MEM_PAGE_SIZE * 500)
@@ -40,9 +42,13 @@ int memory_alloc_for_page_dir(uint32_t pde, uint32_t vaddr, uint32_t size,
 int memory_alloc_page_for(uint32_t addr, uint32_t size, int privilege);
 uint32_t memory_alloc_page();
 void memory_free_page(uint32_t addr);
+uint32_t memory_alloc_pages(int pages);
+void memory_free_pages(uint32_t addr, int pages);
 void memory_destroy_uvm(uint32_t page_dir);
 uint32_t memory_copy_uvm(uint32_t page_dir);
 uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr);
+uint32_t memory_dma_paddr(uint32_t vaddr);
+void *memory_map_mmio(uint32_t paddr, uint32_t size);
 int memory_copy_uvm_data(uint32_t dest, uint32_t page_dir, uint32_t src,
                          uint32_t size);
 
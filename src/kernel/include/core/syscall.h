@@ -36,7 +36,15 @@ enum syscall_t {
   SYS_READDIR,
   SYS_CLOSEDIR,
   SYS_POWEROFF,
-  SYS_REBOOT
+  SYS_REBOOT,
+  SYS_FUTEX,
+  SYS_IO_RING_SETUP,
+  SYS_IO_RING_ENTER,
+  SYS_PIPE,
+  SYS_DUP2,
+  SYS_SPLICE,
+  SYS_POLL,
+  SYS_FCNTL
 };
 
 typedef struct _syscall_frame_t {
@@ -59,5 +67,6 @@ typedef struct _syscall_frame_t {
 } syscall_frame_t;
 
 void syscall_handler();
+void sysenter_handler();
 
 #endif
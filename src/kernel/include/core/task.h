@@ -6,15 +6,23 @@
 #define TASK_H
 
 #include "cpu/cpu.h"
-#include "fs/file.h"
 #include "tools/list.h"
 
 #define TASK_NAME_SIZE 32
 #define TASK_TIME_SLICE_DEFAULT 10
 #define TASK_FILE_NUM 128
+#define ELF_HDR_BUF_SIZE 512 // the ELF header and the program header table
+
+#define TASK_PRIORITY_MIN 0
+#define TASK_PRIORITY_DEFAULT 8
+#define TASK_PRIORITY_MAX 31 // a larger value means a higher priority
 
 typedef enum _flag_t { SYSTEM, USER } flag_t;
 
+struct _mutex_t;
+struct _file_t;
+struct _io_ring_ctx_t;
+
 typedef struct _task_args_t {
   uint32_t ret_addr;
   uint32_t argc;
@@ -42,8 +50,24 @@ typedef struct _task_t {
     int sleep_ticks; // sleeping timer
   };
 
+  struct {
+    int priority;      // effective priority, may be raised by inheritance
+    int base_priority; // priority assigned to the task itself
+    list_t pi_list;    // contended mutexes owned by the task
+    struct _mutex_t *wait_mutex; // the mutex which the task is blocked on
+    int read_locks; // rwlocks held for reading, see rwlock_read_lock
+  };
+
+  struct {
+    list_t *wait_list; // the list which wait_node is inserted to
+    int wait_status;   // WAIT_OK, or WAIT_TIMEOUT if the waiting expired
+    uint32_t futex_key; // physical address of the futex the task waits on
+  };
+
   char name[TASK_NAME_SIZE];
-  file_t *file_table[TASK_FILE_NUM];
+  struct _file_t *file_table[TASK_FILE_NUM];
+  struct _io_ring_ctx_t *io_ring; // the I/O ring set up by the task
+  _Bool io_nonblock; // files never block the task, e.g. an I/O ring worker
   struct {
     list_node_t run_node;  // insert to ready_list/sleep_list
     list_node_t wait_node; // insert to wait_list
@@ -54,6 +78,7 @@ typedef struct _task_t {
   uint16_t tss_selector;
 
   int exit_status; // status when the task exits
+  _Bool trace;     // record the syscalls of the task to /dev/traceN
 } task_t;
 
 typedef struct _task_manager_t {
@@ -66,14 +91,13 @@ typedef struct _task_manager_t {
   struct {
     task_t first_task, idle_task; // a task which executes only when CPU is idle
   };
-
-  struct {
-    int app_code_selector, app_data_selector;
-  };
 } task_manager_t;
 
 int task_init(task_t *task, const char *name, flag_t flag, uint32_t entry,
               uint32_t esp);
+task_t *task_create_kthread(const char *name, uint32_t page_dir,
+                            void (*entry)(void *), void *arg);
+void task_destroy_kthread(task_t *task);
 void task_switch_to(const task_t *target_task);
 void task_manager_init();
 void task_first_init();
@@ -81,6 +105,8 @@ task_t *get_first_task();
 task_t *get_curr_task();
 void task_set_ready(task_t *task);
 void task_set_block(task_t *task);
+void task_set_priority(task_t *task, int priority);
+void task_insert_waiter(list_t *wait_list, task_t *task);
 int sys_yield();
 void task_dispatch();
 void task_time_tick();
@@ -94,9 +120,10 @@ int sys_fork();
 int sys_execve(const char *name, char *const argv[], char *const envp[]);
 void sys_exit(int status);
 
-int task_alloc_fd(file_t *file);
+int task_alloc_fd(struct _file_t *file);
+int task_set_fd(int fd, struct _file_t *file);
 int task_remove_fd(int fd);
-file_t *task_file(int fd);
+struct _file_t *task_file(int fd);
 
 int sys_wait(int *status);
 #endif
@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef CORE_VDSO_H
+#define CORE_VDSO_H
+
+#include "comm/vdso.h"
+
+#define VDSO_CALIB_TICKS 10 // ticks to count TSC cycles for the calibration
+
+void vdso_init();
+uint32_t vdso_paddr();
+void vdso_set_pid(int pid);
+void vdso_tick(uint32_t ticks);
+uint32_t vdso_tsc_khz();
+
+#endif
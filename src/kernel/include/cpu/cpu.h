@@ -60,6 +60,10 @@ typedef struct _tss_t {
 #define GATE_TYPE_INT (0xE << 8) // D=1 (32 bit)
 #define GATE_TYPE_SYSCALL (0xC << 8)
 
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
 #define EFLAGS_DEFAULT (1 << 1)
 #define EFLAGS_IF (1 << 9)
 
@@ -71,5 +75,6 @@ void gate_desc_set(gate_desc_t *desc, uint16_t selector, uint32_t offset,
 int gdt_alloc_desc();
 void switch_to_tss(int tss_selector);
 void gdt_free_selector(int selector);
+void cpu_set_sysenter_esp(uint32_t esp);
 
 #endif
\ No newline at end of file
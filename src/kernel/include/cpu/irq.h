@@ -34,6 +34,7 @@ typedef enum _irq_t {
 #define IRQ1_KEYBOARD 0x21
 
 #define IRQ14_IDE_PRIMARY (0x20 + 14)
+#define IRQ15_IDE_SECONDARY (0x20 + 15)
 
 #define PIC0_ICW1 0x20
 #define PIC0_ICW2 0x21
@@ -15,6 +15,9 @@
 #define PDE_W (1 << 1)
 #define PTE_U (1 << 2)
 #define PDE_U (1 << 2)
+#define PTE_PWT (1 << 3) // write-through
+#define PTE_PCD (1 << 4) // cache disabled, for device registers
+#define PTE_SHARED (1 << 9) // available to software: not owned by the task
 
 #define PDE_RW (1 << 1)
 #define PDE_PS (1 << 7) // PS bit = 1 -> Page Size = 4MB
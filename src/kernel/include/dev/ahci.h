@@ -0,0 +1,148 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef AHCI_H
+#define AHCI_H
+
+#include "dev/disk.h"
+#include "ipc/wait.h"
+
+#define PCI_SUBCLASS_SATA 0x06
+#define PCI_PROG_IF_AHCI 0x01
+#define AHCI_ABAR 5 // the registers of the HBA, in the memory space
+
+#define AHCI_PORT_NUM 32
+#define AHCI_SLOT_NUM 32
+#define AHCI_DISK_NUM 8       // ports used as disks
+#define AHCI_PRDT_NUM 24      // regions of a command table
+#define AHCI_MAX_SECTORS 128  // per command, spanning at most 17 pages
+#define AHCI_REQ_SLOTS 8      // commands in flight for one request
+#define AHCI_TIMEOUT_MS 5000  // give up on a command without completion
+#define AHCI_SPIN_POLLS 1000000 // register reads before giving up
+
+#define get_ahci_id(minor_no) ((minor_no) >> 4)
+
+// Generic host control
+#define AHCI_CAP_NCS(cap) ((((cap) >> 8) & 0x1F) + 1) // command slots
+#define AHCI_CAP_SNCQ (1U << 30)
+#define AHCI_GHC_IE (1 << 1)
+#define AHCI_GHC_AE (1U << 31)
+
+// Port registers
+#define AHCI_PORT_CMD_ST (1 << 0)
+#define AHCI_PORT_CMD_SUD (1 << 1)
+#define AHCI_PORT_CMD_POD (1 << 2)
+#define AHCI_PORT_CMD_FRE (1 << 4)
+#define AHCI_PORT_CMD_FR (1 << 14)
+#define AHCI_PORT_CMD_CR (1 << 15)
+
+#define AHCI_PORT_IS_DHRS (1 << 0) // D2H register FIS, a command completed
+#define AHCI_PORT_IS_SDBS (1 << 3) // set device bits FIS, NCQ completion
+#define AHCI_PORT_IS_ERR 0x78000000 // interface, host bus and task file errors
+#define AHCI_PORT_IE (AHCI_PORT_IS_DHRS | AHCI_PORT_IS_SDBS | AHCI_PORT_IS_ERR)
+
+#define AHCI_SSTS_DET(ssts) ((ssts) & 0xF)
+#define AHCI_SSTS_DET_PRESENT 3 // device present with PHY communication
+#define AHCI_SCTL_DET_INIT 1    // COMRESET
+#define AHCI_SIG_ATA 0x00000101
+
+#define AHCI_CMD_WRITE (1 << 6) // in the flags of the command header
+
+#define FIS_TYPE_H2D 0x27
+#define FIS_H2D_CMD (1 << 7)
+#define FIS_DEVICE_LBA (1 << 6)
+
+// Words of the IDENTIFY data
+#define IDENTIFY_QUEUE_DEPTH 75
+#define IDENTIFY_SATA_CAP 76
+#define SATA_CAP_NCQ (1 << 8)
+
+enum ahci_cmd_t { CMD_READ_FPDMA = 0x60, CMD_WRITE_FPDMA = 0x61 };
+
+typedef volatile struct _ahci_port_t {
+  uint32_t clb, clbu; // command list, 1 KiB aligned
+  uint32_t fb, fbu;   // received FIS, 256 bytes aligned
+  uint32_t is, ie, cmd, reserved0;
+  uint32_t tfd, sig, ssts, sctl, serr;
+  uint32_t sact, ci; // NCQ tags outstanding, and commands issued
+  uint32_t sntf, fbs;
+  uint32_t reserved1[11], vendor[4];
+} ahci_port_t;
+
+typedef volatile struct _ahci_hba_t {
+  uint32_t cap, ghc, is, pi, vs;
+  uint32_t ccc_ctl, ccc_ports, em_loc, em_ctl, cap2, bohc;
+  uint8_t reserved[0xA0 - 0x2C];
+  uint8_t vendor[0x100 - 0xA0];
+  ahci_port_t ports[AHCI_PORT_NUM];
+} ahci_hba_t;
+
+#pragma pack(1)
+
+typedef struct _ahci_cmd_header_t {
+  uint16_t flags; // length of the command FIS in dwords, and AHCI_CMD_*
+  uint16_t prdtl; // regions of the command table
+  volatile uint32_t prdbc;
+  uint32_t ctba, ctbau; // command table, 128 bytes aligned
+  uint32_t reserved[4];
+} ahci_cmd_header_t;
+
+typedef struct _ahci_prd_t {
+  uint32_t dba, dbau, reserved;
+  uint32_t dbc; // bytes - 1, should be even
+} ahci_prd_t;
+
+typedef struct _ahci_cmd_table_t {
+  uint8_t cfis[64];
+  uint8_t acmd[16];
+  uint8_t reserved[48];
+  ahci_prd_t prdt[AHCI_PRDT_NUM];
+} ahci_cmd_table_t;
+
+typedef struct _fis_h2d_t {
+  uint8_t type, flags, command, feature_lo;
+  uint8_t lba0, lba1, lba2, device;
+  uint8_t lba3, lba4, lba5, feature_hi;
+  uint8_t count_lo, count_hi, icc, control;
+  uint8_t reserved[4];
+} fis_h2d_t;
+
+#pragma pack()
+
+#define AHCI_CMD_LIST_SIZE (AHCI_SLOT_NUM * sizeof(ahci_cmd_header_t))
+#define AHCI_PORT_PAGES                                                        \
+  (1 + AHCI_SLOT_NUM * sizeof(ahci_cmd_table_t) / MEM_PAGE_SIZE)
+// The command list and the received FIS share the first page
+
+/*
+ * A slot is busy from allocation until its owner has seen the completion,
+ * and issued while the HBA owns it.
+ */
+typedef struct _ahci_disk_t {
+  char name[DISK_NAME_SIZE];
+  int port;
+  ahci_port_t *regs;
+  ahci_cmd_header_t *cmd_list;
+  ahci_cmd_table_t *cmd_table;
+  _Bool ncq;
+  uint32_t slot_mask; // slots within the queue depth
+  size_t sector_size, sectors;
+  part_info_t part_info[PRIMARY_PART_NUM];
+
+  volatile uint32_t busy, issued, failed;
+  wait_queue_t slot_wait; // requests waiting for a free slot
+  sem_t done[AHCI_SLOT_NUM];
+} ahci_disk_t;
+
+void ahci_init();
+int ahci_open(device_t *dev);
+int ahci_close(const device_t *dev);
+int ahci_read(const device_t *dev, uint32_t start_sector, void *buf,
+              size_t sectors);
+int ahci_write(const device_t *dev, uint32_t start_sector, const void *buf,
+               size_t sectors);
+int ahci_control(const device_t *dev, int cmd, va_list arg_list);
+int ahci_poll(const device_t *dev);
+
+#endif
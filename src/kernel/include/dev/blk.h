@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef BLK_H
+#define BLK_H
+
+#include "ipc/wait.h"
+
+#define BLK_SEG_NUM 17       // a request of 64 KiB may span 17 pages
+#define BLK_REQ_SECTORS 128  // sectors of a request built by blk_rw
+#define BLK_RW_DEPTH 2       // requests queued at once by blk_rw
+#define BLK_MAX_SECTORS 256  // sectors of a dispatch after merging
+#define BLK_BATCH_SEGS 64    // segments of a dispatch after merging
+#define BLK_BATCH_REQS 32    // requests merged into a dispatch
+#define BLK_READ_EXPIRE_MS 500
+#define BLK_WRITE_EXPIRE_MS 5000
+#define BLK_WORKER_PRIORITY (TASK_PRIORITY_DEFAULT + 1)
+
+// A physically contiguous part of a buffer, accessed by its identity mapping
+typedef struct _blk_seg_t {
+  uint32_t paddr, len;
+} blk_seg_t;
+
+/*
+ * Transfer the contiguous sectors described by the segments,
+ * and return the number of sectors transferred from the start.
+ */
+typedef size_t (*blk_transfer_t)(void *dev, uint32_t sector,
+                                 const blk_seg_t *segs, int seg_cnt,
+                                 size_t sectors, _Bool write);
+
+struct _blk_req_t;
+typedef void (*blk_done_t)(struct _blk_req_t *req);
+
+/*
+ * The buffer is translated to physical segments when the request is built,
+ * so that the worker can transfer it from any address space.
+ * A request with done is completed by calling done, which owns the request
+ * afterwards, otherwise its owner waits for it by blk_wait.
+ */
+typedef struct _blk_req_t {
+  void *dev;
+  uint32_t sector;
+  size_t sectors;
+  _Bool write;
+  blk_seg_t segs[BLK_SEG_NUM];
+  int seg_cnt;
+
+  uint32_t deadline; // tick after which the request is dispatched first
+  list_node_t sort_node, fifo_node;
+
+  volatile _Bool completed;
+  size_t result; // sectors transferred
+  wait_queue_t wait;
+  blk_done_t done;
+  void *data; // for done
+} blk_req_t;
+
+typedef struct _blk_stat_t {
+  uint32_t requests, dispatches, merged, expired;
+} blk_stat_t;
+
+/*
+ * Requests are sorted by (device, sector) for a one-way elevator (C-SCAN),
+ * and kept in a FIFO per direction for their deadlines.
+ * A worker thread dispatches them, merging the adjacent ones.
+ */
+typedef struct _blk_queue_t {
+  const char *name;
+  blk_transfer_t transfer;
+  list_t sorted;
+  list_t fifo[2]; // reads, then writes
+  void *next_dev; // where the last dispatch ended
+  uint32_t next_sector;
+
+  task_t *worker; // NULL before multitasking, requests are transferred inline
+  wait_queue_t worker_wait;
+  volatile _Bool active; // a dispatch is in progress
+  blk_seg_t segs[BLK_BATCH_SEGS];
+  blk_req_t *batch[BLK_BATCH_REQS];
+  blk_stat_t stat;
+} blk_queue_t;
+
+// Walk the segments of a transfer
+typedef struct _blk_cursor_t {
+  const blk_seg_t *seg;
+  uint32_t offset;
+} blk_cursor_t;
+
+void blk_queue_init(blk_queue_t *queue, const char *name,
+                    blk_transfer_t transfer);
+int blk_queue_start(blk_queue_t *queue);
+_Bool blk_queue_busy(const blk_queue_t *queue);
+
+int blk_req_init(blk_req_t *req, void *dev, uint32_t sector, void *buf,
+                 size_t sectors, _Bool write);
+void blk_submit(blk_queue_t *queue, blk_req_t *req);
+size_t blk_wait(blk_req_t *req);
+size_t blk_rw(blk_queue_t *queue, void *dev, uint32_t sector, void *buf,
+              size_t sectors, _Bool write);
+
+void blk_cursor_init(blk_cursor_t *cursor, const blk_seg_t *segs,
+                     uint32_t offset);
+void *blk_cursor_take(blk_cursor_t *cursor, uint32_t size);
+void blk_cursor_copy(blk_cursor_t *cursor, void *buf, uint32_t size,
+                     _Bool to_segs);
+
+#endif
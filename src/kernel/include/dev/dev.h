@@ -11,7 +11,20 @@
 #define DEV_NAME_SIZE 32
 #define DEV_TABLE_SIZE 128
 
-typedef enum _major_no_t { DEV_UNKNOWN, TTY_DEV, DEV_DISK } major_no_t;
+typedef enum _major_no_t {
+  DEV_UNKNOWN,
+  TTY_DEV,
+  DEV_DISK,
+  DEV_TRACE,
+  DEV_SYSLAT,
+  DEV_PROF,
+  DEV_BOOT,
+  DEV_DISKSTAT,
+  DEV_AHCI,
+  DEV_VIRTIO,
+  DEV_RAMDISK,
+  DEV_LOCKSTAT
+} major_no_t;
 
 typedef struct _device_t {
   struct _dev_desc_t *desc;
@@ -30,6 +43,7 @@ typedef struct _dev_desc_t {
   int (*write)(const device_t *dev, uint32_t addr, const void *buf,
                size_t size);
   int (*control)(const device_t *dev, int cmd, va_list arg_list);
+  int (*poll)(const device_t *dev); // NULL if the device never blocks
 } dev_desc_t;
 
 int dev_open(major_no_t major_no, int minor_no, void *data);
@@ -37,5 +51,6 @@ int dev_close(int dev_id);
 int dev_read(int dev_id, uint32_t addr, void *buf, size_t size);
 int dev_write(int dev_id, uint32_t addr, const void *buf, size_t size);
 int dev_control(int dev_id, int cmd, ...);
+int dev_poll(int dev_id);
 
 #endif
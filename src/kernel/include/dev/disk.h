@@ -5,8 +5,11 @@
 #ifndef DISK_H
 #define DISK_H
 
+#include "comm/disk_stat.h"
 #include "cpu/irq.h"
+#include "dev/blk.h"
 #include "dev/dev.h"
+#include "core/memory.h"
 #include "ipc/mutex.h"
 #include "ipc/sem.h"
 
@@ -14,9 +17,10 @@
 #define PART_NAME_SIZE 32
 #define PRIMARY_PART_NUM (4 + 1)
 
-#define DISK_NUM 2
+#define DISK_NUM 4
 
 #define DISK_PER_BUS 2
+#define IDE_CHANNEL_NUM (DISK_NUM / DISK_PER_BUS)
 
 #define PRIMARY_BUS_BASE 0x1F0
 #define SECONDARY_BUS_BASE 0x170
@@ -31,8 +35,28 @@
 #define DRIVE_REG(disk) (((disk)->port_base) + 6)
 #define STATUS_REG(disk) (((disk)->port_base) + 7)
 #define CMD_REG(disk) (((disk)->port_base) + 7)
+#define DEV_CTRL_REG(disk) (((disk)->port_base) + 0x206) // alternate status
 
 #define DRIVE_REG_BASE 0xE0
+#define DEV_CTRL_NIEN (1 << 1) // mask the interrupt of the drives
+#define DEV_CTRL_SRST (1 << 2) // reset the drives of the channel
+#define DEV_CTRL_SRST_READS 16 // alternate status reads holding SRST, >= 5 us
+
+// Bus master IDE registers of the channel, in the I/O space of BAR4
+#define BM_CMD_REG(disk) (((disk)->bm_base) + 0)
+#define BM_STATUS_REG(disk) (((disk)->bm_base) + 2)
+#define BM_PRDT_REG(disk) (((disk)->bm_base) + 4)
+
+#define BM_BAR 4
+#define BM_CHANNEL_SIZE 8 // the secondary channel follows the primary one
+#define BM_CMD_START (1 << 0)
+#define BM_CMD_READ (1 << 3) // the device writes to the memory
+#define BM_STATUS_ACTIVE (1 << 0)
+#define BM_STATUS_ERR (1 << 1)
+#define BM_STATUS_IRQ (1 << 2)
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
 
 #define disk_size_mib(disk)                                                    \
   (((disk)->sectors) * ((disk)->sector_size) / 1024 / 1024)
@@ -47,6 +71,13 @@
 
 #define MBR_PRIMARY_PARTC 4
 
+#define DISK_TIMEOUT_MS 5000 // give up on a command without interrupt
+#define DISK_DMA_MAX_SECTORS 256 // sectors per DMA command
+#define DISK_IDENTIFY_POLLS 100000 // status reads before giving up IDENTIFY
+#define DISK_MULTIPLE_MAX 128 // sectors per interrupt in READ/WRITE MULTIPLE
+
+#define ID_MULTIPLE_WORD 47 // the low byte is the maximum of SET MULTIPLE
+
 enum disk_status_t {
   STATUS_ERR = (1 << 0),
   STATUS_IDX = (1 << 1),
@@ -58,7 +89,16 @@ enum disk_status_t {
   STATUS_BSY = (1 << 7)
 };
 
-enum disk_cmd_t { CMD_READ = 0x24, CMD_WRITE = 0x34, CMD_IDENTIFY = 0xEC };
+enum disk_cmd_t {
+  CMD_READ = 0x24,
+  CMD_READ_DMA = 0x25,
+  CMD_READ_MULTIPLE = 0x29,
+  CMD_WRITE = 0x34,
+  CMD_WRITE_DMA = 0x35,
+  CMD_WRITE_MULTIPLE = 0x39,
+  CMD_SET_MULTIPLE = 0xC6,
+  CMD_IDENTIFY = 0xEC
+};
 
 #pragma pack(1)
 
@@ -81,29 +121,71 @@ typedef struct _mbr_t {
   const uint16_t boot_sign; // 0x55AA
 } mbr_t;
 
-#pragma pack()
+/*
+ * Physical Region Descriptor, a region should be contiguous in the physical
+ * memory and mustn't cross a 64 KiB boundary.
+ */
+typedef struct _prd_t {
+  uint32_t addr;
+  uint16_t byte_cnt; // 0 for 64 KiB
+  uint16_t flags;
+} prd_t;
+
+#define PRD_EOT 0x8000 // the last region of the table
+#define PRD_NUM (MEM_PAGE_SIZE / sizeof(prd_t))
+#define PRD_MAX_SIZE 0x10000
 
-struct _disk_t;
+#pragma pack()
 
 typedef struct _part_info_t {
   char name[PART_NAME_SIZE];
-  const struct _disk_t *disk;
+  const void *disk; // disk_t, or the disk of another driver
   unsigned int start_sector, total_sector;
   enum { FS_INVALID, FS_FAT16_DOS = 0x6, FS_FAT16_WIN95 = 0xE } type;
 } part_info_t;
 
+/*
+ * The drives of a channel share its registers and its interrupt, so that
+ * one of them transfers at a time, while the two channels run in parallel.
+ */
+typedef struct _ide_channel_t {
+  uint16_t port_base;
+  uint16_t bm_base; // bus master registers, 0 if only PIO is available
+  int irq;
+  irq_handler_t handler;
+  int disks; // drives identified on the channel
+
+  prd_t *prd_table; // one page, shared by the drives of the channel
+  mutex_t rw_mutex;
+  sem_t rw_sem;
+  volatile _Bool on_task;
+  uint64_t wait_cycles; // waiting for interrupts in the request
+  uint32_t irqs;        // interrupts waited for in the request
+  blk_queue_t queue;
+} ide_channel_t;
+
 typedef struct _disk_t {
   char name[DISK_NAME_SIZE];
   enum { MASTER = (0 << 4), SLAVE = (1 << 4) } drive_type;
   uint16_t port_base;
+  uint16_t bm_base; // bus master registers, 0 if only PIO is available
   size_t sector_size, sectors;
+  uint32_t multiple; // sectors per interrupt of PIO, 1 without multiple mode
   part_info_t part_info[PRIMARY_PART_NUM];
 
-  mutex_t *rw_mutex;
-  sem_t *rw_sem;
+  ide_channel_t *channel;
 } disk_t;
 
+// Accumulated per transfer mode, converted to disk_stat_t when read
+typedef struct _disk_cycles_t {
+  uint32_t requests, sectors, irqs;
+  uint64_t busy, cpu; // Unit: TSC cycles
+} disk_cycles_t;
+
 void disk_init();
+void disk_start();
+void disk_parse_mbr(const mbr_t *mbr, const char *disk_name, const void *disk,
+                    part_info_t *part_info);
 int disk_open(device_t *dev);
 int disk_close(const device_t *dev);
 int disk_read(const device_t *dev, uint32_t start_sector, void *buf,
@@ -111,7 +193,18 @@ int disk_read(const device_t *dev, uint32_t start_sector, void *buf,
 int disk_write(const device_t *dev, uint32_t start_sector, const void *buf,
                size_t sectors);
 int disk_control(const device_t *dev, int cmd, va_list arg_list);
+int disk_poll(const device_t *dev);
+
+int disk_stat_open(device_t *dev);
+int disk_stat_close(const device_t *dev);
+int disk_stat_read(const device_t *dev, uint32_t addr, void *buf, size_t size);
+int disk_stat_write(const device_t *dev, uint32_t addr, const void *buf,
+                    size_t size);
+int disk_stat_control(const device_t *dev, int cmd, va_list arg_list);
+
 void exception_handler_ide_primary();
 void do_handle_ide_primary(exception_frame_t *frame);
+void exception_handler_ide_secondary();
+void do_handle_ide_secondary(exception_frame_t *frame);
 
 #endif
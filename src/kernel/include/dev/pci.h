@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef PCI_H
+#define PCI_H
+
+#include "comm/types.h"
+#include "cpu/irq.h"
+
+#define PCI_CONFIG_ADDR_PORT 0xCF8
+#define PCI_CONFIG_DATA_PORT 0xCFC
+
+#define PCI_BUS_NUM 256
+#define PCI_SLOT_NUM 32
+#define PCI_FUNC_NUM 8
+#define PCI_DEV_NUM 32 // functions remembered by pci_init
+#define PCI_IRQ_HANDLER_NUM 8
+
+// Offsets in the configuration space (header type 0)
+#define PCI_VENDOR_ID 0x00 // 16 bits, followed by the device ID
+#define PCI_COMMAND 0x04   // 16 bits, followed by the status
+#define PCI_CLASS 0x08     // revision, prog IF, subclass, class code
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0 0x10
+#define PCI_INTERRUPT_LINE 0x3C
+
+#define PCI_COMMAND_IO (1 << 0)
+#define PCI_COMMAND_MEMORY (1 << 1)
+#define PCI_COMMAND_BUS_MASTER (1 << 2)
+
+#define PCI_VENDOR_NONE 0xFFFF
+#define PCI_HEADER_MULTI_FUNC 0x80
+
+#define PCI_BAR_IO 0x1 // the BAR holds an I/O port instead of an address
+#define pci_bar_addr(bar) ((bar) & ((bar) & PCI_BAR_IO ? ~0x3 : ~0xF))
+
+typedef struct _pci_dev_t {
+  uint8_t bus, slot, func;
+  uint16_t vendor_id, device_id;
+  uint8_t class_code, subclass, prog_if;
+  uint8_t irq; // legacy IRQ routed by the firmware
+} pci_dev_t;
+
+// Called in the interrupt, it should acknowledge the device before waking tasks
+typedef void (*pci_irq_handler_t)(void *data);
+
+void pci_init();
+uint32_t pci_read(const pci_dev_t *dev, uint8_t offset);
+void pci_write(const pci_dev_t *dev, uint8_t offset, uint32_t value);
+uint32_t pci_bar(const pci_dev_t *dev, int index);
+void pci_enable(const pci_dev_t *dev, uint16_t command);
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_dev_t *dev);
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index,
+                    pci_dev_t *dev);
+int pci_irq_install(const pci_dev_t *dev, pci_irq_handler_t handler,
+                    void *data);
+
+void exception_handler_pci_irq5();
+void exception_handler_pci_irq9();
+void exception_handler_pci_irq10();
+void exception_handler_pci_irq11();
+void do_handle_pci_irq5(const exception_frame_t *frame);
+void do_handle_pci_irq9(const exception_frame_t *frame);
+void do_handle_pci_irq10(const exception_frame_t *frame);
+void do_handle_pci_irq11(const exception_frame_t *frame);
+
+#endif
@@ -0,0 +1,24 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DEV_PROF_H
+#define DEV_PROF_H
+
+#include "comm/prof.h"
+#include "cpu/irq.h"
+#include "dev/dev.h"
+
+#define PROF_BUF_PAGES 64
+#define PROF_HZ_MAX 10000
+
+void prof_sample(const exception_frame_t *frame);
+
+int prof_open(device_t *dev);
+int prof_close(const device_t *dev);
+int prof_read(const device_t *dev, uint32_t addr, void *buf, size_t size);
+int prof_write(const device_t *dev, uint32_t addr, const void *buf,
+               size_t size);
+int prof_control(const device_t *dev, int cmd, va_list arg_list);
+
+#endif
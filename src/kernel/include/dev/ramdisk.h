@@ -0,0 +1,22 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DEV_RAMDISK_H
+#define DEV_RAMDISK_H
+
+#include "comm/ramdisk.h"
+#include "dev/dev.h"
+
+#define RAMDISK_MAX_PAGES 8192 // 32 MiB
+
+void ramdisk_init();
+int ramdisk_open(device_t *dev);
+int ramdisk_close(const device_t *dev);
+int ramdisk_read(const device_t *dev, uint32_t start_sector, void *buf,
+                 size_t sectors);
+int ramdisk_write(const device_t *dev, uint32_t start_sector, const void *buf,
+                  size_t sectors);
+int ramdisk_control(const device_t *dev, int cmd, va_list arg_list);
+
+#endif
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef RTC_H
+#define RTC_H
+
+#include "comm/types.h"
+
+#define CMOS_ADDR_PORT 0x70
+#define CMOS_DATA_PORT 0x71
+
+#define RTC_SECOND 0x00
+#define RTC_MINUTE 0x02
+#define RTC_HOUR 0x04
+#define RTC_DAY 0x07
+#define RTC_MONTH 0x08
+#define RTC_YEAR 0x09
+#define RTC_STATUS_A 0x0A
+#define RTC_STATUS_B 0x0B
+
+#define RTC_UPDATING (1 << 7) // Status Register A
+#define RTC_24HOUR (1 << 1)   // Status Register B
+#define RTC_BINARY (1 << 2)   // Status Register B
+#define RTC_PM (1 << 7)       // Hour Register in 12-hour mode
+
+#define bcd2bin(bcd) ((((bcd) >> 4) * 10) + ((bcd) & 0xF))
+
+uint32_t rtc_read_time();
+
+#endif
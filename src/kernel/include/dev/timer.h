@@ -5,6 +5,8 @@
 #ifndef TIME_H
 #define TIME_H
 
+#include "comm/types.h"
+
 #define PIT_OSC_FREQ 1193182 // Programmable Interval Timer
 #define PIT_COMMAND_MODE_PORT 0x43
 #define PIT_CHANNEL0_DATA_PORT 0x40
@@ -15,6 +17,8 @@
 #define PIT_MODE3 (3 << 1)
 
 void time_init();
+void timer_set_rate(uint32_t hz);
+uint32_t timer_get_tick();
 void exception_handler_time();
 
 #endif
\ No newline at end of file
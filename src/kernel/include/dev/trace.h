@@ -0,0 +1,25 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DEV_TRACE_H
+#define DEV_TRACE_H
+
+#include "comm/trace.h"
+#include "core/syscall.h"
+#include "dev/dev.h"
+
+#define TRACE_RING_SIZE 1024 // should be a power of 2
+
+void trace_syscall(const syscall_frame_t *frame, int ret, uint64_t cycles);
+
+int trace_open(device_t *dev);
+int trace_close(const device_t *dev);
+int trace_read(const device_t *dev, uint32_t addr, void *buf, size_t size);
+int trace_write(const device_t *dev, uint32_t addr, const void *buf,
+                size_t size);
+int trace_control(const device_t *dev, int cmd, va_list arg_list);
+
+int syslat_read(const device_t *dev, uint32_t addr, void *buf, size_t size);
+
+#endif
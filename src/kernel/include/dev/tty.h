@@ -30,6 +30,7 @@ typedef struct _tty_t {
   sem_t output_sem, input_sem;
   _Bool output_crlf_esc, input_crlf_esc; // convert '\n' to "\r\n"
   _Bool input_echo;
+  volatile int input_lines; // '\n' in input_queue, a line is ready to read
   int console_id;
 } tty_t;
 
@@ -38,6 +39,7 @@ int tty_close(const device_t *dev);
 int tty_read(const device_t *dev, uint32_t addr, void *buf, size_t size);
 int tty_write(const device_t *dev, uint32_t addr, const void *buf, size_t size);
 int tty_control(const device_t *dev, int cmd, va_list arg_list);
+int tty_poll(const device_t *dev);
 void tty_queue_init(tty_queue_t *queue, char *buf, int size);
 int tty_enqueue(tty_queue_t *queue, char data);
 int tty_dequeue(tty_queue_t *queue, char *data);
@@ -0,0 +1,135 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "dev/disk.h"
+#include "ipc/wait.h"
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+#define VIRTIO_BLK_DEVICE_ID 0x1001 // transitional, with the legacy interface
+
+#define VIRTIO_DISK_NUM 4
+#define VIRTIO_SLOT_NUM 32     // requests in flight per disk
+#define VIRTIO_SEG_NUM 24      // data segments of a request
+#define VIRTIO_MAX_SECTORS 128 // per request, spanning at most 17 pages
+#define VIRTIO_REQ_SLOTS 8     // requests in flight for one transfer
+#define VIRTIO_TIMEOUT_MS 5000 // give up on a request without completion
+#define VIRTIO_SPIN_POLLS 1000000
+
+#define get_virtio_id(minor_no) ((minor_no) >> 4)
+
+// Legacy registers, in the I/O space of BAR0
+#define VIRTIO_DEVICE_FEATURES(disk) ((disk)->io_base + 0x00)
+#define VIRTIO_GUEST_FEATURES(disk) ((disk)->io_base + 0x04)
+#define VIRTIO_QUEUE_PFN(disk) ((disk)->io_base + 0x08)
+#define VIRTIO_QUEUE_SIZE(disk) ((disk)->io_base + 0x0C)
+#define VIRTIO_QUEUE_SELECT(disk) ((disk)->io_base + 0x0E)
+#define VIRTIO_QUEUE_NOTIFY(disk) ((disk)->io_base + 0x10)
+#define VIRTIO_DEVICE_STATUS(disk) ((disk)->io_base + 0x12)
+#define VIRTIO_ISR_STATUS(disk) ((disk)->io_base + 0x13) // cleared by reading
+#define VIRTIO_CONFIG(disk) ((disk)->io_base + 0x14)     // without MSI-X
+
+#define VIRTIO_BLK_CAPACITY 0x00 // 64 bits, in 512 bytes sectors
+#define VIRTIO_BLK_SEG_MAX 0x0C
+
+#define VIRTIO_STATUS_ACK (1 << 0)
+#define VIRTIO_STATUS_DRIVER (1 << 1)
+#define VIRTIO_STATUS_DRIVER_OK (1 << 2)
+#define VIRTIO_STATUS_FAILED (1 << 7)
+
+#define VIRTIO_BLK_F_SEG_MAX (1 << 2)
+#define VIRTIO_BLK_F_RO (1 << 5)
+#define VIRTIO_F_INDIRECT_DESC (1 << 28)
+#define VIRTIO_FEATURES                                                        \
+  (VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_F_INDIRECT_DESC)
+
+#define VIRTQ_DESC_F_NEXT (1 << 0)
+#define VIRTQ_DESC_F_WRITE (1 << 1) // written by the device
+#define VIRTQ_DESC_F_INDIRECT (1 << 2)
+#define VIRTQ_USED_F_NO_NOTIFY (1 << 0)
+#define VIRTQ_ALIGN MEM_PAGE_SIZE
+
+enum virtio_blk_type_t { VIRTIO_BLK_T_IN = 0, VIRTIO_BLK_T_OUT = 1 };
+enum virtio_blk_status_t { VIRTIO_BLK_S_OK = 0 };
+
+#pragma pack(1)
+
+typedef struct _virtq_desc_t {
+  uint32_t addr, addr_hi;
+  uint32_t len;
+  uint16_t flags, next;
+} virtq_desc_t;
+
+typedef struct _virtq_avail_t {
+  uint16_t flags;
+  volatile uint16_t idx;
+  uint16_t ring[];
+} virtq_avail_t;
+
+typedef struct _virtq_used_elem_t {
+  uint32_t id, len;
+} virtq_used_elem_t;
+
+typedef struct _virtq_used_t {
+  volatile uint16_t flags, idx;
+  virtq_used_elem_t ring[];
+} virtq_used_t;
+
+typedef struct _virtio_blk_hdr_t {
+  uint32_t type, reserved;
+  uint32_t sector, sector_hi;
+} virtio_blk_hdr_t;
+
+#pragma pack()
+
+#define VIRTIO_DESC_NUM (VIRTIO_SEG_NUM + 2) // with the header and the status
+
+/*
+ * The descriptors of a request, which are either referred by one indirect
+ * descriptor of the ring, or chained in the ring from the slot onwards.
+ */
+typedef struct _virtio_req_t {
+  virtq_desc_t desc[VIRTIO_DESC_NUM];
+  virtio_blk_hdr_t hdr;
+  volatile uint8_t status;
+} __attribute__((aligned(16))) virtio_req_t;
+
+/*
+ * Like the AHCI slots, a slot is busy from allocation until its owner has
+ * seen the completion, and issued while the device owns it.
+ */
+typedef struct _virtio_disk_t {
+  char name[DISK_NAME_SIZE];
+  uint16_t io_base;
+  _Bool indirect, read_only;
+  int seg_max, max_sectors; // per request
+
+  uint16_t queue_size, last_used;
+  virtq_desc_t *desc;
+  virtq_avail_t *avail;
+  virtq_used_t *used;
+  virtio_req_t *req; // one per slot
+  uint32_t slot_mask;
+
+  size_t sector_size, sectors;
+  part_info_t part_info[PRIMARY_PART_NUM];
+
+  volatile uint32_t busy, issued;
+  wait_queue_t slot_wait; // transfers waiting for a free slot
+  sem_t done[VIRTIO_SLOT_NUM];
+} virtio_disk_t;
+
+void virtio_blk_init();
+int virtio_blk_open(device_t *dev);
+int virtio_blk_close(const device_t *dev);
+int virtio_blk_read(const device_t *dev, uint32_t start_sector, void *buf,
+                    size_t sectors);
+int virtio_blk_write(const device_t *dev, uint32_t start_sector,
+                     const void *buf, size_t sectors);
+int virtio_blk_control(const device_t *dev, int cmd, va_list arg_list);
+int virtio_blk_poll(const device_t *dev);
+
+#endif
@@ -0,0 +1,50 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "core/memory.h"
+
+#define BCACHE_BLOCK_SIZE SECTOR_SIZE
+#define BCACHE_BUF_NUM 512   // 256 KiB of cached blocks
+#define BCACHE_HASH_SIZE 128 // buckets of the (device, block) hash
+#define BCACHE_RUN_MAX 128   // blocks filled by one device request
+#define BCACHE_FLUSH_BLOCKS 64 // blocks written back by one device request
+#define BCACHE_FLUSH_MS 1000        // interval of the flusher
+#define BCACHE_DIRTY_EXPIRE_MS 3000 // age of a dirty block written back
+#define BCACHE_DIRTY_HIGH (BCACHE_BUF_NUM / 2) // wake the flusher early
+#define BCACHE_RA_NUM 16 // ranges queued for reading ahead
+
+/*
+ * A buffer is pinned while its users hold it, and is in lru_list otherwise.
+ * busy is set while the device reads or writes the buffer, and the tasks
+ * looking it up wait until the transfer completes.
+ */
+typedef struct _bcache_buf_t {
+  int dev_id; // -1 if the buffer holds no block
+  uint32_t block;
+  uint8_t *data;
+
+  int pin_cnt;
+  volatile _Bool valid, dirty, busy;
+  uint32_t dirty_tick; // when the buffer became dirty
+
+  list_node_t hash_node, lru_node, dirty_node;
+} bcache_buf_t;
+
+void bcache_init();
+void bcache_start();
+
+bcache_buf_t *bcache_get(int dev_id, uint32_t block);
+void bcache_put(bcache_buf_t *buf);
+void bcache_mark_dirty(bcache_buf_t *buf);
+
+int bcache_read(int dev_id, uint32_t block, void *buf, size_t blocks);
+int bcache_write(int dev_id, uint32_t block, const void *buf, size_t blocks);
+void bcache_readahead(int dev_id, uint32_t block, size_t blocks);
+int bcache_sync(int dev_id);
+void bcache_invalidate(int dev_id);
+
+#endif
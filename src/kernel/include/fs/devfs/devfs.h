@@ -23,5 +23,6 @@ int devfs_write(const void *buf, size_t size, file_t *file);
 int devfs_seek(file_t *file, uint32_t offset, int dir);
 int devfs_stat(file_t *file, struct stat *stat);
 int devfs_ioctl(file_t *file, int cmd, void *arg0, void *arg1);
+int devfs_poll(file_t *file);
 
 #endif
@@ -5,7 +5,8 @@
 #ifndef FATFS_H
 #define FATFS_H
 
-#include "ipc/mutex.h"
+#include "fs/file.h"
+#include "ipc/rwlock.h"
 #include <sys/stat.h>
 
 #define ROOT_ENTRY_SIZE 32
@@ -28,6 +29,10 @@
 #define DIRENT_NAME_FREE 0xE5
 #define DIRENT_NAME_END 0x00
 
+#define FAT_RA_MIN_CLUSTERS 2 // window of the first sequential read
+#define FAT_RA_MAX_CLUSTERS 16
+#define FAT_RA_MAX_BLOCKS (BCACHE_BUF_NUM / 4) // whatever the cluster size
+
 #define CLUSTER_BITS 32
 #define CLUSTER_START_NO 2
 #define FAT_CLUSTER_INVALID 0xFFF8
@@ -45,9 +50,6 @@
     (_dirent->first_cluster_hi << 16) | _dirent->first_cluster_lo;             \
   })
 
-#define get_next_dirent(fat, dirent)                                           \
-  (dirent_t *)((void *)(dirent) + sizeof(dirent_t))
-
 typedef struct _dbr_t {
   struct {
     uint8_t jmp_code[3], oem_id[8];
@@ -83,10 +85,9 @@ typedef struct _fat_t {
   uint32_t fat_start, fat_num;
   uint32_t sectors_per_fat, bytes_per_sector, sectors_per_cluster;
   uint32_t root_entries, root_start, data_start, bytes_per_cluster;
-  void *fat_buf;
-  int curr_sector;
-  struct _fs_t *fs;
-  mutex_t mutex;
+  struct _fs_t *fs; // sectors are accessed through the buffer cache
+
+  rwlock_t rwlock; // exclusive for changing the metadata
 } fat_t;
 
 typedef uint16_t cluster_t;
@@ -94,9 +95,6 @@ typedef struct _fs_t fs_t;
 typedef struct _DIR DIR;
 struct dirent;
 
-int buf_read_sector(fat_t *fat, int sector_no);
-int buf_write_sector(fat_t *fat, int sector_no);
-
 int expand_file(file_t *file, size_t incr);
 
 int fatfs_mount(struct _fs_t *fs, int major_no, int minor_no);
@@ -108,10 +106,11 @@ int fatfs_write(const void *buf, size_t size, file_t *file);
 int fatfs_seek(file_t *file, uint32_t offset, int dir);
 int fatfs_stat(file_t *file, struct stat *stat);
 
-void cluster_unlink(fat_t *fat, const dirent_t *prev, const dirent_t *curr);
+void cluster_unlink(fat_t *fat, const dirent_t *prev, const dirent_t *curr,
+                    const dirent_t *next);
 int fatfs_unlink(fs_t *fs, const char *path);
 
-dirent_t *read_dirent(fat_t *fat, size_t index);
+int read_dirent(fat_t *fat, size_t index, dirent_t *dirent);
 int write_dirent(fat_t *fat, const dirent_t *dirent, size_t index);
 void dirent_get_name(const dirent_t *dirent, char *str_buf);
 file_type_t dirent_get_type(const dirent_t *dirent);
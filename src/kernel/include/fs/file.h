@@ -8,13 +8,18 @@
 #define FILENAME_SIZE 32
 #define FILE_TABLE_SIZE 2048
 
-#include "comm/types.h"
+#define FIONBIO 0x5421 // ioctl: set O_NONBLOCK if arg0 isn't 0, clear it if 0
+
+#include "ipc/mutex.h"
 
 typedef enum _file_type_t {
   UNKNOWN_FILE,
   TTY_FILE,
   DIR_FILE,
-  NORMAL_FILE
+  NORMAL_FILE,
+  DEV_FILE,
+  PIPE_FILE,
+  BLOCK_FILE // a device addressed in sectors, read and written in bytes
 } file_type_t;
 
 struct _fs_t;
@@ -28,6 +33,12 @@ typedef struct _file_t {
 
   struct _fs_t *fs;
   size_t dirent_index, cluster_start, curr_cluster;
+  uint32_t ra_pos;    // where a sequential read would continue
+  uint32_t ra_window; // clusters read ahead, 0 for random access
+  uint32_t ra_end;    // index of the cluster where reading ahead stopped
+  void *data; // private to the file system, e.g. the pipe of PIPE_FILE
+
+  mutex_t mutex; // protect pos and curr_cluster among tasks sharing the file
 } file_t;
 
 file_t *file_alloc();
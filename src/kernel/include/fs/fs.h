@@ -7,13 +7,16 @@
 
 #include "applib/lib_syscall.h"
 #include "fs/fatfs/fatfs.h"
+#include <sys/fcntl.h>
 
 #define MOUNTPOINT_SIZE 512
 #define FS_TABLE_SIZE 10
 
 #define DIRENT_NAME_LEN 255
 
-typedef enum _fs_type_t { DEVFS, FAT16 } fs_type_t;
+#define file_acc_mode(file) ((file)->mode & O_ACCMODE)
+
+typedef enum _fs_type_t { DEVFS, FAT16, PIPEFS } fs_type_t;
 
 typedef struct _fs_t fs_t;
 
@@ -28,6 +31,7 @@ typedef struct _fs_api_t {
   int (*seek)(file_t *file, uint32_t offset, int dir);
   int (*stat)(file_t *file, struct stat *stat);
   int (*ioctl)(file_t *file, int cmd, void *arg0, void *arg1);
+  int (*poll)(file_t *file); // return the POLL* events ready right now
   int (*unlink)(fs_t *fs, const char *path);
 
   int (*opendir)(fs_t *fs, const char *name, DIR *dir);
@@ -47,22 +51,33 @@ typedef struct _fs_t {
   union {
     struct _fat_t fat_data;
   };
-  mutex_t *mutex;
+  rwlock_t *rwlock;
 } fs_t;
 
+_Bool file_nonblock(const file_t *file);
+ssize_t fs_read(file_t *file, void *buf, size_t len);
+ssize_t fs_write(file_t *file, const void *buf, size_t len);
+ssize_t fs_rw_at(file_t *file, void *buf, size_t len, int offset,
+                 _Bool write);
+int fs_seek(file_t *file, int offset, int whence);
+void fs_close(file_t *file);
+
 int sys_open(const char *path, flag_t flag, ...);
 ssize_t sys_read(int fd, void *buf, size_t len);
 ssize_t sys_write(int fd, const void *buf, size_t len);
 int sys_lseek(int fd, int offset, int whence);
 int sys_close(int fd);
 int sys_ioctl(int fd, int cmd, void *arg0, void *arg1);
+int sys_fcntl(int fd, int cmd, int arg);
 
 int sys_isatty(int fd);
 int sys_fstat(int fd, struct stat *buf);
 int sys_dup(int fd);
+int sys_dup2(int old_fd, int new_fd);
 int sys_unlink(const char *pathname);
 
 void fs_init();
+void fs_shutdown();
 
 int sys_opendir(const char *name, DIR *dir);
 int sys_readdir(DIR *dir, struct dirent *dirent);
@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FS_IO_RING_H
+#define FS_IO_RING_H
+
+#include "comm/io_ring.h"
+#include "ipc/sem.h"
+#include "ipc/wait.h"
+
+#define IO_RING_NUM 16
+
+typedef struct _io_ring_ctx_t {
+  io_ring_t *ring; // user address, valid in the page table of the owner
+  uint32_t entries;
+
+  task_t *owner, *worker;
+  sem_t sq_sem;         // notified when new entries are submitted
+  wait_queue_t cq_wait; // tasks waiting for completions
+  volatile _Bool exiting, done;
+} io_ring_ctx_t;
+
+void io_ring_init();
+void io_ring_destroy(task_t *task);
+
+int sys_io_ring_setup(io_ring_t *ring, uint32_t entries);
+int sys_io_ring_enter(uint32_t to_submit, uint32_t min_complete);
+
+#endif
@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "core/memory.h"
+#include "fs/file.h"
+#include "ipc/mutex.h"
+#include "ipc/wait.h"
+
+#define PIPE_NUM 32
+#define PIPE_SIZE MEM_PAGE_SIZE
+
+/*
+ * A ring of PIPE_SIZE bytes with free-running head and tail,
+ * written through the write end and read through the read end.
+ * The mutex of each end is held from copying to advancing the index, never
+ * while waiting, so the ring has exactly one producer and one consumer.
+ */
+typedef struct _pipe_t {
+  uint8_t *buf; // NULL if the pipe is free
+  volatile uint32_t head, tail;
+  mutex_t read_mutex, write_mutex;
+
+  wait_queue_t read_wait;  // readers waiting for data
+  wait_queue_t write_wait; // writers waiting for free space
+  volatile _Bool reader, writer; // whether each end is still open
+} pipe_t;
+
+void pipe_init();
+
+int sys_pipe(int fds[2]);
+int sys_splice(int fd_in, int fd_out, size_t len);
+
+#endif
@@ -0,0 +1,20 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FS_POLL_H
+#define FS_POLL_H
+
+#include "comm/poll.h"
+#include "fs/file.h"
+
+#define POLL_DEFAULT_MASK (POLLIN | POLLOUT)
+
+void poll_init();
+void poll_notify();
+int file_poll(file_t *file);
+int poll_wait_file(file_t *file, int events, volatile _Bool *cancel);
+
+int sys_poll(struct pollfd *fds, nfds_t nfds, int timeout_ms);
+
+#endif
@@ -0,0 +1,19 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "comm/types.h"
+
+#define FUTEX_WAIT 0 // sleep if *uaddr still equals val
+#define FUTEX_WAKE 1 // wake up at most val tasks waiting on uaddr
+
+#define FUTEX_HASH_SIZE 64
+#define futex_hash(key) (((key) >> 2) % FUTEX_HASH_SIZE)
+
+void futex_init();
+int sys_futex(uint32_t *uaddr, int op, uint32_t val);
+
+#endif
@@ -0,0 +1,12 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef IPC_BENCH_H
+#define IPC_BENCH_H
+
+#define IPC_BENCH_LOOPS 10000
+
+void ipc_bench();
+
+#endif
@@ -7,14 +7,34 @@
 
 #include "core/task.h"
 
+typedef struct _mutex_stat_t {
+  uint32_t acquired;  // times the Mutex was acquired (recursion excluded)
+  uint32_t contended; // times a task was blocked on the Mutex
+  uint64_t hold_cycles, max_hold_cycles; // Unit: TSC cycles
+} mutex_stat_t;
+
+/*
+ * The owner word holds the address of the owner (NULL if the Mutex is free),
+ * and its lowest bit is set once a task waits on the Mutex, so that locking
+ * and unlocking without contention is done by a single cmpxchg.
+ */
+#define MUTEX_CONTENDED 1
+#define mutex_owner(mutex) ((task_t *)((mutex)->owner & ~MUTEX_CONTENDED))
+
 typedef struct _mutex_t {
-  task_t *owner;
+  volatile uint32_t owner;
   int locked_cnt;
-  list_t wait_list;
+  list_t wait_list; // sorted by the priority of waiting tasks
+
+  list_node_t pi_node; // insert to pi_list of the owner when contended
+  uint64_t hold_start;
+  mutex_stat_t stat;
 } mutex_t;
 
 void mutex_init(mutex_t *mutex);
 void mutex_lock(mutex_t *mutex);
+int mutex_timedlock(mutex_t *mutex, uint32_t timeout_ms);
 void mutex_unlock(mutex_t *mutex);
+void mutex_get_stat(const mutex_t *mutex, mutex_stat_t *stat);
 
 #endif
@@ -0,0 +1,24 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef MUTEX_STAT_H
+#define MUTEX_STAT_H
+
+#include "dev/dev.h"
+#include "ipc/mutex.h"
+
+#define MUTEX_STAT_MAX 16
+#define MUTEX_REPORT_SIZE 2048
+
+void mutex_stat_add(mutex_t *mutex, const char *name);
+
+int mutex_stat_open(device_t *dev);
+int mutex_stat_close(const device_t *dev);
+int mutex_stat_read(const device_t *dev, uint32_t addr, void *buf,
+                    size_t size);
+int mutex_stat_write(const device_t *dev, uint32_t addr, const void *buf,
+                     size_t size);
+int mutex_stat_control(const device_t *dev, int cmd, va_list arg_list);
+
+#endif
@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include "core/task.h"
+
+/*
+ * Any number of readers, or a single writer, may hold the lock.
+ * A new reader waits while a writer is waiting, so writers don't starve,
+ * unless it already holds a read lock, which would deadlock with the writer;
+ * the writer holding the lock may lock it again in either mode.
+ */
+typedef struct _rwlock_t {
+  int readers;    // number of readers holding the lock
+  task_t *writer; // the writer holding the lock
+  int write_cnt;
+  list_t read_list, write_list; // waiting readers and writers
+} rwlock_t;
+
+void rwlock_init(rwlock_t *rwlock);
+void rwlock_read_lock(rwlock_t *rwlock);
+void rwlock_write_lock(rwlock_t *rwlock);
+void rwlock_unlock(rwlock_t *rwlock);
+
+#endif
@@ -7,13 +7,18 @@
 
 #include "tools/list.h"
 
+/*
+ * count is -1 when no resource is available and wait_list is not empty,
+ * so that sem_wait and sem_notify only need a cmpxchg while count >= 0.
+ */
 typedef struct _sem_t {
-  int count;
+  volatile uint32_t count;
   list_t wait_list;
 } sem_t;
 
 void sem_init(sem_t *sem, int init_cnt);
 void sem_wait(sem_t *sem);
+int sem_timedwait(sem_t *sem, uint32_t timeout_ms);
 void sem_notify(sem_t *sem);
 int sem_cnt(const sem_t *sem);
 
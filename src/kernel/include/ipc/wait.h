@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef WAIT_H
+#define WAIT_H
+
+#include "core/task.h"
+
+#define WAIT_FOREVER 0 // timeout value which never expires
+
+#define WAIT_OK 0
+#define WAIT_TIMEOUT (-1)
+
+typedef struct _wait_queue_t {
+  list_t wait_list;
+} wait_queue_t;
+
+int wait_block(list_t *wait_list, uint32_t timeout_ms);
+void wait_wakeup(list_t *wait_list, task_t *task);
+
+void wait_queue_init(wait_queue_t *queue);
+int wait_queue_wait(wait_queue_t *queue, uint32_t timeout_ms);
+int wait_queue_wake(wait_queue_t *queue, int cnt);
+
+#endif
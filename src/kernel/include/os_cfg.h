@@ -10,7 +10,9 @@
 
 #define KERNEL_SELECTOR_CS (1 << 3)
 #define KERNEL_SELECTOR_DS (2 << 3)
-#define SYSCALL_SELECTOR (3 << 3)
+#define APP_SELECTOR_CS (3 << 3) // sysexit loads KERNEL_SELECTOR_CS + 16
+#define APP_SELECTOR_DS (4 << 3) // sysexit loads KERNEL_SELECTOR_CS + 24
+#define SYSCALL_SELECTOR (5 << 3)
 #define KERNEL_STACK_SIZE 8192
 
 #define OS_TICKS_MS 10
@@ -30,6 +32,14 @@
 #define TASK_NUM 128
 
 #define ROOT_DEV DEV_DISK, 0xB1 // The first partition of the second disk
+// DEV_VIRTIO, 0x01 or DEV_AHCI, 0x01 for the first partition of vda or sda
 
 #define IDLE_TASK_SIZE 1024
+
+#define IPC_BENCH 0 // measure the cost of mutex_t and sem_t at boot
+#define SYSCALL_BENCH 0 // measure the null syscall latency in the first task
+#define SYSCALL_TRACE 0 // record syscall events and histograms, for strace
+#define EXEC_REPORT 0   // log the latency of every execve
+#define DISK_DMA_DEFAULT 1 // use the IDE bus master by default if it exists
+#define RAMDISK_SIZE (4 * 1024 * 1024) // bytes of /dev/ram0 at boot, or 0
 #endif
@@ -52,6 +52,7 @@ void panic(const char *file, const int line, const char *func,
 #define ASSERT(expr)
 #endif
 
+uint64_t kernel_div_u64(uint64_t dividend, uint32_t divisor);
 int strings_cnt(char *const *start);
 const char *kernel_basename(const char *path);
 
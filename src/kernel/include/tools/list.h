@@ -42,6 +42,7 @@ void list_init(list_t *list);
 
 void list_insert_first(list_t *list, list_node_t *node);
 void list_insert_last(list_t *list, list_node_t *node);
+void list_insert_after(list_t *list, list_node_t *pos, list_node_t *node);
 list_node_t *list_remove_first(list_t *list);
 list_node_t *list_remove(list_t *list, list_node_t *node);
 
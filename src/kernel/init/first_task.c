@@ -3,9 +3,38 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "applib/lib_syscall.h"
+#include "comm/cpu_instr.h"
+#include "core/syscall.h"
 #include "dev/tty.h"
+#include "os_cfg.h"
+
+#if SYSCALL_BENCH
+#define SYSCALL_BENCH_LOOPS 1000
+
+// Average TSC cycles of a getpid() round trip through the kernel
+static uint32_t syscall_cycles(int (*call)(const syscall_args_t *)) {
+  const syscall_args_t args = {.id = SYS_GETPID};
+  const uint32_t start = (uint32_t)read_tsc();
+  for (int i = 0; i < SYSCALL_BENCH_LOOPS; i++)
+    call(&args);
+
+  return ((uint32_t)read_tsc() - start) / SYSCALL_BENCH_LOOPS;
+}
+
+static void syscall_bench() {
+  print_msg("Null syscall via call gate: %d cycles",
+            syscall_cycles(sys_call_gate));
+  if (cpu_has_sep())
+    print_msg("Null syscall via sysenter: %d cycles",
+              syscall_cycles(sys_call_sysenter));
+}
+#endif
 
 int first_task_main() {
+#if SYSCALL_BENCH
+  syscall_bench();
+#endif
+
   for (int i = 0; i < TTY_NUM; i++) {
     const int pid = fork();
     if (pid < 0) {
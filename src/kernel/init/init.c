@@ -3,26 +3,56 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "comm/cpu_instr.h"
+#include "core/boot_stamp.h"
 #include "core/memory.h"
+#include "core/vdso.h"
+#include "dev/ahci.h"
 #include "dev/disk.h"
+#include "dev/pci.h"
+#include "dev/ramdisk.h"
 #include "dev/timer.h"
+#include "dev/virtio_blk.h"
+#include "fs/bcache.h"
 #include "fs/fs.h"
+#include "fs/io_ring.h"
+#include "ipc/futex.h"
+#include "ipc/ipc_bench.h"
+#include "os_cfg.h"
 #include "tools/klib.h"
 #include "tools/log.h"
 
 void kernel_init(const boot_info_t *boot_info) {
   ASSERT(boot_info->ram_regions != 0);
+  boot_stamp_init(boot_info);
+  boot_stamp("kernel entry");
 
   cpu_init();
   irq_init();
   log_init();
+  boot_stamp("kernel_init: cpu, irq, log");
 
   memory_init(boot_info);
+  boot_stamp("kernel_init: memory");
+  pci_init();
+  boot_stamp("kernel_init: pci scan");
   disk_init();
+  boot_stamp("kernel_init: disk identify");
+  ahci_init();
+  boot_stamp("kernel_init: ahci probe");
+  virtio_blk_init();
+  boot_stamp("kernel_init: virtio probe");
+  ramdisk_init();
   fs_init();
+  boot_stamp("kernel_init: fs mount");
 
+  vdso_init();
   time_init();
+  futex_init();
+  io_ring_init();
   task_manager_init();
+  disk_start();
+  bcache_start();
+  boot_stamp("kernel_init: timer, tasks");
 }
 
 void jump_to_first_task() {
@@ -37,5 +67,9 @@ void init_main() {
   log_printf("Kernel is running...");
 
   task_first_init();
+  boot_stamp("first task");
+#if IPC_BENCH
+  ipc_bench(); // the fast paths of mutex_t take effect when a task is running
+#endif
   jump_to_first_task();
 }
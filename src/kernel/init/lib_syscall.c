@@ -4,10 +4,12 @@
 
 #include "applib/lib_syscall.h"
 #include "comm/cpu_instr.h"
+#include "comm/vdso.h"
 #include "core/syscall.h"
 #include "os_cfg.h"
+#include <stddef.h>
 
-int sys_call(const syscall_args_t *args) {
+int sys_call_gate(const syscall_args_t *args) {
   const uint32_t addr[] = {0, SYSCALL_SELECTOR | SELECTOR_RPL0};
   int ret;
   __asm__ __volatile__(
@@ -23,6 +25,36 @@ int sys_call(const syscall_args_t *args) {
   return ret;
 }
 
+/*
+ * The arguments are passed in eax, ebx, esi, edi and ebp,
+ * and the kernel returns to the esp in ecx and the eip in edx.
+ */
+int sys_call_sysenter(const syscall_args_t *args) {
+  const syscall_args_t *ptr = args; // ecx is overwritten
+  int ret;
+  __asm__ __volatile__("push %%ebp\n\t"
+                       "mov %c[arg3](%%ecx), %%ebp\n\t"
+                       "mov %%esp, %%ecx\n\t"
+                       "lea 1f, %%edx\n\t"
+                       "sysenter\n\t"
+                       "1:\n\t"
+                       "pop %%ebp"
+                       : "=a"(ret), "+c"(ptr)
+                       : "a"(args->id), "b"(args->arg0), "S"(args->arg1),
+                         "D"(args->arg2),
+                         [arg3] "i"(offsetof(syscall_args_t, arg3))
+                       : "edx", "memory");
+  return ret;
+}
+
+int sys_call(const syscall_args_t *args) {
+  static int has_sep = -1; // not probed yet
+  if (has_sep < 0)
+    has_sep = cpu_has_sep();
+
+  return has_sep ? sys_call_sysenter(args) : sys_call_gate(args);
+}
+
 void msleep(uint32_t time) {
   if (time <= 0)
     return;
@@ -31,10 +63,8 @@ void msleep(uint32_t time) {
   sys_call(&args);
 }
 
-int getpid() {
-  syscall_args_t args = {.id = SYS_GETPID};
-  return sys_call(&args);
-}
+// Read from the page shared with the kernel instead of making a syscall
+int getpid() { return vdso_data()->pid; }
 
 void print_msg(const char *fmt, int arg) {
   syscall_args_t args = {
@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "ipc/futex.h"
+#include "core/memory.h"
+#include "cpu/irq.h"
+#include "ipc/wait.h"
+#include "tools/log.h"
+
+/*
+ * Tasks waiting on a futex are queued by wait_node in the bucket of the
+ * physical address of the futex word, which is shared by every page table
+ * that maps the word.
+ */
+static list_t futex_queue[FUTEX_HASH_SIZE];
+
+void futex_init() {
+  for (int i = 0; i < FUTEX_HASH_SIZE; i++)
+    list_init(futex_queue + i);
+}
+
+static uint32_t futex_key(const uint32_t *uaddr) {
+  if ((uint32_t)uaddr < MEM_TASK_BASE || (uint32_t)uaddr % sizeof(uint32_t))
+    return 0;
+
+  return memory_get_paddr(get_curr_task()->tss.cr3, (uint32_t)uaddr);
+}
+
+static int futex_wait(uint32_t *uaddr, uint32_t key, uint32_t val) {
+  const irq_state_t state = irq_protect();
+
+  // Nobody can change *uaddr between the comparison and blocking
+  if (*uaddr != val) {
+    irq_unprotect(state);
+    return -1;
+  }
+
+  task_t *curr = get_curr_task();
+  list_t *queue = futex_queue + futex_hash(key);
+  curr->futex_key = key;
+  list_insert_last(queue, &curr->wait_node);
+  wait_block(queue, WAIT_FOREVER);
+
+  irq_unprotect(state);
+  return 0;
+}
+
+static int futex_wake(uint32_t key, uint32_t val) {
+  const irq_state_t state = irq_protect();
+
+  list_t *queue = futex_queue + futex_hash(key);
+  list_node_t *node = list_first(queue);
+  uint32_t woken = 0;
+  while (node && woken < val) {
+    list_node_t *next = list_node_next(node);
+    task_t *task = list_node_parent(node, task_t, wait_node);
+    if (task->futex_key == key) {
+      task->futex_key = 0;
+      wait_wakeup(queue, task);
+      woken++;
+    }
+
+    node = next;
+  }
+
+  if (woken)
+    task_dispatch();
+
+  irq_unprotect(state);
+  return woken;
+}
+
+int sys_futex(uint32_t *uaddr, int op, uint32_t val) {
+  const uint32_t key = futex_key(uaddr);
+  if (!key) {
+    log_printf("Invalid futex address: 0x%x", uaddr);
+    return -1;
+  }
+
+  switch (op) {
+  case FUTEX_WAIT:
+    return futex_wait(uaddr, key, val);
+  case FUTEX_WAKE:
+    return futex_wake(key, val);
+  default:
+    return -1;
+  }
+}
@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "ipc/ipc_bench.h"
+#include "comm/cpu_instr.h"
+#include "cpu/irq.h"
+#include "ipc/mutex.h"
+#include "ipc/sem.h"
+#include "tools/log.h"
+
+/*
+ * Measure the average TSC cycles of an uncontended lock/unlock cycle.
+ * The irq_protect/irq_unprotect pair is the cost which the previous
+ * implementation paid on every operation, shown as the baseline.
+ */
+void ipc_bench() {
+  mutex_t mutex;
+  sem_t sem;
+  mutex_init(&mutex);
+  sem_init(&sem, 1);
+
+  uint64_t start = read_tsc();
+  for (int i = 0; i < IPC_BENCH_LOOPS; i++) {
+    irq_unprotect(irq_protect());
+    irq_unprotect(irq_protect());
+  }
+  const uint32_t irq_cycles = read_tsc() - start;
+
+  start = read_tsc();
+  for (int i = 0; i < IPC_BENCH_LOOPS; i++) {
+    mutex_lock(&mutex);
+    mutex_unlock(&mutex);
+  }
+  const uint32_t mutex_cycles = read_tsc() - start;
+
+  start = read_tsc();
+  for (int i = 0; i < IPC_BENCH_LOOPS; i++) {
+    sem_wait(&sem);
+    sem_notify(&sem);
+  }
+  const uint32_t sem_cycles = read_tsc() - start;
+
+  log_printf("IPC benchmark (TSC cycles per lock/unlock cycle):");
+  log_printf("irq_protect x2: %d", irq_cycles / IPC_BENCH_LOOPS);
+  log_printf("mutex_lock + mutex_unlock: %d", mutex_cycles / IPC_BENCH_LOOPS);
+  log_printf("sem_wait + sem_notify: %d", sem_cycles / IPC_BENCH_LOOPS);
+}
@@ -3,54 +3,195 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "ipc/mutex.h"
+#include "comm/cpu_instr.h"
 #include "cpu/irq.h"
+#include "ipc/wait.h"
+#include "tools/klib.h"
 
 void mutex_init(mutex_t *mutex) {
   mutex->locked_cnt = 0;
-  mutex->owner = NULL;
+  mutex->owner = 0;
   list_init(&mutex->wait_list);
+  list_node_init(&mutex->pi_node);
+  mutex->hold_start = 0;
+  kernel_memset(&mutex->stat, 0, sizeof(mutex_stat_t));
 }
 
-void mutex_lock(mutex_t *mutex) {
+// The owner word has been set before calling it
+static void mutex_acquired(mutex_t *mutex) {
+  mutex->locked_cnt = 1;
+  mutex->hold_start = read_tsc();
+  mutex->stat.acquired++;
+}
+
+static void mutex_released(mutex_t *mutex) {
+  const uint64_t hold_cycles = read_tsc() - mutex->hold_start;
+  mutex->stat.hold_cycles += hold_cycles;
+  if (hold_cycles > mutex->stat.max_hold_cycles)
+    mutex->stat.max_hold_cycles = hold_cycles;
+}
+
+/*
+ * The effective priority of a task is the higher one of its base priority
+ * and the priority of the first (most urgent) waiter of every Mutex it owns.
+ */
+static int pi_priority(const task_t *task) {
+  int priority = task->base_priority;
+  list_for_each_node(&task->pi_list, node) {
+    const mutex_t *mutex = list_node_parent(node, mutex_t, pi_node);
+    const task_t *waiter =
+        list_node_parent(list_first(&mutex->wait_list), task_t, wait_node);
+    priority = max(priority, waiter->priority);
+  }
+
+  return priority;
+}
+
+/*
+ * Recompute the priority of the owner, and propagate the change along the
+ * chain of owners when the owner itself is blocked on another Mutex.
+ */
+static void pi_update(task_t *owner) {
+  while (owner) {
+    const int priority = pi_priority(owner);
+    if (priority == owner->priority)
+      break;
+
+    task_set_priority(owner, priority);
+
+    mutex_t *mutex = owner->wait_mutex;
+    if (!mutex)
+      break;
+
+    list_remove(&mutex->wait_list, &owner->wait_node);
+    task_insert_waiter(&mutex->wait_list, owner);
+    owner = mutex_owner(mutex);
+  }
+}
+
+/*
+ * The contended bit is set iff pi_node is linked to the pi_list of the owner.
+ * A waiter which timed out leaves the Mutex, clearing the contended bit if it
+ * is the last waiter, and the owner gives back the priority it lent.
+ */
+static void mutex_leave(mutex_t *mutex, task_t *curr) {
+  task_t *owner = mutex_owner(mutex);
+  curr->wait_mutex = NULL;
+  if (!owner)
+    return;
+
+  if (list_is_empty(&mutex->wait_list) && (mutex->owner & MUTEX_CONTENDED)) {
+    mutex->owner = (uint32_t)owner;
+    list_remove(&owner->pi_list, &mutex->pi_node);
+  }
+
+  pi_update(owner);
+  task_dispatch();
+}
+
+static int mutex_lock_slow(mutex_t *mutex, task_t *curr, uint32_t timeout_ms) {
   const irq_state_t state = irq_protect();
 
-  task_t *curr = get_curr_task();
-  if (mutex->locked_cnt == 0) { // if the Mutex is available
-    mutex->locked_cnt++;
-    mutex->owner = curr;
-  } else if (mutex->owner == curr)
-    mutex->locked_cnt++;
+  int err = WAIT_OK;
+  if (!cmpxchg(&mutex->owner, 0, (uint32_t)curr)) // released in the meantime
+    mutex_acquired(mutex);
   else { // if the Mutex is owned by other task
-    task_set_block(curr);
-    list_insert_last(&mutex->wait_list, &curr->wait_node);
-    task_dispatch();
+    task_t *owner = mutex_owner(mutex);
+    if (!(mutex->owner & MUTEX_CONTENDED)) {
+      mutex->owner |= MUTEX_CONTENDED; // force the owner into mutex_unlock_slow
+      list_insert_last(&owner->pi_list, &mutex->pi_node);
+    }
+
+    mutex->stat.contended++;
+    curr->wait_mutex = mutex;
+    task_insert_waiter(&mutex->wait_list, curr);
+    pi_update(owner); // lend the priority of curr to the owner
+
+    // The Mutex has been passed to curr unless the waiting timed out
+    err = wait_block(&mutex->wait_list, timeout_ms);
+    if (err < 0)
+      mutex_leave(mutex, curr);
   }
 
   irq_unprotect(state);
+  return err;
 }
 
-void mutex_unlock(mutex_t *mutex) {
+/*
+ * Without contention, the Mutex is taken by a cmpxchg on the owner word,
+ * and the interrupts are left enabled.
+ * Before multitasking starts, no other task can compete for the Mutex.
+ * Return -1 if the Mutex can't be taken within timeout_ms.
+ */
+int mutex_timedlock(mutex_t *mutex, uint32_t timeout_ms) {
+  task_t *curr = get_curr_task();
+  if (!curr)
+    return 0;
+
+  if (mutex_owner(mutex) == curr)
+    mutex->locked_cnt++;
+  else if (!cmpxchg(&mutex->owner, 0, (uint32_t)curr))
+    mutex_acquired(mutex);
+  else
+    return mutex_lock_slow(mutex, curr, timeout_ms);
+
+  return 0;
+}
+
+void mutex_lock(mutex_t *mutex) { mutex_timedlock(mutex, WAIT_FOREVER); }
+
+/*
+ * Pass the Mutex to the most urgent waiter,
+ * and give back the priority inherited from the waiters of this Mutex.
+ */
+static void mutex_unlock_slow(mutex_t *mutex, task_t *curr) {
   const irq_state_t state = irq_protect();
 
-  const task_t *curr = get_curr_task();
-  /*
-   * The Mutex should only be unlocked by the task which lock the Mutex.
-   * If wait_list is not empty, pass the Mutex to the first task of wait_list.
-   */
-  if (mutex->owner == curr) {
-    if (--mutex->locked_cnt == 0) {
-      mutex->owner = NULL;
-
-      if (list_cnt(&mutex->wait_list)) {
-        const list_node_t *node = list_first(&mutex->wait_list);
-        task_t *task = list_node_parent(node, task_t, wait_node);
-        mutex->locked_cnt++;
-        mutex->owner = task;
-        task_set_ready(task);
-        task_dispatch();
-      }
-    }
+  list_remove(&curr->pi_list, &mutex->pi_node);
+  if (list_is_empty(&mutex->wait_list)) // all waiters timed out
+    mutex->owner = 0;
+  else {
+    task_t *task =
+        list_node_parent(list_first(&mutex->wait_list), task_t, wait_node);
+    wait_wakeup(&mutex->wait_list, task);
+    task->wait_mutex = NULL;
+
+    if (list_cnt(&mutex->wait_list)) {
+      mutex->owner = (uint32_t)task | MUTEX_CONTENDED;
+      list_insert_last(&task->pi_list, &mutex->pi_node);
+    } else
+      mutex->owner = (uint32_t)task;
+
+    mutex_acquired(mutex);
+    task_set_priority(task, pi_priority(task));
   }
 
+  task_set_priority(curr, pi_priority(curr));
+  task_dispatch();
+
+  irq_unprotect(state);
+}
+
+/*
+ * The Mutex should only be unlocked by the task which lock the Mutex.
+ * The owner word is cleared by a cmpxchg if no task is waiting,
+ * otherwise the contended bit makes the cmpxchg fail.
+ */
+void mutex_unlock(mutex_t *mutex) {
+  task_t *curr = get_curr_task();
+  if (!curr || mutex_owner(mutex) != curr)
+    return;
+
+  if (--mutex->locked_cnt)
+    return;
+
+  mutex_released(mutex);
+  if (cmpxchg(&mutex->owner, (uint32_t)curr, 0) != (uint32_t)curr)
+    mutex_unlock_slow(mutex, curr);
+}
+
+void mutex_get_stat(const mutex_t *mutex, mutex_stat_t *stat) {
+  const irq_state_t state = irq_protect();
+  *stat = mutex->stat;
   irq_unprotect(state);
 }
@@ -0,0 +1,87 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "ipc/mutex_stat.h"
+#include "core/vdso.h"
+#include "cpu/irq.h"
+#include "tools/klib.h"
+
+const dev_desc_t mutex_stat_desc = {.name = "lockstat",
+                                    .major_no = DEV_LOCKSTAT,
+                                    .open = mutex_stat_open,
+                                    .close = mutex_stat_close,
+                                    .read = mutex_stat_read,
+                                    .write = mutex_stat_write,
+                                    .control = mutex_stat_control};
+
+// The kernel mutexes reported by /dev/lockstat0, which are never freed
+static struct {
+  const char *name;
+  const mutex_t *mutex;
+} mutex_table[MUTEX_STAT_MAX];
+static int mutex_cnt = 0;
+
+void mutex_stat_add(mutex_t *mutex, const char *name) {
+  const irq_state_t state = irq_protect();
+  if (mutex_cnt < MUTEX_STAT_MAX) {
+    mutex_table[mutex_cnt].name = name;
+    mutex_table[mutex_cnt].mutex = mutex;
+    mutex_cnt++;
+  }
+
+  irq_unprotect(state);
+}
+
+// Microseconds if the TSC has been calibrated, otherwise kilo cycles
+static uint32_t cycles_to_time(uint64_t cycles) {
+  const uint32_t khz = vdso_tsc_khz();
+  return khz ? kernel_div_u64(cycles * 1000, khz) : cycles >> 10;
+}
+
+static int format_stat(char *buf, int index) {
+  mutex_stat_t stat;
+  mutex_get_stat(mutex_table[index].mutex, &stat);
+
+  const uint32_t acquired = stat.acquired ? stat.acquired : 1;
+  return kernel_sprintf(buf, "%s: acquired %d, contended %d, hold %d/%d\n",
+                        mutex_table[index].name, stat.acquired,
+                        stat.contended,
+                        cycles_to_time(stat.hold_cycles) / acquired,
+                        cycles_to_time(stat.max_hold_cycles));
+}
+
+int mutex_stat_open(device_t *dev) { return 0; }
+
+int mutex_stat_close(const device_t *dev) { return 0; }
+
+// /dev/lockstat0 reads as one line per mutex, with the average/maximum hold
+int mutex_stat_read(const device_t *dev, uint32_t addr, void *buf,
+                    size_t size) {
+  static char report[MUTEX_REPORT_SIZE];
+  const irq_state_t state = irq_protect();
+
+  int len = kernel_sprintf(report, "Mutexes (hold in %s):\n",
+                           vdso_tsc_khz() ? "us" : "Kcycles") + 1;
+  for (int i = 0; i < mutex_cnt; i++)
+    len += format_stat(report + len, i) + 1;
+
+  if (addr >= (uint32_t)len)
+    size = 0;
+  else {
+    size = min(size, (size_t)(len - addr));
+    kernel_memcpy(buf, report + addr, size);
+  }
+
+  irq_unprotect(state);
+  return size;
+}
+
+int mutex_stat_write(const device_t *dev, uint32_t addr, const void *buf,
+                     size_t size) {
+  return -1;
+}
+
+int mutex_stat_control(const device_t *dev, int cmd, va_list arg_list) {
+  return -1;
+}
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "ipc/rwlock.h"
+#include "cpu/irq.h"
+#include "ipc/wait.h"
+
+void rwlock_init(rwlock_t *rwlock) {
+  rwlock->readers = 0;
+  rwlock->writer = NULL;
+  rwlock->write_cnt = 0;
+  list_init(&rwlock->read_list);
+  list_init(&rwlock->write_list);
+}
+
+/*
+ * Before multitasking starts, no other task can compete for the lock.
+ * A task which holds a read lock isn't tracked per lock, so it passes the
+ * waiting writers of any rwlock, which is only unfair to them.
+ */
+void rwlock_read_lock(rwlock_t *rwlock) {
+  task_t *curr = get_curr_task();
+  if (!curr)
+    return;
+
+  const irq_state_t state = irq_protect();
+
+  if (rwlock->writer == curr)
+    rwlock->write_cnt++;
+  else {
+    if (!rwlock->writer &&
+        (list_is_empty(&rwlock->write_list) || curr->read_locks))
+      rwlock->readers++;
+    else { // counted in readers by the task waking it up
+      list_insert_last(&rwlock->read_list, &curr->wait_node);
+      wait_block(&rwlock->read_list, WAIT_FOREVER);
+    }
+
+    curr->read_locks++;
+  }
+
+  irq_unprotect(state);
+}
+
+void rwlock_write_lock(rwlock_t *rwlock) {
+  task_t *curr = get_curr_task();
+  if (!curr)
+    return;
+
+  const irq_state_t state = irq_protect();
+
+  if (rwlock->writer == curr)
+    rwlock->write_cnt++;
+  else if (!rwlock->writer && !rwlock->readers) {
+    rwlock->writer = curr;
+    rwlock->write_cnt = 1;
+  } else { // the lock has been passed to curr when it returns
+    list_insert_last(&rwlock->write_list, &curr->wait_node);
+    wait_block(&rwlock->write_list, WAIT_FOREVER);
+  }
+
+  irq_unprotect(state);
+}
+
+/*
+ * When the lock becomes free, the waiting readers are preferred after a
+ * writer releases it, and a waiting writer is preferred after the readers.
+ */
+void rwlock_unlock(rwlock_t *rwlock) {
+  task_t *curr = get_curr_task();
+  if (!curr)
+    return;
+
+  const irq_state_t state = irq_protect();
+
+  _Bool by_writer = FALSE;
+  if (rwlock->writer == curr) {
+    by_writer = TRUE;
+    if (--rwlock->write_cnt == 0)
+      rwlock->writer = NULL;
+  } else if (rwlock->readers > 0) {
+    rwlock->readers--;
+    curr->read_locks--;
+  }
+
+  if (!rwlock->writer && !rwlock->readers) {
+    if (list_cnt(&rwlock->read_list) &&
+        (by_writer || list_is_empty(&rwlock->write_list))) {
+      while (list_cnt(&rwlock->read_list)) {
+        list_node_t *node = list_first(&rwlock->read_list);
+        rwlock->readers++;
+        wait_wakeup(&rwlock->read_list,
+                    list_node_parent(node, task_t, wait_node));
+      }
+
+      task_dispatch();
+    } else if (list_cnt(&rwlock->write_list)) {
+      list_node_t *node = list_first(&rwlock->write_list);
+      task_t *task = list_node_parent(node, task_t, wait_node);
+      rwlock->writer = task;
+      rwlock->write_cnt = 1;
+      wait_wakeup(&rwlock->write_list, task);
+      task_dispatch();
+    }
+  }
+
+  irq_unprotect(state);
+}
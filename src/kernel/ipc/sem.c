@@ -3,41 +3,93 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "ipc/sem.h"
-#include "core/task.h"
+#include "comm/cpu_instr.h"
 #include "cpu/irq.h"
+#include "ipc/wait.h"
+
+#define SEM_WAITING ((uint32_t)-1)
 
 void sem_init(sem_t *sem, int init_cnt) {
   sem->count = init_cnt;
   list_init(&sem->wait_list);
 }
 
-void sem_wait(sem_t *sem) {
+static int sem_wait_slow(sem_t *sem, uint32_t timeout_ms) {
   const irq_state_t state = irq_protect();
 
-  if (sem->count > 0)
+  int err = WAIT_OK;
+  if ((int)sem->count > 0) // notified in the meantime
     sem->count--;
   else {
-    task_t *curr = get_curr_task();
-    task_set_block(curr);
-    list_insert_last(&sem->wait_list, &curr->wait_node);
-    task_dispatch();
+    sem->count = SEM_WAITING;
+    list_insert_last(&sem->wait_list, &get_curr_task()->wait_node);
+    err = wait_block(&sem->wait_list, timeout_ms);
+
+    // The last waiter timed out, and nobody has notified since then
+    if (err < 0 && list_is_empty(&sem->wait_list) &&
+        sem->count == SEM_WAITING)
+      sem->count = 0;
   }
 
   irq_unprotect(state);
+  return err;
 }
 
-void sem_notify(sem_t *sem) {
+static _Bool sem_try_wait(sem_t *sem) {
+  uint32_t count = sem->count;
+  while ((int)count > 0) {
+    const uint32_t prev = cmpxchg(&sem->count, count, count - 1);
+    if (prev == count)
+      return TRUE;
+
+    count = prev;
+  }
+
+  return FALSE;
+}
+
+void sem_wait(sem_t *sem) {
+  if (!sem_try_wait(sem))
+    sem_wait_slow(sem, WAIT_FOREVER);
+}
+
+// Return -1 if no resource is available within timeout_ms
+int sem_timedwait(sem_t *sem, uint32_t timeout_ms) {
+  return sem_try_wait(sem) ? 0 : sem_wait_slow(sem, timeout_ms);
+}
+
+static void sem_notify_slow(sem_t *sem) {
   const irq_state_t state = irq_protect();
 
   if (list_cnt(&sem->wait_list)) {
     list_node_t *curr = list_first(&sem->wait_list);
-    list_remove(&sem->wait_list, curr);
-    task_set_ready(list_node_parent(curr, task_t, wait_node));
+    wait_wakeup(&sem->wait_list, list_node_parent(curr, task_t, wait_node));
+    if (list_is_empty(&sem->wait_list))
+      sem->count = 0;
+
     task_dispatch();
-  } else
+  } else if (sem->count == SEM_WAITING) // all waiters timed out
+    sem->count = 1;
+  else
     sem->count++;
 
   irq_unprotect(state);
 }
 
-int sem_cnt(const sem_t *sem) { return sem->count; }
+void sem_notify(sem_t *sem) {
+  uint32_t count = sem->count;
+  while (count != SEM_WAITING) {
+    const uint32_t prev = cmpxchg(&sem->count, count, count + 1);
+    if (prev == count)
+      return;
+
+    count = prev;
+  }
+
+  sem_notify_slow(sem);
+}
+
+int sem_cnt(const sem_t *sem) {
+  const int count = sem->count;
+  return count > 0 ? count : 0;
+}
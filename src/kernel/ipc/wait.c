@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2024 Integral <integral@member.fsf.org>
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "ipc/wait.h"
+#include "cpu/irq.h"
+#include "os_cfg.h"
+
+/*
+ * Block the current task, which has been inserted to wait_list by wait_node,
+ * until wait_wakeup is called or timeout_ms expires.
+ * A timed wait also puts the task to sleep_list, and task_time_tick removes it
+ * from wait_list when the sleeping is due.
+ * Interrupts should be disabled by the caller, so that the condition checked
+ * before blocking can't change until the task is queued.
+ */
+int wait_block(list_t *wait_list, uint32_t timeout_ms) {
+  task_t *curr = get_curr_task();
+  curr->wait_list = wait_list;
+  curr->wait_status = WAIT_OK;
+
+  task_set_block(curr);
+  if (timeout_ms != WAIT_FOREVER)
+    task_set_sleep(curr, (timeout_ms + (OS_TICKS_MS - 1)) / OS_TICKS_MS);
+
+  task_dispatch();
+  return curr->wait_status;
+}
+
+// The caller should dispatch afterwards
+void wait_wakeup(list_t *wait_list, task_t *task) {
+  list_remove(wait_list, &task->wait_node);
+  task->wait_list = NULL;
+
+  if (task->state == TASK_SLEEPING) // cancel the timeout
+    task_set_wakeup(task);
+
+  task_set_ready(task);
+}
+
+void wait_queue_init(wait_queue_t *queue) { list_init(&queue->wait_list); }
+
+int wait_queue_wait(wait_queue_t *queue, uint32_t timeout_ms) {
+  const irq_state_t state = irq_protect();
+
+  list_insert_last(&queue->wait_list, &get_curr_task()->wait_node);
+  const int err = wait_block(&queue->wait_list, timeout_ms);
+
+  irq_unprotect(state);
+  return err;
+}
+
+// Wake up at most cnt tasks in FIFO order, and return the number of them
+int wait_queue_wake(wait_queue_t *queue, int cnt) {
+  const irq_state_t state = irq_protect();
+
+  int woken = 0;
+  for (; woken < cnt && list_cnt(&queue->wait_list); woken++) {
+    list_node_t *node = list_first(&queue->wait_list);
+    wait_wakeup(&queue->wait_list, list_node_parent(node, task_t, wait_node));
+  }
+
+  if (woken)
+    task_dispatch();
+
+  irq_unprotect(state);
+  return woken;
+}
@@ -244,6 +244,14 @@ char *kernel_strrchr(const char *str, int c) {
   return ptr;
 }
 
+// Divide without __udivdi3, which is unavailable as libgcc isn't linked
+uint64_t kernel_div_u64(uint64_t dividend, uint32_t divisor) {
+  const uint32_t hi = dividend >> 32;
+  uint32_t lo = dividend, rem = hi % divisor;
+  __asm__("divl %[d]" : "+a"(lo), "+d"(rem) : [d] "rm"(divisor));
+  return ((uint64_t)(hi / divisor) << 32) | lo;
+}
+
 int strings_cnt(char *const *start) {
   int count = 0;
 
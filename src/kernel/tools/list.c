@@ -35,6 +35,25 @@ void list_insert_last(list_t *list, list_node_t *node) {
   list->count++;
 }
 
+// Insert node behind pos, or at the head of the list if pos is NULL
+void list_insert_after(list_t *list, list_node_t *pos, list_node_t *node) {
+  if (!pos) {
+    list_insert_first(list, node);
+    return;
+  }
+
+  node->prev = pos;
+  node->next = pos->next;
+
+  if (pos->next)
+    pos->next->prev = node;
+  else
+    list->last = node;
+
+  pos->next = node;
+  list->count++;
+}
+
 list_node_t *list_remove_first(list_t *list) {
   if (list_is_empty(list))
     return NULL;
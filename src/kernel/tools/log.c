@@ -40,7 +40,7 @@ int log_printf(const char *fmt, ...) {
 #if LOG_COM
   const char *p = str_buf;
   while (*p != '\0') {
-    while (!inb((COM1_PORT + 5) & (1 << 6)))
+    while (!(inb(COM1_PORT + 5) & (1 << 6)))
       ; // Check whether the port is busy
     outb(COM1_PORT, *p++);
   }
@@ -8,6 +8,9 @@
 #include "comm/boot_info.h"
 #include "comm/cpu_instr.h"
 
+#define KERNEL_START_SECTOR 100
+#define KERNEL_MAX_SECTORS 500
+
 void protected_mode_entry();
 
 typedef struct SMAP_entry {
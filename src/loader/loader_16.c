@@ -67,9 +67,11 @@ static void enter_protected_mode() {
   // make a far jump to clear the pipeline
 }
 
-void loader_entry() {
+void loader_entry(uint64_t boot_tsc) {
+  boot_info.boot_stamp[BOOT_STAMP_BOOT_ENTRY] = boot_tsc;
   show_msg("Loading...\r\n");
   detect_memory();
+  boot_info.boot_stamp[BOOT_STAMP_MEMORY_PROBE] = read_tsc();
   enter_protected_mode();
   while (1)
     ;
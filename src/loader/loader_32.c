@@ -77,14 +77,47 @@ void enable_paging() {
   write_cr0(cr0 | CR0_PG);
 }
 
+/*
+ * Read the first sector, which holds the ELF header and the program headers,
+ * and then only the sectors covered by the segments.
+ */
+static void read_kernel(uint8_t *buf) {
+  read_disk(KERNEL_START_SECTOR, 1, buf);
+
+  const Elf32_Ehdr *elf_hdr = (Elf32_Ehdr *)buf;
+  uint32_t size = elf_hdr->e_phoff + elf_hdr->e_phnum * sizeof(Elf32_Phdr);
+  if (size > SECTOR_SIZE) { // unexpected layout, read as much as possible
+    read_disk(KERNEL_START_SECTOR + 1, KERNEL_MAX_SECTORS - 1,
+              buf + SECTOR_SIZE);
+    return;
+  }
+
+  for (int i = 0; i < elf_hdr->e_phnum; i++) {
+    const Elf32_Phdr *phdr = (Elf32_Phdr *)(buf + elf_hdr->e_phoff) + i;
+    if (phdr->p_type == PT_LOAD && phdr->p_offset + phdr->p_filesz > size)
+      size = phdr->p_offset + phdr->p_filesz;
+  }
+
+  uint32_t sectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  if (sectors > KERNEL_MAX_SECTORS)
+    sectors = KERNEL_MAX_SECTORS;
+
+  if (sectors > 1)
+    read_disk(KERNEL_START_SECTOR + 1, sectors - 1, buf + SECTOR_SIZE);
+}
+
 void load_kernel() {
-  // read from sector 100 and read 500 sectors
-  read_disk(100, 500, (uint8_t *)SYS_KERNEL_START_ADDR);
+  boot_info.boot_stamp[BOOT_STAMP_LOAD_KERNEL] = read_tsc();
+  read_kernel((uint8_t *)SYS_KERNEL_START_ADDR);
+  boot_info.boot_stamp[BOOT_STAMP_KERNEL_READ] = read_tsc();
+
   const uint32_t kernel_entry =
       reload_elf_file((uint8_t *)SYS_KERNEL_START_ADDR);
   if (!kernel_entry)
     panic(); // verify the kernel_entry
 
+  boot_info.boot_stamp[BOOT_STAMP_KERNEL_RELOAD] = read_tsc();
+
   enable_paging();
   ((void (*)(boot_info_t *))kernel_entry)(&boot_info); // jump into the kernel
 }
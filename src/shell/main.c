@@ -139,8 +139,9 @@ static void print_cat_help() {
   puts("--help              display this help and exit");
 }
 
+// Read the standard input if filename is NULL, e.g. at the end of a pipeline
 static int print_file(const char *filename, _Bool line_no, show_mode_t mode) {
-  FILE *fp = fopen(filename, "r");
+  FILE *fp = filename ? fopen(filename, "r") : stdin;
   if (!fp) {
     printf("%s: %s: No such file or directory\n", mode == CAT ? "cat" : "less",
            filename);
@@ -161,33 +162,45 @@ static int print_file(const char *filename, _Bool line_no, show_mode_t mode) {
     }
 
   } else {
-    setvbuf(stdin, NULL, _IONBF, 0);
-    ioctl(0, TTY_CMD_ECHO, NULL, NULL);
+    // Keys come from the terminal on stderr if the text comes from a pipe
+    const int key_fd = isatty(0) ? 0 : 2;
+    ioctl(key_fd, TTY_CMD_ECHO, NULL, NULL);
     while (1) {
       if (!fgets(buf, STR_BUF_SIZE, fp))
         break;
 
       fputs(buf, stdout);
+      fflush(stdout);
 
       char key;
-      while ((key = fgetc(stdin)) != 'n') {
-        if (key == 'q')
+      do {
+        if (read(key_fd, &key, 1) <= 0 || key == 'q')
           goto exit_less;
-      }
+      } while (key != 'n');
     }
 
   exit_less:
-    setvbuf(stdin, NULL, _IOLBF, BUFSIZ);
-    ioctl(0, TTY_CMD_ECHO, (void *)1, NULL);
+    ioctl(key_fd, TTY_CMD_ECHO, (void *)1, NULL);
   }
 
   free(buf);
-  fclose(fp);
+  if (fp != stdin)
+    fclose(fp);
+
   return 0;
 }
 
 static int cmd_cat(int argc, char **argv) {
   switch (argc) {
+  case 1:
+    if (isatty(0)) { // the builtin would never see the end of the TTY
+      puts("Missing filename!");
+      print_cat_help();
+      return -1;
+    }
+
+    print_file(NULL, FALSE, CAT);
+    break;
   case 2:
     if (!strcmp(argv[1], "--help"))
       print_cat_help();
@@ -224,9 +237,14 @@ static int cmd_less(int argc, char **argv) {
   case 0: // The execution of less finishes
     return 0;
   case 1:
-    puts("Missing filename!");
-    print_less_help();
-    return -1;
+    if (isatty(0)) { // the text would have to be typed between the keys
+      puts("Missing filename!");
+      print_less_help();
+      return -1;
+    }
+
+    print_file(NULL, FALSE, LESS);
+    break;
   case 2:
     if (!strcmp(argv[1], "--help"))
       print_less_help();
@@ -389,6 +407,108 @@ static void run_exec_file(const char *path, int argc, char **argv) {
   }
 }
 
+static _Bool is_pipeline(int argc, char **argv) {
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "|"))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+// Run a command of a pipeline in the forked child, never return
+static void exec_pipeline_cmd(int argc, char **argv) {
+  const cmd_t *cmd = find_builtin_cmd(*argv);
+  if (cmd)
+    exit(cmd->func(argc, argv)); // flush the output to the pipe
+
+  const char *path = find_exec_file(*argv);
+  if (path)
+    execve(path, argv, NULL);
+
+  eprintf(ERR_STR("Command not found: %s"), *argv);
+  exit(-1);
+}
+
+/*
+ * Run "cmd1 | cmd2 | ...", the standard output of every command is connected
+ * to the standard input of the next one by a pipe.
+ * Every command runs in its own child, including the builtin ones.
+ */
+static void run_pipeline(int argc, char **argv) {
+  char **cmd_argv[PIPELINE_MAX_CMDS] = {argv};
+  int cmd_argc[PIPELINE_MAX_CMDS] = {0}, cmd_cnt = 1;
+
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "|")) {
+      cmd_argc[cmd_cnt - 1]++;
+      continue;
+    }
+
+    argv[i] = NULL; // terminate the arguments of the previous command
+    if (!cmd_argc[cmd_cnt - 1] || cmd_cnt == PIPELINE_MAX_CMDS) {
+      eprintf(ERR_STR("Invalid pipeline!"));
+      return;
+    }
+
+    cmd_argv[cmd_cnt] = argv + i + 1;
+    cmd_argc[cmd_cnt++] = 0;
+  }
+
+  if (!cmd_argc[cmd_cnt - 1]) {
+    eprintf(ERR_STR("Invalid pipeline!"));
+    return;
+  }
+
+  fflush(stdout); // don't duplicate the buffered output in the children
+  int in_fd = -1, child_cnt = 0;
+  for (int i = 0; i < cmd_cnt; i++) {
+    int fds[2] = {-1, -1};
+    if (i < cmd_cnt - 1 && pipe(fds) < 0) {
+      eprintf(ERR_STR("Failed to create pipe!"));
+      break;
+    }
+
+    const int pid = fork();
+    if (pid == 0) { // child process
+      if (in_fd >= 0) {
+        dup2(in_fd, 0);
+        close(in_fd);
+      }
+
+      if (fds[1] >= 0) {
+        dup2(fds[1], 1);
+        close(fds[0]);
+        close(fds[1]);
+      }
+
+      exec_pipeline_cmd(cmd_argc[i], cmd_argv[i]);
+    }
+
+    // The parent keeps no end, so that EOF reaches the next command
+    if (in_fd >= 0)
+      close(in_fd);
+
+    if (fds[1] >= 0)
+      close(fds[1]);
+
+    in_fd = fds[0];
+    if (pid < 0) {
+      eprintf(ERR_STR("Fork failed! Command = %s"), *cmd_argv[i]);
+      break;
+    }
+
+    child_cnt++;
+  }
+
+  if (in_fd >= 0)
+    close(in_fd);
+
+  int status;
+  while (child_cnt--)
+    wait(&status);
+}
+
 static void cli_init(const char *prompt, const cmd_t *cmd_list, size_t size) {
   cli.prompt = PROMPT;
   memset(cli.input_buf, 0, CLI_INPUT_SIZE);
@@ -458,6 +578,11 @@ passwd_correct:
     if (!argc)
       continue;
 
+    if (is_pipeline(argc, argv)) {
+      run_pipeline(argc, argv);
+      continue;
+    }
+
     const cmd_t *cmd = find_builtin_cmd(*argv);
     if (cmd) {
       run_builtin_cmd(cmd, argc, argv);
@@ -9,6 +9,7 @@
 
 #define CLI_INPUT_SIZE 1024
 #define CMD_MAX_ARGC 10
+#define PIPELINE_MAX_CMDS 4
 #define STR_BUF_SIZE 1024
 #define CP_BUF_SIZE 1024
 
@@ -27,8 +28,8 @@
 #define EXIT_USAGE "- exit from shell"
 #define LS_USAGE "[OPTION] - list directory contents"
 #define CAT_USAGE                                                              \
-  "[OPTION] FILE - concatenate files and print on the standard output"
-#define LESS_USAGE "FILE - file perusal filter for crt viewing"
+  "[OPTION] [FILE] - concatenate files and print on the standard output"
+#define LESS_USAGE "[FILE] - file perusal filter for crt viewing"
 #define CP_USAGE "SOURCE DEST - copy files and directories"
 #define RM_USAGE "- remove files or directories"
 #define POWEROFF_USAGE "- power off the machine"